@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+
+// Benchmarks of the server's data structures, built with -DREDISPP_BENCH=ON and best run from a Release build:
+// `redispp-bench [name...]` runs the named ones, or all of them.
+namespace redispp::bench {
+using Clock = std::chrono::steady_clock;
+
+// How long OpsPerSec runs an operation for.
+static constexpr auto MinDuration = std::chrono::milliseconds(500);
+
+// Keeps the compiler from dropping a result that isn't otherwise used.
+template <typename T>
+void DoNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Calls `op(i)` with i = 0, 1, ... for at least MinDuration and returns how many calls a second it made.
+template <typename Op>
+auto OpsPerSec(Op &&op) -> double {
+  const auto start = Clock::now();
+  size_t calls = 0;
+  for (size_t batch = 1;; batch *= 2) {
+    for (const auto end = calls + batch; calls < end; calls++) {
+      op(calls);
+    }
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+    if (elapsed >= MinDuration) {
+      return static_cast<double>(calls) / elapsed.count();
+    }
+  }
+}
+
+// Counts the bytes allocated through it and not freed yet, to measure the memory of data structures.
+class CountingResource : public std::pmr::memory_resource {
+ public:
+  [[nodiscard]] auto InUse() const noexcept -> size_t { return m_in_use; }
+
+ private:
+  auto do_allocate(size_t bytes, size_t alignment) -> void * override {
+    m_in_use += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *ptr, size_t bytes, size_t alignment) override {
+    m_in_use -= bytes;
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+  }
+  [[nodiscard]] auto do_is_equal(const memory_resource &other) const noexcept -> bool override {
+    return this == &other;
+  }
+
+  size_t m_in_use = 0;
+};
+
+void HyperLogLog();
+// Starts the server built with the benchmarks.
+void Connections();
+void Stream();
+void SortedSet();
+}  // namespace redispp::bench
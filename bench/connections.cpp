@@ -0,0 +1,118 @@
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+namespace redispp::bench {
+static constexpr uint16_t Port = 56379;
+static constexpr size_t MaxConnections = 10'000;
+
+static auto vm_rss(pid_t pid) -> size_t {
+  std::ifstream status(fmt::format("/proc/{}/status", pid));
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.starts_with("VmRSS:")) {
+      return std::stoul(line.substr(6)) * 1024;
+    }
+  }
+  throw std::runtime_error("No VmRSS in /proc/<pid>/status");
+}
+
+static auto connect_to_server() -> int {
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(Port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    const auto err = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw std::system_error(err, std::generic_category(), "connect");
+  }
+  return fd;
+}
+
+// A command and its reply, so that the server has accepted the connection and run a command on it before it's idle.
+static void round_trip(int fd) {
+  static constexpr std::string_view Request = "*2\r\n$3\r\nGET\r\n$5\r\nbench\r\n";
+  std::array<char, 64> reply{};
+  if (::write(fd, Request.data(), Request.size()) != static_cast<ssize_t>(Request.size()) ||
+      ::read(fd, reply.data(), reply.size()) <= 0) {
+    throw std::runtime_error("No reply from the server");
+  }
+}
+
+// Runs the server built with the benchmarks and returns its pid once it accepts connections.
+static auto start_server() -> pid_t {
+  const auto pid = ::fork();
+  if (pid == 0) {
+    // Quiet: the server reports every connection it drops on shutdown.
+    const int null = ::open("/dev/null", O_WRONLY);
+    ::dup2(null, STDOUT_FILENO);
+    const auto port = std::to_string(Port);
+    ::execl(REDISPP_SERVER, REDISPP_SERVER, "--port", port.c_str(), nullptr);
+    ::_exit(127);
+  }
+  for (int attempt = 0; attempt < 100; attempt++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    try {
+      const int fd = connect_to_server();
+      round_trip(fd);
+      ::close(fd);
+      return pid;
+    } catch (const std::exception &) {
+      // Not listening yet
+    }
+  }
+  ::kill(pid, SIGKILL);
+  ::waitpid(pid, nullptr, 0);
+  throw std::runtime_error("The server didn't start: " REDISPP_SERVER);
+}
+
+// The server's memory for each idle connection, measured as the growth of its resident set.
+void Connections() {
+  // The server inherits the limit.
+  rlimit files{};
+  ::getrlimit(RLIMIT_NOFILE, &files);
+  files.rlim_cur = files.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE, &files);
+  const auto count = std::min<size_t>(MaxConnections, files.rlim_cur - 64);
+
+  const auto pid = start_server();
+  const auto before = vm_rss(pid);
+  std::vector<int> fds;
+  for (size_t i = 0; i < count; i++) {
+    fds.push_back(connect_to_server());
+    round_trip(fds.back());
+  }
+  const auto after = vm_rss(pid);
+
+  fmt::print("{} idle connections: VmRSS {} KB -> {} KB, {} bytes per connection\n", count, before / 1024,
+             after / 1024, (after - before) / count);
+
+  for (const int fd : fds) {
+    ::close(fd);
+  }
+  ::kill(pid, SIGTERM);
+  ::waitpid(pid, nullptr, 0);
+}
+}  // namespace redispp::bench
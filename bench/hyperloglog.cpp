@@ -0,0 +1,82 @@
+#include "hyperloglog.h"
+
+#include <fmt/core.h>
+
+#include <cstdint>
+#include <string>
+
+#include "bench.h"
+
+namespace redispp::bench {
+// The encoding byte of the Redis format, after the magic.
+static auto is_sparse(const std::pmr::string &hll) -> bool { return hll[4] == 1; }
+
+static auto element(size_t i) -> std::string { return fmt::format("element:{}", i); }
+
+static auto make_hll(size_t first, size_t count) -> std::pmr::string {
+  std::pmr::string hll;
+  hll::Init(hll);
+  for (size_t i = first; i < first + count; i++) {
+    hll::Add(hll, element(i));
+  }
+  return hll;
+}
+
+static void accuracy() {
+  fmt::print("PFCOUNT vs the exact cardinality (standard error 0.81%):\n");
+  std::pmr::string hll;
+  hll::Init(hll);
+  size_t added = 0;
+  for (const size_t size : {10, 100, 1'000, 10'000, 100'000, 1'000'000}) {
+    for (; added < size; added++) {
+      hll::Add(hll, element(added));
+    }
+    const auto count = hll::Count(hll);
+    fmt::print("  {:>9} elements: {:>9} counted, error {:+.2f}% ({})\n", size, count,
+               100 * (static_cast<double>(count) - static_cast<double>(size)) / static_cast<double>(size),
+               is_sparse(hll) ? "sparse" : "dense");
+  }
+}
+
+// `size` elements are added to HyperLogLogs: few enough for the sparse encoding, or enough for the dense one.
+static void throughput(size_t size) {
+  const auto hll = make_hll(0, size);
+  const auto other = make_hll(size / 2, size);
+  fmt::print("{} encoding, {} elements:\n", is_sparse(hll) ? "sparse" : "dense", size);
+
+  // New elements; a sparse HyperLogLog starts over before it's promoted to dense.
+  auto target = hll;
+  const auto add = OpsPerSec([&](size_t i) {
+    if (is_sparse(hll) && i % size == 0) {
+      target = hll;
+    }
+    DoNotOptimize(hll::Add(target, element(size + i)));
+  });
+  fmt::print("  PFADD   {:>12.0f} ops/s\n", add);
+
+  // The cached cardinality is invalidated, as an update would, so that it's estimated each time.
+  target = hll;
+  const auto count = OpsPerSec([&](size_t /*i*/) {
+    target[hll::HeaderSize - 1] = static_cast<char>(target[hll::HeaderSize - 1] | 0x80);
+    DoNotOptimize(hll::Count(target));
+  });
+  fmt::print("  PFCOUNT {:>12.0f} ops/s\n", count);
+
+  // PFMERGE dest hll other, as it's executed.
+  std::pmr::string dest;
+  const auto merge = OpsPerSec([&](size_t /*i*/) {
+    hll::RawRegisters raw{};
+    hll::Merge(raw, hll);
+    hll::Merge(raw, other);
+    hll::StoreDense(dest, raw);
+    DoNotOptimize(dest);
+  });
+  fmt::print("  PFMERGE {:>12.0f} ops/s\n", merge);
+}
+
+void HyperLogLog() {
+  accuracy();
+  throughput(200);
+  throughput(100'000);
+}
+}  // namespace redispp::bench
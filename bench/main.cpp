@@ -0,0 +1,45 @@
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <string_view>
+
+#include "bench.h"
+
+struct Benchmark {
+  std::string_view name;
+  void (*run)();
+};
+
+static constexpr std::array Benchmarks{
+    Benchmark{"hll", redispp::bench::HyperLogLog},
+    Benchmark{"connections", redispp::bench::Connections},
+    Benchmark{"stream", redispp::bench::Stream},
+    Benchmark{"zset", redispp::bench::SortedSet},
+};
+
+auto main(int argc, char *argv[]) -> int {
+  const std::span args(argv, argc);
+  const std::span<char *> names = args.subspan(1);
+
+  for (std::string_view name : names) {
+    if (std::none_of(Benchmarks.begin(), Benchmarks.end(), [&](const auto &bench) { return bench.name == name; })) {
+      fmt::print("Usage: {} [benchmark...], benchmarks:", args[0]);
+      for (const auto &bench : Benchmarks) {
+        fmt::print(" {}", bench.name);
+      }
+      fmt::print("\n");
+      return 1;
+    }
+  }
+
+  for (const auto &bench : Benchmarks) {
+    const auto selected = [&](std::string_view name) { return bench.name == name; };
+    if (names.empty() || std::any_of(names.begin(), names.end(), selected)) {
+      fmt::print("== {}\n", bench.name);
+      bench.run();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include "sorted_set.h"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+
+namespace redispp::bench {
+static constexpr size_t RangeLength = 100;
+
+static auto less(const zset::Element &lhs, const zset::Element &rhs) noexcept -> bool {
+  if (lhs.score != rhs.score) {
+    return lhs.score < rhs.score;
+  }
+  return *lhs.member < *rhs.member;
+}
+
+// Redis' skiplist, which ScoreTree replaces as the order of sorted sets: nodes of random heights (p = 1/4, up to 32)
+// whose forward links count the elements they skip, so that ranks are found in O(log n) too.
+class SkipList {
+  struct Node;
+  struct Level {
+    Node *forward;
+    size_t span;
+  };
+  struct Node {
+    zset::Element element;
+    Node *backward;
+    size_t height;
+
+    // Allocated right after the node.
+    auto levels() noexcept -> Level * { return reinterpret_cast<Level *>(this + 1); }
+  };
+
+ public:
+  static constexpr size_t MaxLevel = 32;
+
+  explicit SkipList(std::pmr::memory_resource *alloc) : m_alloc(alloc), m_head(new_node(MaxLevel, {})) {}
+  SkipList(const SkipList &) = delete;
+  auto operator=(const SkipList &) -> SkipList & = delete;
+  ~SkipList() {
+    for (auto *node = m_head; node != nullptr;) {
+      auto *next = node->levels()[0].forward;
+      m_alloc->deallocate(node, node_bytes(node->height), alignof(Node));
+      node = next;
+    }
+  }
+
+  void Insert(zset::Element element, std::mt19937_64 &rng) {
+    std::array<Node *, MaxLevel> update{};
+    std::array<size_t, MaxLevel> rank{};
+    auto *node = m_head;
+    for (size_t i = m_level; i-- > 0;) {
+      rank[i] = i + 1 == m_level ? 0 : rank[i + 1];
+      while (node->levels()[i].forward != nullptr && less(node->levels()[i].forward->element, element)) {
+        rank[i] += node->levels()[i].span;
+        node = node->levels()[i].forward;
+      }
+      update[i] = node;
+    }
+
+    const auto height = random_height(rng);
+    for (; m_level < height; m_level++) {
+      update[m_level] = m_head;
+      m_head->levels()[m_level].span = m_length;
+    }
+
+    auto *inserted = new_node(height, element);
+    for (size_t i = 0; i < height; i++) {
+      auto &prev = update[i]->levels()[i];
+      inserted->levels()[i] = {prev.forward, prev.span - (rank[0] - rank[i])};
+      prev = {inserted, rank[0] - rank[i] + 1};
+    }
+    for (size_t i = height; i < m_level; i++) {
+      update[i]->levels()[i].span++;
+    }
+    inserted->backward = update[0] == m_head ? nullptr : update[0];
+    if (auto *next = inserted->levels()[0].forward) {
+      next->backward = inserted;
+    }
+    m_length++;
+  }
+
+  // The number of elements before `element`, which must be in the list.
+  [[nodiscard]] auto Rank(zset::Element element) const noexcept -> size_t {
+    size_t rank = 0;
+    auto *node = m_head;
+    for (size_t i = m_level; i-- > 0;) {
+      while (node->levels()[i].forward != nullptr && !less(element, node->levels()[i].forward->element)) {
+        rank += node->levels()[i].span;
+        node = node->levels()[i].forward;
+      }
+    }
+    return rank - 1;
+  }
+
+  // Calls func(score) for up to `count` elements from the first scored at least `score`.
+  template <typename Func>
+  void Range(double score, size_t count, Func &&func) const {
+    auto *node = m_head;
+    for (size_t i = m_level; i-- > 0;) {
+      while (node->levels()[i].forward != nullptr && node->levels()[i].forward->element.score < score) {
+        node = node->levels()[i].forward;
+      }
+    }
+    for (node = node->levels()[0].forward; node != nullptr && count != 0; node = node->levels()[0].forward, count--) {
+      func(node->element.score);
+    }
+  }
+
+ private:
+  static auto node_bytes(size_t height) noexcept -> size_t { return sizeof(Node) + height * sizeof(Level); }
+
+  static auto random_height(std::mt19937_64 &rng) -> size_t {
+    size_t height = 1;
+    while (height < MaxLevel && (rng() & 3) == 0) {
+      height++;
+    }
+    return height;
+  }
+
+  auto new_node(size_t height, zset::Element element) -> Node * {
+    auto *node = new (m_alloc->allocate(node_bytes(height), alignof(Node))) Node{element, nullptr, height};
+    for (size_t i = 0; i < height; i++) {
+      new (node->levels() + i) Level{nullptr, 0};
+    }
+    return node;
+  }
+
+  std::pmr::memory_resource *m_alloc;
+  Node *m_head;
+  size_t m_level = 1;
+  size_t m_length = 0;
+};
+
+// The same operations on both, so that they're timed alike.
+struct TreeOps {
+  zset::ScoreTree tree;
+
+  explicit TreeOps(std::pmr::memory_resource *alloc) : tree(alloc) {}
+  void Insert(zset::Element element, std::mt19937_64 & /*rng*/) { tree.Insert(element); }
+  [[nodiscard]] auto Rank(zset::Element element) const noexcept -> size_t { return tree.Rank(element); }
+  template <typename Func>
+  void Range(double score, size_t count, Func &&func) const {
+    for (auto it = tree.LowerBound(score, false); it.Valid() && count != 0; it.Next(), count--) {
+      func(it.Score());
+    }
+  }
+};
+
+template <typename Order>
+static void measure(std::string_view name, const std::vector<zset::Element> &elements) {
+  std::mt19937_64 rng(1);
+  CountingResource alloc;
+  Order order(&alloc);
+
+  const auto start = Clock::now();
+  for (const auto &element : elements) {
+    order.Insert(element, rng);
+  }
+  const std::chrono::duration<double> insert = Clock::now() - start;
+
+  const auto rank = OpsPerSec([&](size_t /*i*/) { DoNotOptimize(order.Rank(elements[rng() % elements.size()])); });
+  // ZRANGEBYSCORE key <score> +inf LIMIT 0 100, from random scores.
+  const auto range = OpsPerSec([&](size_t /*i*/) {
+    double sum = 0;
+    order.Range(elements[rng() % elements.size()].score, RangeLength, [&](double score) { sum += score; });
+    DoNotOptimize(sum);
+  });
+
+  fmt::print("  {:<9} {:>6.1f} bytes/element, insert {:>9.0f} ops/s, rank {:>9.0f} ops/s, range {:>11.0f} elements/s\n",
+             name, static_cast<double>(alloc.InUse()) / static_cast<double>(elements.size()),
+             static_cast<double>(elements.size()) / insert.count(), rank, range * RangeLength);
+}
+
+// The order of a sorted set, without the member -> score map both keep alongside: its memory, and how fast elements
+// are inserted, ranked and ranges read.
+void SortedSet() {
+  for (const size_t size : {10'000, 1'000'000}) {
+    std::mt19937_64 rng(size);
+    std::uniform_real_distribution<double> score(0, 1e9);
+    std::vector<resp::String> members;
+    members.reserve(size);
+    std::vector<zset::Element> elements;
+    for (size_t i = 0; i < size; i++) {
+      members.push_back(resp::String(fmt::format("member:{}", i)));
+      elements.push_back({score(rng), &members.back()});
+    }
+
+    fmt::print("{} elements, in random order:\n", size);
+    measure<TreeOps>("ScoreTree", elements);
+    measure<SkipList>("skiplist", elements);
+  }
+}
+}  // namespace redispp::bench
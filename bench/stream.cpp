@@ -0,0 +1,46 @@
+#include "stream.h"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdint>
+
+#include "bench.h"
+
+namespace redispp::bench {
+static constexpr size_t Entries = 1'000'000;
+// Entries added in the same millisecond.
+static constexpr size_t EntriesPerMs = 10;
+static constexpr uint64_t FirstMs = 1'700'000'000'000;
+
+// Stream entries as events with the same fields, the common case the macro nodes are laid out for.
+void Stream() {
+  CountingResource alloc;
+  stream::Stream stream(&alloc);
+
+  std::array<resp::String, 6> fields{"user", "", "action", "click", "value", ""};
+  // Timed with the formatting of the values, which is a small part of it.
+  const auto start = Clock::now();
+  for (size_t i = 0; i < Entries; i++) {
+    fields[1] = fmt::format("user:{}", i % 1000);
+    fields[5] = fmt::format("{}", i);
+    stream.Add({FirstMs + i / EntriesPerMs, i % EntriesPerMs}, fields);
+  }
+  const std::chrono::duration<double> add = Clock::now() - start;
+  fmt::print("XADD   {} entries of 3 fields: {:.0f} ops/s, {:.1f} bytes per entry\n", Entries,
+             static_cast<double>(Entries) / add.count(),
+             static_cast<double>(alloc.InUse()) / static_cast<double>(Entries));
+
+  size_t read = 0;
+  size_t bytes = 0;
+  const auto scan_start = Clock::now();
+  stream.Range(stream::ID{}, stream::ID::Max(), Entries, [&](const stream::Node::Cursor &cursor) {
+    cursor.ForEachField([&](std::string_view name, std::string_view value) { bytes += name.size() + value.size(); });
+    read++;
+  });
+  const std::chrono::duration<double> scan = Clock::now() - scan_start;
+  DoNotOptimize(bytes);
+  fmt::print("XRANGE - + over {} entries: {:.1f} ms, {:.0f} entries/s\n", read, scan.count() * 1000,
+             static_cast<double>(read) / scan.count());
+}
+}  // namespace redispp::bench
@@ -0,0 +1,34 @@
+#include <boost/asio/io_context.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "resp_serde.h"
+#include "test_utils.h"
+
+namespace redispp::test {
+static auto parse(std::string_view input, std::mt19937 &rng, size_t max_segment) -> Parsed {
+  boost::asio::io_context io;
+  SegmentedReader reader{input, &rng, max_segment};
+  resp::Deserializer deserializer(reader);
+  return RunCoroutine(io, ReadAll(deserializer, reader));
+}
+}  // namespace redispp::test
+
+// The first byte seeds how the rest is split in segments of 1 to 7 bytes, which must parse the same as when it's read
+// at once.
+extern "C" auto LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) -> int {
+  using namespace redispp::test;
+  if (size == 0) {
+    return 0;
+  }
+  const std::string_view input(reinterpret_cast<const char *>(data) + 1, size - 1);
+  std::mt19937 rng(data[0]);
+  if (parse(input, rng, 7) != parse(input, rng, std::numeric_limits<size_t>::max())) {
+    __builtin_trap();
+  }
+  return 0;
+}
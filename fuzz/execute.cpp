@@ -0,0 +1,97 @@
+#include <fmt/core.h>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/io_context.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "db.h"
+#include "exec.h"
+#include "resp_serde.h"
+#include "test_utils.h"
+
+namespace redispp::test {
+// MIGRATE connects to other servers. The name is still encoded, e.g. "$7\r\nmigrate\r\n".
+static auto runnable(const std::vector<std::string> &command) -> bool {
+  if (command.empty()) {
+    return true;
+  }
+  auto name = command.front();
+  std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+  return name.find("MIGRATE") == std::string::npos;
+}
+
+// Runs the command as a client of `db` would. Commands that block are woken up, as when their client goes away; any
+// other exception than the ones Execute turns into error replies escapes, as it would drop the connection.
+static void execute(boost::asio::io_context &io, DB &db, Client &client, const std::string &request,
+                    std::mt19937 &rng) {
+  SegmentedReader reader{request, &rng, 7};
+  resp::Deserializer deserializer(reader);
+  bool done = false;
+  std::exception_ptr error;
+  Response response;
+  boost::asio::co_spawn(io, redispp::Execute(db, client, deserializer), [&](std::exception_ptr e, Response r) {
+    done = true;
+    error = e;
+    response = std::move(r);
+  });
+
+  io.restart();
+  io.poll();
+  if (!done) {
+    db.GetBlocking().Abort(client);
+    io.restart();
+    io.poll();
+  }
+  if (!done) {
+    __builtin_trap();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  std::string reply;
+  response.Encode(reply, client.GetProtocol());
+}
+}  // namespace redispp::test
+
+// The first byte seeds how requests are split in segments; the rest is parsed into commands, which run one after
+// another against the same DB.
+extern "C" auto LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) -> int {
+  using namespace redispp;
+  using namespace redispp::test;
+  if (size == 0) {
+    return 0;
+  }
+  std::mt19937 rng(data[0]);
+  const std::string_view input(reinterpret_cast<const char *>(data) + 1, size - 1);
+
+  boost::asio::io_context io;
+  SegmentedReader reader{input, &rng, std::numeric_limits<size_t>::max()};
+  resp::Deserializer deserializer(reader);
+  // Invalid input ends the session, after the commands before it.
+  const auto commands = RunCoroutine(io, ReadAll(deserializer, reader)).commands;
+
+  DB db;
+  db.SetCompressionThreshold(64);
+  Client client(io.get_executor(), OutputLimits{});
+  db.RegisterClient(client);
+  for (const auto &command : commands) {
+    if (!runnable(command)) {
+      continue;
+    }
+    auto request = fmt::format("*{}\r\n", command.size());
+    for (const auto &tok : command) {
+      request += tok;
+    }
+    execute(io, db, client, request, rng);
+  }
+  db.UnregisterClient(client);
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include "bitops.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#if defined(REDISPP_X86)
+#include <immintrin.h>
+#endif
+
+namespace redispp::bits {
+static auto load_word(const unsigned char *p) noexcept -> uint64_t {
+  uint64_t word = 0;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// Big endian, so that the first bit of the bitmap is the most significant one.
+static auto load_be_word(const unsigned char *p) noexcept -> uint64_t {
+  const auto word = load_word(p);
+  return std::endian::native == std::endian::little ? __builtin_bswap64(word) : word;
+}
+
+[[gnu::always_inline]] static inline auto count_words(const unsigned char *p, size_t len) noexcept -> uint64_t {
+  uint64_t count = 0;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    count += std::popcount(load_word(p + i));
+  }
+  for (; i < len; i++) {
+    count += std::popcount(p[i]);
+  }
+  return count;
+}
+
+template <Op op>
+[[gnu::always_inline]] static inline void apply_words(unsigned char *dst, const unsigned char *src,
+                                                      size_t len) noexcept {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    auto word = load_word(dst + i);
+    const auto other = load_word(src + i);
+    word = op == Op::And ? word & other : op == Op::Or ? word | other : word ^ other;
+    std::memcpy(dst + i, &word, sizeof(word));
+  }
+  for (; i < len; i++) {
+    dst[i] = op == Op::And ? dst[i] & src[i] : op == Op::Or ? dst[i] | src[i] : dst[i] ^ src[i];
+  }
+}
+
+#if defined(REDISPP_X86)
+[[gnu::target("popcnt")]] static auto count_popcnt(const unsigned char *p, size_t len) noexcept -> uint64_t {
+  return count_words(p, len);
+}
+
+// Nibble lookup with PSHUFB (Mula et al.). Byte counters are flushed with PSADBW before they can overflow.
+[[gnu::target("avx2,popcnt")]] static auto count_avx2(const unsigned char *p, size_t len) noexcept -> uint64_t {
+  const auto lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2,
+                                       3, 2, 3, 3, 4);
+  const auto low_mask = _mm256_set1_epi8(0x0f);
+  const auto zero = _mm256_setzero_si256();
+  auto total = zero;
+
+  static constexpr size_t BlocksPerFlush = 31;  // 31 * 8 bits per byte < 256
+  size_t i = 0;
+  while (i + sizeof(__m256i) <= len) {
+    auto counts = zero;
+    for (size_t n = 0; n < BlocksPerFlush && i + sizeof(__m256i) <= len; n++, i += sizeof(__m256i)) {
+      const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+      const auto lo = _mm256_and_si256(v, low_mask);
+      const auto hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+      counts = _mm256_add_epi8(counts, _mm256_shuffle_epi8(lookup, lo));
+      counts = _mm256_add_epi8(counts, _mm256_shuffle_epi8(lookup, hi));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+  }
+
+  const auto count = static_cast<uint64_t>(_mm256_extract_epi64(total, 0)) +
+                     static_cast<uint64_t>(_mm256_extract_epi64(total, 1)) +
+                     static_cast<uint64_t>(_mm256_extract_epi64(total, 2)) +
+                     static_cast<uint64_t>(_mm256_extract_epi64(total, 3));
+  return count + count_words(p + i, len - i);
+}
+
+template <Op op>
+[[gnu::target("avx2")]] static void apply_avx2(unsigned char *dst, const unsigned char *src, size_t len) noexcept {
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= len; i += sizeof(__m256i)) {
+    const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+    const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    const auto v = op == Op::And  ? _mm256_and_si256(a, b)
+                   : op == Op::Or ? _mm256_or_si256(a, b)
+                                  : _mm256_xor_si256(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+  }
+  apply_words<op>(dst + i, src + i, len - i);
+}
+#endif
+
+auto Count(std::string_view data) noexcept -> uint64_t {
+  const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+#if defined(REDISPP_X86)
+  if (utils::HasAvx2()) {
+    return count_avx2(p, data.size());
+  }
+  if (utils::HasPopcnt()) {
+    return count_popcnt(p, data.size());
+  }
+#endif
+  return count_words(p, data.size());
+}
+
+template <Op op>
+static void apply(unsigned char *dst, const unsigned char *src, size_t len) noexcept {
+#if defined(REDISPP_X86)
+  if (utils::HasAvx2()) {
+    apply_avx2<op>(dst, src, len);
+    return;
+  }
+#endif
+  apply_words<op>(dst, src, len);
+}
+
+void Apply(Op op, std::span<const std::string_view> srcs, std::pmr::string &dst) {
+  size_t len = 0;
+  for (auto src : srcs) {
+    len = std::max(len, src.size());
+  }
+  dst.assign(len, '\0');
+  if (srcs.empty()) {
+    return;
+  }
+
+  auto *out = reinterpret_cast<unsigned char *>(dst.data());
+  std::memcpy(out, srcs.front().data(), srcs.front().size());
+
+  if (op == Op::Not) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+      const auto word = ~load_word(out + i);
+      std::memcpy(out + i, &word, sizeof(word));
+    }
+    for (; i < len; i++) {
+      out[i] = static_cast<unsigned char>(~out[i]);
+    }
+    return;
+  }
+
+  for (auto src : srcs.subspan(1)) {
+    const auto *in = reinterpret_cast<const unsigned char *>(src.data());
+    switch (op) {
+      case Op::And:
+        apply<Op::And>(out, in, src.size());
+        std::memset(out + src.size(), 0, len - src.size());
+        break;
+      case Op::Or:
+        apply<Op::Or>(out, in, src.size());
+        break;
+      case Op::Xor:
+      case Op::Not:
+        apply<Op::Xor>(out, in, src.size());
+        break;
+    }
+  }
+}
+
+auto FindFirst(std::string_view data, bool bit) noexcept -> std::optional<uint64_t> {
+  const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+  // Skips whole words that can't contain the bit.
+  const uint64_t skip = bit ? 0 : ~uint64_t{0};
+
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+    const auto word = load_be_word(p + i);
+    if (word != skip) {
+      return i * 8 + std::countl_zero(bit ? word : ~word);
+    }
+  }
+  for (; i < data.size(); i++) {
+    const auto byte = static_cast<unsigned char>(bit ? p[i] : ~p[i]);
+    if (byte != 0) {
+      return i * 8 + std::countl_zero(byte);
+    }
+  }
+  return {};
+}
+
+auto GetField(std::string_view data, uint64_t offset, unsigned width) noexcept -> uint64_t {
+  uint64_t value = 0;
+  for (uint64_t pos = offset; pos < offset + width; pos++) {
+    const auto byte = pos / 8;
+    const auto set = byte < data.size() && (static_cast<unsigned char>(data[byte]) & (0x80 >> (pos % 8))) != 0;
+    value = (value << 1) | (set ? 1 : 0);
+  }
+  return value;
+}
+
+void SetField(std::pmr::string &data, uint64_t offset, unsigned width, uint64_t value) noexcept {
+  for (unsigned i = 0; i < width; i++) {
+    const auto pos = offset + i;
+    const auto mask = static_cast<char>(0x80 >> (pos % 8));
+    if (((value >> (width - 1 - i)) & 1) != 0) {
+      data[pos / 8] = static_cast<char>(data[pos / 8] | mask);
+    } else {
+      data[pos / 8] = static_cast<char>(data[pos / 8] & ~mask);
+    }
+  }
+}
+}  // namespace redispp::bits
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Bitmaps are strings addressed the Redis way: bit 0 is the most significant bit of the first byte.
+namespace redispp::bits {
+enum class Op { And, Or, Xor, Not };
+
+// Number of set bits, using AVX2 or POPCNT when the CPU has them.
+auto Count(std::string_view data) noexcept -> uint64_t;
+
+// Offset of the first bit equal to `bit`.
+auto FindFirst(std::string_view data, bool bit) noexcept -> std::optional<uint64_t>;
+
+// Sets `dst` to the sources combined with `op`, as long as the longest one; shorter sources are zero padded.
+// NOT takes a single source. `dst` must not alias the sources.
+void Apply(Op op, std::span<const std::string_view> srcs, std::pmr::string &dst);
+
+// Unsigned field of `width` (<= 64) bits at bit `offset`; bits past the end read as zero.
+auto GetField(std::string_view data, uint64_t offset, unsigned width) noexcept -> uint64_t;
+
+// `data` must hold the whole field.
+void SetField(std::pmr::string &data, uint64_t offset, unsigned width, uint64_t value) noexcept;
+}  // namespace redispp::bits
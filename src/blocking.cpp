@@ -0,0 +1,142 @@
+#include "blocking.h"
+
+#include <algorithm>
+
+#include "db.h"
+
+namespace redispp::blocking {
+void Registry::Block(Waiter &waiter) {
+  waiter.m_positions.clear();
+  for (size_t i = 0; i < waiter.keys.size(); i++) {
+    const auto &key = waiter.keys[i];
+    auto it = m_queues.find(key);
+    if (it == m_queues.end()) {
+      it = m_queues.emplace(resp::String(key, m_queues.get_allocator().resource()), Queue{}).first;
+    }
+
+    // The same key given twice is waited on once.
+    auto &queue = it->second;
+    if (!queue.empty() && queue.back() == &waiter) {
+      continue;
+    }
+    waiter.m_positions.push_back({i, &queue, queue.insert(queue.end(), &waiter)});
+  }
+  waiter.client->SetWaiter(&waiter);
+}
+
+void Registry::Unblock(Waiter &waiter) noexcept {
+  for (const auto &pos : waiter.m_positions) {
+    pos.queue->erase(pos.it);
+    if (pos.queue->empty() && pos.queue != m_serving) {
+      m_queues.erase(m_queues.find(waiter.keys[pos.key_index]));
+    }
+  }
+  waiter.m_positions.clear();
+  if (waiter.client->GetWaiter() == &waiter) {
+    waiter.client->SetWaiter(nullptr);
+  }
+}
+
+void Registry::Abort(Client &client) noexcept {
+  auto *waiter = client.GetWaiter();
+  if (waiter == nullptr) {
+    return;
+  }
+  Unblock(*waiter);
+  waiter->aborted = true;
+  waiter->timer.cancel();
+}
+
+void Registry::SignalReady(std::string_view key) {
+  if (m_queues.contains(key) && std::find(m_ready.begin(), m_ready.end(), key) == m_ready.end()) {
+    m_ready.emplace_back(key);
+  }
+}
+
+void Registry::ServeReady() {
+  // Serving BLMOVE pushes to its destination, which can make more keys ready.
+  for (size_t i = 0; i < m_ready.size(); i++) {
+    const auto key = std::move(m_ready[i]);
+    auto it = m_queues.find(key);
+    if (it == m_queues.end()) {
+      continue;
+    }
+
+    auto &queue = it->second;
+    m_serving = &queue;
+    for (auto pos = queue.begin(); pos != queue.end();) {
+      auto &waiter = **pos++;
+      if (!serve(waiter, key)) {
+        break;
+      }
+    }
+    m_serving = nullptr;
+
+    if (queue.empty()) {
+      m_queues.erase(it);
+    }
+  }
+  m_ready.clear();
+}
+
+// Returns false once there's nothing left to serve at the key. As in Redis, waiters for another type than the key's are
+// skipped: a list waiter queued ahead of a stream reader mustn't keep the reader from being woken up.
+auto Registry::serve(Waiter &waiter, std::string_view key) -> bool {
+  const auto *value = m_db->Find(key);
+  if (value == nullptr) {
+    return false;
+  }
+  if (waiter.wake_only) {
+    if (value->GetType() == Value::Type::Stream) {
+      waiter.woken = true;
+      Unblock(waiter);
+      waiter.timer.cancel();
+    }
+    return true;
+  }
+  if (value->GetType() != Value::Type::List) {
+    return true;
+  }
+  auto *list = m_db->GetList(key);
+
+  // Elements must not be handed to clients that can't receive them anymore.
+  const auto *input = waiter.client->Input();
+  if (waiter.client->Output().IsClosed() || (input != nullptr && input->InputClosed())) {
+    Abort(*waiter.client);
+    return true;
+  }
+
+  List *destination = nullptr;
+  if (waiter.destination != nullptr) {
+    try {
+      destination = m_db->GetList(*waiter.destination);
+    } catch (const WrongTypeError &) {
+      // As in Redis, the client stays blocked until it can be served or times out.
+      return true;
+    }
+  }
+
+  // The keys change now, not when the blocked command resumes, so clients caching them are told now.
+  auto element = PopElement(*list, waiter.from);
+  m_db->GetTracking().Invalidate(key, waiter.client->Id());
+  if (waiter.destination != nullptr) {
+    if (destination == nullptr) {
+      destination = &m_db->CreateList(*waiter.destination);
+    }
+    PushElement(*destination, waiter.to, resp::String(element, element.get_allocator()));
+    m_db->GetTracking().Invalidate(*waiter.destination, waiter.client->Id());
+    SignalReady(*waiter.destination);
+  }
+
+  const auto key_index = std::find(waiter.keys.begin(), waiter.keys.end(), key) - waiter.keys.begin();
+  waiter.served.emplace(static_cast<size_t>(key_index), std::move(element));
+  Unblock(waiter);
+  waiter.timer.cancel();
+
+  if (list->empty()) {
+    m_db->Erase(key);
+    return false;
+  }
+  return true;
+}
+}  // namespace redispp::blocking
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <list>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "list.h"
+#include "resp_serde.h"
+#include "string_hash.h"
+
+namespace redispp {
+class Client;
+class DB;
+
+namespace blocking {
+// A client suspended in BLPOP, BRPOP, BLMOVE or a blocking stream read. It lives in the frame of the blocked command,
+// which waits on `timer`: the timer expiring is the timeout, cancelling it wakes the command up.
+struct Waiter {
+  Waiter(Client &client, std::span<const resp::String> keys, ListEnd from, const boost::asio::any_io_executor &executor)
+      : client(&client), keys(keys), from(from), timer(executor) {}
+
+  Client *client;
+  std::span<const resp::String> keys;
+  ListEnd from;
+  // BLMOVE pushes the element onto this list instead of returning the key it came from.
+  const resp::String *destination = nullptr;
+  ListEnd to = ListEnd::Left;
+
+  // Stream readers aren't handed elements: they're woken up, all of them, and read the stream themselves.
+  bool wake_only = false;
+  bool woken = false;
+
+  // Set when served: which of `keys` the element was popped from, and the element.
+  std::optional<std::pair<size_t, resp::String>> served;
+  // The client went away while blocked.
+  bool aborted = false;
+
+  boost::asio::steady_timer timer;
+
+ private:
+  friend class Registry;
+
+  struct Position {
+    size_t key_index;
+    std::list<Waiter *> *queue;
+    std::list<Waiter *>::iterator it;
+  };
+  std::vector<Position> m_positions;
+};
+
+// Per key queues of blocked clients. Pushes mark keys as ready; once the pushing command is done, the waiters of the
+// ready keys are handed elements in the order they blocked, each wakeup costing O(1) per key the waiter blocked on.
+class Registry {
+ public:
+  explicit Registry(DB &db, std::pmr::memory_resource &alloc) : m_db(&db), m_queues(&alloc), m_ready(&alloc) {}
+
+  void Block(Waiter &waiter);
+  // Removes the waiter from its queues; a no-op when it isn't blocked.
+  void Unblock(Waiter &waiter) noexcept;
+  // Wakes the client's waiter without serving it, e.g. when the connection is closed.
+  void Abort(Client &client) noexcept;
+
+  // Called after pushing to the list, or adding to the stream, at `key`.
+  void SignalReady(std::string_view key);
+  // Serves the waiters of the keys signalled since the last call.
+  void ServeReady();
+
+ private:
+  using Queue = std::list<Waiter *>;
+  using QueueMap = std::pmr::unordered_map<resp::String, Queue, utils::string_hash, std::equal_to<>>;
+
+  auto serve(Waiter &waiter, std::string_view key) -> bool;
+
+  DB *m_db;
+  QueueMap m_queues;
+  std::pmr::vector<resp::String> m_ready;
+  // Not erased when it runs empty while it's being served.
+  const Queue *m_serving = nullptr;
+};
+}  // namespace blocking
+}  // namespace redispp
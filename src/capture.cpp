@@ -0,0 +1,139 @@
+#include "capture.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+namespace redispp::capture {
+// A varint takes at most 10 bytes, and a record's header holds 3.
+static constexpr size_t MaxHeaderSize = 30;
+// How long the writer sleeps when the ring is empty: records wait in the ring at most this long.
+static constexpr auto DrainInterval = std::chrono::milliseconds(10);
+
+static auto put_varint(char *out, uint64_t val) noexcept -> char * {
+  for (; val >= 0x80; val >>= 7) {
+    *out++ = static_cast<char>(val | 0x80);
+  }
+  *out++ = static_cast<char>(val);
+  return out;
+}
+
+static auto get_varint(std::string_view &in, uint64_t &val) noexcept -> bool {
+  val = 0;
+  for (unsigned shift = 0; shift < 64 && !in.empty(); shift += 7) {
+    const auto byte = static_cast<uint8_t>(in.front());
+    in.remove_prefix(1);
+    val |= uint64_t{byte & 0x7fU} << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Recorder::Recorder(const std::string &path, size_t ring_size)
+    : m_file(std::fopen(path.c_str(), "wb"), &std::fclose),
+      m_ring(std::make_unique<char[]>(ring_size)),  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+      m_ring_size(ring_size),
+      m_last(Clock::now()) {
+  if (!m_file || std::fwrite(Magic.data(), 1, Magic.size(), m_file.get()) != Magic.size()) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  m_writer = std::thread([this] { drain(); });
+}
+
+Recorder::~Recorder() {
+  m_stop.store(true, std::memory_order_release);
+  m_writer.join();
+}
+
+void Recorder::Record(uint64_t client_id, std::string_view data) noexcept {
+  const auto now = Clock::now();
+  std::array<char, MaxHeaderSize> header{};
+  auto *end = put_varint(header.data(), std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count());
+  end = put_varint(end, client_id);
+  end = put_varint(end, data.size());
+  const auto header_size = static_cast<size_t>(end - header.data());
+
+  const auto head = m_head.load(std::memory_order_relaxed);
+  const auto size = header_size + data.size();
+  if (head + size - m_cached_tail > m_ring_size) {
+    m_cached_tail = m_tail.load(std::memory_order_acquire);
+    if (head + size - m_cached_tail > m_ring_size) {
+      m_dropped++;
+      return;
+    }
+  }
+
+  copy_in(head, header.data(), header_size);
+  copy_in(head + header_size, data.data(), data.size());
+  m_last = now;
+  m_head.store(head + size, std::memory_order_release);
+}
+
+void Recorder::copy_in(uint64_t pos, const char *data, size_t len) noexcept {
+  const auto offset = pos % m_ring_size;
+  const auto first = std::min(len, m_ring_size - offset);
+  std::copy_n(data, first, m_ring.get() + offset);
+  std::copy_n(data + first, len - first, m_ring.get());
+}
+
+void Recorder::drain() noexcept {
+  auto tail = m_tail.load(std::memory_order_relaxed);
+  bool failed = false;
+
+  for (;;) {
+    // Read before the head: whatever was recorded before stopping is seen, and written out, before leaving.
+    const bool stopping = m_stop.load(std::memory_order_acquire);
+    const auto head = m_head.load(std::memory_order_acquire);
+    if (head == tail) {
+      if (stopping) {
+        break;
+      }
+      std::this_thread::sleep_for(DrainInterval);
+      continue;
+    }
+
+    while (tail != head && !failed) {
+      const auto offset = tail % m_ring_size;
+      const auto len = std::min(head - tail, m_ring_size - offset);
+      if (std::fwrite(m_ring.get() + offset, 1, len, m_file.get()) != len) {
+        fmt::print("Capture stopped, can't write: {}\n", std::generic_category().message(errno));
+        failed = true;
+      }
+      tail += len;
+    }
+    // Once writing fails, records are still taken out of the ring, and discarded.
+    tail = head;
+    m_tail.store(tail, std::memory_order_release);
+  }
+
+  std::fflush(m_file.get());
+}
+
+auto Parse(std::string_view file) -> std::vector<Record> {
+  if (!file.starts_with(Magic)) {
+    throw std::runtime_error("Not a capture file");
+  }
+  file.remove_prefix(Magic.size());
+
+  std::vector<Record> records;
+  uint64_t time = 0;
+  while (!file.empty()) {
+    uint64_t delta = 0;
+    uint64_t client_id = 0;
+    uint64_t len = 0;
+    if (!get_varint(file, delta) || !get_varint(file, client_id) || !get_varint(file, len) || len > file.size()) {
+      break;
+    }
+    time += delta;
+    records.push_back({std::chrono::nanoseconds(time), client_id, file.substr(0, len)});
+    file.remove_prefix(len);
+  }
+  return records;
+}
+}  // namespace redispp::capture
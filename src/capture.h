@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace redispp::capture {
+// Traffic capture: the bytes clients send, as read from their sockets, with when and by which client, so that real
+// traffic can be replayed against a build to compare it with another one (see replay.cpp).
+//
+// The file starts with `Magic`, followed by one record per read: the nanoseconds since the previous record, the client
+// ID and the length of the data, as LEB128 varints, then the data.
+static constexpr std::string_view Magic = "RPPCAP01";
+
+// Records go through a lock-free, single producer and single consumer ring: the server's thread only copies them in,
+// a background thread writes them to the file. Records that don't fit while the writer lags behind are dropped, and
+// counted, rather than slowing the server down.
+class Recorder {
+ public:
+  static constexpr size_t DefaultRingSize = size_t{16} << 20;
+
+  // Throws std::system_error when the file can't be created.
+  explicit Recorder(const std::string &path, size_t ring_size = DefaultRingSize);
+  Recorder(const Recorder &) = delete;
+  auto operator=(const Recorder &) -> Recorder & = delete;
+  // Writes out the records left in the ring and closes the file.
+  ~Recorder();
+
+  // Called by the server's thread only.
+  void Record(uint64_t client_id, std::string_view data) noexcept;
+
+  [[nodiscard]] auto Dropped() const noexcept -> uint64_t { return m_dropped; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void copy_in(uint64_t pos, const char *data, size_t len) noexcept;
+  // The writer thread.
+  void drain() noexcept;
+
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> m_file;
+  std::unique_ptr<char[]> m_ring;  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+  size_t m_ring_size;
+
+  // Positions grow forever and wrap around the ring when indexing it. Each is written by one side only, and kept on
+  // its own cache line so that the two sides don't bounce it back and forth.
+  alignas(64) std::atomic<uint64_t> m_head{0};  // Written by the server's thread
+  uint64_t m_cached_tail = 0;
+  Clock::time_point m_last;
+  uint64_t m_dropped = 0;
+  alignas(64) std::atomic<uint64_t> m_tail{0};  // Written by the writer thread
+  std::atomic<bool> m_stop{false};
+
+  std::thread m_writer;
+};
+
+// A record read back from a capture file; `data` points into the file's contents.
+struct Record {
+  std::chrono::nanoseconds time;  // Since the capture started
+  uint64_t client_id;
+  std::string_view data;
+};
+
+// Parses the contents of a capture file. Throws std::runtime_error when they aren't one; a record cut short, e.g. by
+// the server being killed, ends the capture.
+auto Parse(std::string_view file) -> std::vector<Record>;
+}  // namespace redispp::capture
@@ -0,0 +1,135 @@
+#include "cluster.h"
+
+#include <fmt/format.h>
+
+#include <array>
+#include <iterator>
+
+namespace redispp::cluster {
+static constexpr auto Crc16Table = [] {
+  constexpr uint16_t Poly = 0x1021;
+  std::array<uint16_t, 256> table{};
+
+  for (uint16_t i = 0; i < table.size(); i++) {
+    uint16_t crc = i << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) != 0 ? (crc << 1) ^ Poly : crc << 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}();
+
+static auto crc16(std::string_view buf) noexcept -> uint16_t {
+  uint16_t crc = 0;
+  for (auto c : buf) {
+    crc = (crc << 8) ^ Crc16Table[((crc >> 8) ^ static_cast<uint8_t>(c)) & 0xFF];
+  }
+  return crc;
+}
+
+auto KeyHashSlot(std::string_view key) noexcept -> Slot {
+  auto open = key.find('{');
+  if (open != std::string_view::npos) {
+    auto close = key.find('}', open + 1);
+    if (close != std::string_view::npos && close != open + 1) {
+      key = key.substr(open + 1, close - open - 1);
+    }
+  }
+  return crc16(key) & (SlotCount - 1);
+}
+
+auto Node::Id() const -> std::string { return fmt::format("{}:{}", host, port); }
+
+Cluster::Cluster(Node myself) { m_nodes.push_back(std::move(myself)); }
+
+auto Cluster::AddNode(Node node) -> const Node & {
+  if (const auto *known = FindNode(node.Id())) {
+    return *known;
+  }
+  return m_nodes.emplace_back(std::move(node));
+}
+
+auto Cluster::FindNode(std::string_view id) const noexcept -> const Node * {
+  for (const auto &node : m_nodes) {
+    if (node.Id() == id) {
+      return &node;
+    }
+  }
+  return nullptr;
+}
+
+void Cluster::AssignSlots(Slot first, Slot last, const Node &node) {
+  for (size_t slot = first; slot <= last; slot++) {
+    SetOwner(slot, node);
+  }
+}
+
+void Cluster::SetOwner(Slot slot, const Node &node) {
+  m_owner[slot] = index_of(node);
+  m_migrating[slot] = NoNode;
+  m_importing[slot] = NoNode;
+}
+
+void Cluster::SetMigrating(Slot slot, const Node &node) { m_migrating[slot] = index_of(node); }
+
+void Cluster::SetImporting(Slot slot, const Node &node) { m_importing[slot] = index_of(node); }
+
+void Cluster::SetStable(Slot slot) {
+  m_migrating[slot] = NoNode;
+  m_importing[slot] = NoNode;
+}
+
+auto Cluster::Describe() const -> std::string {
+  std::string out;
+
+  for (const auto &node : m_nodes) {
+    const auto idx = index_of(node);
+    fmt::format_to(std::back_inserter(out),
+                   "{} {}:{}@{} {} - 0 0 0 connected",
+                   node.Id(),
+                   node.host,
+                   node.port,
+                   node.port + 10000,
+                   &node == &Myself() ? "myself,master" : "master");
+
+    for (size_t slot = 0; slot < SlotCount;) {
+      if (m_owner[slot] != idx) {
+        slot++;
+        continue;
+      }
+      auto last = slot;
+      while (last + 1 < SlotCount && m_owner[last + 1] == idx) {
+        last++;
+      }
+      if (last == slot) {
+        fmt::format_to(std::back_inserter(out), " {}", slot);
+      } else {
+        fmt::format_to(std::back_inserter(out), " {}-{}", slot, last);
+      }
+      slot = last + 1;
+    }
+
+    // Migration state is only known locally.
+    for (size_t slot = 0; slot < SlotCount && &node == &Myself(); slot++) {
+      if (m_migrating[slot] != NoNode) {
+        fmt::format_to(std::back_inserter(out), " [{}->-{}]", slot, m_nodes[m_migrating[slot]].Id());
+      }
+      if (m_importing[slot] != NoNode) {
+        fmt::format_to(std::back_inserter(out), " [{}-<-{}]", slot, m_nodes[m_importing[slot]].Id());
+      }
+    }
+    out += '\n';
+  }
+  return out;
+}
+
+auto Cluster::index_of(const Node &node) const noexcept -> NodeIndex {
+  for (NodeIndex i = 0; i < m_nodes.size(); i++) {
+    if (&m_nodes[i] == &node) {
+      return i;
+    }
+  }
+  return NoNode;
+}
+}  // namespace redispp::cluster
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace redispp::cluster {
+using Slot = uint16_t;
+
+static constexpr size_t SlotCount = 16384;
+
+// CRC16 (XMODEM) of the key, or of the non-empty `{hashtag}` inside it, modulo `SlotCount`.
+auto KeyHashSlot(std::string_view key) noexcept -> Slot;
+
+struct Node {
+  std::string host;
+  uint16_t port = 0;
+
+  // Nodes are identified by their "host:port" address.
+  [[nodiscard]] auto Id() const -> std::string;
+};
+
+class Cluster {
+ public:
+  explicit Cluster(Node myself);
+
+  [[nodiscard]] auto Myself() const noexcept -> const Node & { return m_nodes.front(); }
+
+  auto AddNode(Node node) -> const Node &;
+  [[nodiscard]] auto FindNode(std::string_view id) const noexcept -> const Node *;
+
+  void AssignSlots(Slot first, Slot last, const Node &node);
+  void SetOwner(Slot slot, const Node &node);
+  void SetMigrating(Slot slot, const Node &node);
+  void SetImporting(Slot slot, const Node &node);
+  void SetStable(Slot slot);
+
+  [[nodiscard]] auto Owner(Slot slot) const noexcept -> const Node * { return node_at(m_owner[slot]); }
+  [[nodiscard]] auto MigratingTo(Slot slot) const noexcept -> const Node * { return node_at(m_migrating[slot]); }
+  [[nodiscard]] auto ImportingFrom(Slot slot) const noexcept -> const Node * { return node_at(m_importing[slot]); }
+
+  // Node table in the `CLUSTER NODES` format.
+  [[nodiscard]] auto Describe() const -> std::string;
+
+ private:
+  using NodeIndex = uint16_t;
+  static constexpr NodeIndex NoNode = UINT16_MAX;
+
+  [[nodiscard]] auto node_at(NodeIndex idx) const noexcept -> const Node * {
+    return idx == NoNode ? nullptr : &m_nodes[idx];
+  }
+  [[nodiscard]] auto index_of(const Node &node) const noexcept -> NodeIndex;
+
+  // Stable addresses: slot tables and callers hold on to nodes.
+  std::deque<Node> m_nodes;
+  std::vector<NodeIndex> m_owner = std::vector<NodeIndex>(SlotCount, NoNode);
+  std::vector<NodeIndex> m_migrating = std::vector<NodeIndex>(SlotCount, NoNode);
+  std::vector<NodeIndex> m_importing = std::vector<NodeIndex>(SlotCount, NoNode);
+};
+}  // namespace redispp::cluster
@@ -0,0 +1,32 @@
+#pragma once
+
+#if defined(__x86_64__)
+#define REDISPP_X86 1
+#endif
+
+namespace redispp::utils {
+// Runtime checks for code built with `[[gnu::target(...)]]`; always false on other architectures.
+inline auto HasAvx2() noexcept -> bool {
+#if defined(REDISPP_X86)
+  static const bool avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return avx2;
+#else
+  return false;
+#endif
+}
+
+inline auto HasPopcnt() noexcept -> bool {
+#if defined(REDISPP_X86)
+  static const bool popcnt = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("popcnt") != 0;
+  }();
+  return popcnt;
+#else
+  return false;
+#endif
+}
+}  // namespace redispp::utils
@@ -1,73 +1,330 @@
 #pragma once
 
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/smart_ptr/local_shared_ptr.hpp>
+#include <boost/smart_ptr/make_local_shared.hpp>
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <memory_resource>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
+#include "blocking.h"
+#include "cluster.h"
 #include "exec.h"
+#include "list.h"
+#include "lz.h"
+#include "output_queue.h"
+#include "stream.h"
+#include "pubsub.h"
+#include "script.h"
+#include "sorted_set.h"
 #include "string_hash.h"
+#include "tracking.h"
 
 namespace redispp {
 class DB;
 class Executor;
 
 using Transaction = std::vector<exec::Command>;
-using ClientID = uint64_t;
+
+// Thrown by the accessors of one type of value when the key holds another.
+class WrongTypeError : public std::runtime_error {
+ public:
+  WrongTypeError() : std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value") {}
+};
+
+// A string, a list, a stream or a sorted set. Large strings are moved to a shared buffer the first time they're sent,
+// so that replies reference them instead of copying them; a string that's still being sent is copied before it's
+// modified. Strings may also be stored compressed: GET decompresses them straight into the output buffer, GETRANGE
+// decodes the bytes up to the range only and STRLEN reads the original length. Other readers decompress them into a
+// buffer of their own; only writers, Mutable and Take, replace them with the decompressed string.
+class Value {
+ public:
+  enum class Type { String, List, Stream, SortedSet };
+
+  explicit Value(std::pmr::string str) noexcept : m_data(std::move(str)) {}
+  explicit Value(SharedCompressed compressed) noexcept : m_data(std::move(compressed)) {}
+  explicit Value(std::unique_ptr<List> list) noexcept : m_data(std::move(list)) {}
+  explicit Value(std::unique_ptr<stream::Stream> stream) noexcept : m_data(std::move(stream)) {}
+  explicit Value(std::unique_ptr<zset::SortedSet> zset) noexcept : m_data(std::move(zset)) {}
+
+  [[nodiscard]] auto GetType() const noexcept -> Type {
+    if (std::holds_alternative<std::unique_ptr<List>>(m_data)) {
+      return Type::List;
+    }
+    if (std::holds_alternative<std::unique_ptr<stream::Stream>>(m_data)) {
+      return Type::Stream;
+    }
+    return std::holds_alternative<std::unique_ptr<zset::SortedSet>>(m_data) ? Type::SortedSet : Type::String;
+  }
+
+  // The string accessors throw WrongTypeError for other types. A compressed string is decompressed into `scratch`.
+  [[nodiscard]] auto View(std::pmr::string &scratch) const -> std::string_view {
+    if (const auto *compressed = std::get_if<SharedCompressed>(&m_data)) {
+      scratch.clear();
+      lz::Append(**compressed, scratch);
+      return scratch;
+    }
+    return view();
+  }
+
+  auto Mutable() -> std::pmr::string & {
+    inflate();
+    if (auto *str = std::get_if<std::pmr::string>(&m_data)) {
+      return *str;
+    }
+    auto &shared_str = shared();
+    if (shared_str.local_use_count() > 1) {
+      shared_str = allocate(std::pmr::string(*shared_str));
+    }
+    return *shared_str;
+  }
+
+  // A compressed string is shared as a decompressed copy.
+  auto Share() -> SharedValue {
+    if (const auto *compressed = std::get_if<SharedCompressed>(&m_data)) {
+      std::pmr::string str((*compressed)->data.get_allocator());
+      lz::Append(**compressed, str);
+      return allocate(std::move(str));
+    }
+    if (auto *str = std::get_if<std::pmr::string>(&m_data)) {
+      auto shared_str = allocate(std::move(*str));
+      m_data = shared_str;
+      return shared_str;
+    }
+    return shared();
+  }
+
+  auto Take() && -> std::pmr::string {
+    inflate();
+    if (auto *str = std::get_if<std::pmr::string>(&m_data)) {
+      return std::move(*str);
+    }
+    auto &shared_str = shared();
+    return shared_str.local_use_count() > 1 ? std::pmr::string(*shared_str) : std::move(*shared_str);
+  }
+
+  [[nodiscard]] auto Size() const -> size_t {
+    if (const auto *compressed = std::get_if<SharedCompressed>(&m_data)) {
+      return (*compressed)->size;
+    }
+    return view().size();
+  }
+
+  // nullptr unless the string is compressed.
+  [[nodiscard]] auto ShareCompressed() const noexcept -> SharedCompressed {
+    const auto *compressed = std::get_if<SharedCompressed>(&m_data);
+    return compressed != nullptr ? *compressed : nullptr;
+  }
+
+  // Appends bytes [pos, pos + len) of the string to `out`.
+  void Read(size_t pos, size_t len, std::pmr::string &out) const {
+    if (const auto *compressed = std::get_if<SharedCompressed>(&m_data)) {
+      const auto old_size = out.size();
+      out.resize(old_size + pos + len);
+      lz::Decompress((*compressed)->data, out.data() + old_size, pos + len);
+      out.erase(old_size, pos);
+      return;
+    }
+    out += view().substr(pos, len);
+  }
+
+  // List, stream::Stream or zset::SortedSet; nullptr for other types.
+  template <typename T>
+  auto As() noexcept -> T * {
+    auto *ptr = std::get_if<std::unique_ptr<T>>(&m_data);
+    return ptr != nullptr ? ptr->get() : nullptr;
+  }
+
+ private:
+  using SharedString = boost::local_shared_ptr<std::pmr::string>;
+
+  static auto allocate(std::pmr::string str) -> SharedString {
+    const std::pmr::polymorphic_allocator<std::pmr::string> alloc(str.get_allocator());
+    return boost::allocate_local_shared<std::pmr::string>(alloc, std::move(str));
+  }
+
+  void inflate() {
+    if (const auto *compressed = std::get_if<SharedCompressed>(&m_data)) {
+      std::pmr::string str((*compressed)->data.get_allocator());
+      lz::Append(**compressed, str);
+      m_data = std::move(str);
+    }
+  }
+
+  // Not compressed.
+  [[nodiscard]] auto view() const -> std::string_view {
+    if (const auto *str = std::get_if<std::pmr::string>(&m_data)) {
+      return *str;
+    }
+    return *shared();
+  }
+
+  auto shared() const -> const SharedString & {
+    if (const auto *shared_str = std::get_if<SharedString>(&m_data)) {
+      return *shared_str;
+    }
+    throw WrongTypeError();
+  }
+  auto shared() -> SharedString & { return const_cast<SharedString &>(std::as_const(*this).shared()); }
+
+  std::variant<std::pmr::string, SharedString, SharedCompressed, std::unique_ptr<List>,
+                       std::unique_ptr<stream::Stream>, std::unique_ptr<zset::SortedSet>>
+      m_data;
+};
 
 class Client {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  Client(const boost::asio::any_io_executor &executor, OutputLimits output_limits)
+      : m_output(executor, output_limits), m_created(Clock::now()), m_last_active(m_created) {}
+
+  // Peer and local "host:port", for CLIENT LIST and KILL.
+  void SetAddresses(std::string addr, std::string laddr) {
+    m_addr = std::move(addr);
+    m_laddr = std::move(laddr);
+  }
+  [[nodiscard]] auto Address() const noexcept -> std::string_view { return m_addr; }
+  [[nodiscard]] auto LocalAddress() const noexcept -> std::string_view { return m_laddr; }
+
+  // The connection's request reader, for CLIENT LIST.
+  void SetInput(const resp::Deserializer *input) noexcept { m_input = input; }
+  [[nodiscard]] auto Input() const noexcept -> const resp::Deserializer * { return m_input; }
+
+  // Called for every command; idle time is measured from the last one.
+  void SetLastCommand(std::string_view name) noexcept {
+    m_last_command = name;
+    m_last_active = Clock::now();
+  }
+  [[nodiscard]] auto LastCommand() const noexcept -> std::string_view { return m_last_command; }
+  [[nodiscard]] auto Created() const noexcept -> Clock::time_point { return m_created; }
+  [[nodiscard]] auto LastActive() const noexcept -> Clock::time_point { return m_last_active; }
+
+  // Set by ASKING: the next command may touch a slot this node is importing.
+  void SetAsking(bool asking) noexcept { m_asking = asking; }
+  [[nodiscard]] auto IsAsking() const noexcept -> bool { return m_asking; }
+
+  auto Output() noexcept -> OutputQueue & { return m_output; }
+
+  void SetProtocol(resp::Protocol proto) noexcept { m_protocol = proto; }
+  [[nodiscard]] auto GetProtocol() const noexcept -> resp::Protocol { return m_protocol; }
+
+  auto PubSub() -> pubsub::ClientState & {
+    if (!m_pubsub) {
+      m_pubsub = std::make_unique<pubsub::ClientState>();
+    }
+    return *m_pubsub;
+  }
+  [[nodiscard]] auto GetPubSub() const noexcept -> pubsub::ClientState * { return m_pubsub.get(); }
+
+  // Assigned by DB::RegisterClient; ids are never reused.
+  [[nodiscard]] auto Id() const noexcept -> ClientID { return m_id; }
+
+  void SetTracking(std::unique_ptr<tracking::ClientState> state) noexcept { m_tracking = std::move(state); }
+  [[nodiscard]] auto GetTracking() const noexcept -> tracking::ClientState * { return m_tracking.get(); }
+
+  // Set by blocking::Registry while the client is blocked on lists.
+  void SetWaiter(blocking::Waiter *waiter) noexcept { m_waiter = waiter; }
+  [[nodiscard]] auto GetWaiter() const noexcept -> blocking::Waiter * { return m_waiter; }
+
  private:
+  friend class DB;
   friend class Executor;
 
   void AddQueryToCurTxn(exec::Command query) { m_cur_txn.push_back(std::move(query)); }
 
   auto GetAndClearCurTxn() noexcept -> Transaction { return std::exchange(m_cur_txn, {}); }
 
-  ClientID m_id;
+  ClientID m_id = 0;
   DB *m_db = nullptr;
   Transaction m_cur_txn = {};
+  OutputQueue m_output;
+  std::unique_ptr<pubsub::ClientState> m_pubsub;
+  std::unique_ptr<tracking::ClientState> m_tracking;
+  blocking::Waiter *m_waiter = nullptr;
+  const resp::Deserializer *m_input = nullptr;
+  std::string m_addr;
+  std::string m_laddr;
+  std::string_view m_last_command = "NULL";
+  Clock::time_point m_created;
+  Clock::time_point m_last_active;
+  resp::Protocol m_protocol = resp::Protocol::Resp2;
+  bool m_asking = false;
 };
 
 class DB {
  public:
-  explicit DB(std::pmr::memory_resource &alloc = *std::pmr::get_default_resource()) : m_alloc(&alloc) {}
+  explicit DB(std::pmr::memory_resource &alloc = *std::pmr::get_default_resource())
+      : m_alloc(&alloc),
+        m_clients(&alloc),
+        m_pubsub(alloc),
+        m_tracking(*this, alloc),
+        m_scripts(alloc),
+        m_blocking(*this, alloc) {}
+
+  // The string accessors below throw WrongTypeError when the key holds another type of value.
 
-  auto Get(std::string_view key) const noexcept -> std::optional<std::string_view> {
+  // A compressed value is decompressed into `scratch`, and stays compressed in the DB.
+  auto Get(std::string_view key, std::pmr::string &scratch) const -> std::optional<std::string_view> {
     auto it = m_key_vals.find(key);
     if (it == m_key_vals.end()) {
       return {};
     }
-    return it->second;
+    return it->second.View(scratch);
   }
 
-  auto Get(std::string_view key) noexcept -> std::pmr::string * {
+  // For modifying the value in place. Read only commands should use the overload above, which copies nothing but
+  // compressed values.
+  auto Get(std::string_view key) -> std::pmr::string * {
     auto it = m_key_vals.find(key);
     if (it == m_key_vals.end()) {
       return nullptr;
     }
-    return &it->second;
+    return &it->second.Mutable();
   }
 
-  auto GetAndSet(std::pmr::string key, std::pmr::string value) -> std::optional<std::pmr::string> {
+  // The value without decompressing it, for the commands that read compressed strings; nullptr when the key doesn't
+  // exist.
+  auto Find(std::string_view key) const noexcept -> const Value * {
+    auto it = m_key_vals.find(key);
+    return it == m_key_vals.end() ? nullptr : &it->second;
+  }
+
+  // Values at least this long are sent from the DB's buffer instead of being copied into replies.
+  static constexpr size_t SharedValueSize = size_t{64} << 10;
+
+  auto Share(std::string_view key) -> SharedValue {
     auto it = m_key_vals.find(key);
     if (it == m_key_vals.end()) {
-      m_key_vals[std::move(key)] = std::move(value);
       return {};
     }
-    return std::exchange(it->second, std::move(value));
+    return it->second.Share();
   }
 
-  auto GetAndSet(std::string_view key, std::pmr::string value) -> std::optional<std::pmr::string> {
+  auto GetAndSet(std::pmr::string key, std::pmr::string value) -> std::optional<std::pmr::string> {
     auto it = m_key_vals.find(key);
     if (it == m_key_vals.end()) {
-      m_key_vals[key.data()] = std::move(value);
+      m_key_vals.emplace(std::move(key), Value(std::move(value)));
       return {};
     }
-    return std::exchange(it->second, std::move(value));
+    if (it->second.GetType() != Value::Type::String) {
+      throw WrongTypeError();
+    }
+    return std::exchange(it->second, Value(std::move(value))).Take();
+  }
+
+  auto GetAndSet(std::string_view key, std::pmr::string value) -> std::optional<std::pmr::string> {
+    return GetAndSet(NewString(key), std::move(value));
   }
 
   auto Delete(std::string_view key) -> std::optional<std::pmr::string> {
@@ -76,15 +333,146 @@ class DB {
       return {};
     }
 
-    auto ret = std::move(it->second);
+    auto ret = std::move(it->second).Take();
     m_key_vals.erase(it);
     return ret;
   }
 
+  // Replaces the value, whatever its type, like SET. Compresses it when compression is enabled and pays off.
+  void Set(std::pmr::string key, std::pmr::string value) {
+    m_key_vals.insert_or_assign(std::move(key), string_value(std::move(value)));
+  }
+
+  // Strings at least this long are compressed by Set when that saves at least an eighth of their size; 0 disables
+  // compression.
+  void SetCompressionThreshold(size_t size) noexcept { m_compression_threshold = size; }
+
+  // Deletes the value, whatever its type.
+  auto Erase(std::string_view key) -> bool {
+    auto it = m_key_vals.find(key);
+    if (it == m_key_vals.end()) {
+      return false;
+    }
+    m_key_vals.erase(it);
+    return true;
+  }
+
+  [[nodiscard]] auto Exists(std::string_view key) const noexcept -> bool { return m_key_vals.contains(key); }
+
+  // Keys MIGRATE is sending to another node: writes to them are refused until it's done, as it deletes them then.
+  void SetMigrating(std::string_view key, bool migrating) {
+    if (migrating) {
+      m_migrating.insert(NewString(key));
+    } else if (auto it = m_migrating.find(key); it != m_migrating.end()) {
+      m_migrating.erase(it);
+    }
+  }
+  [[nodiscard]] auto IsMigrating(std::string_view key) const noexcept -> bool {
+    return !m_migrating.empty() && m_migrating.contains(key);
+  }
+
+  // nullptr when the key doesn't exist; throws WrongTypeError when it holds another type.
+  auto GetList(std::string_view key) -> List * { return get_as<List>(key); }
+  auto GetStream(std::string_view key) -> stream::Stream * { return get_as<stream::Stream>(key); }
+  auto GetSortedSet(std::string_view key) -> zset::SortedSet * { return get_as<zset::SortedSet>(key); }
+
+  // The key must not exist. Lists are deleted by their last pop, keys never hold empty ones.
+  auto CreateList(std::string_view key) -> List & { return create<List>(key); }
+  // Unlike lists, streams stay when they're emptied.
+  auto CreateStream(std::string_view key) -> stream::Stream & { return create<stream::Stream>(key); }
+  // Deleted by the removal of their last member, like lists.
+  auto CreateSortedSet(std::string_view key) -> zset::SortedSet & { return create<zset::SortedSet>(key); }
+
   auto NewString(std::string_view str = "") -> std::pmr::string { return std::pmr::string{str, m_alloc}; }
+  auto Allocator() const noexcept -> std::pmr::memory_resource & { return *m_alloc; }
+
+  template <typename Func>
+  void ForEach(Func &&func) const {
+    for (const auto &[key, val] : m_key_vals) {
+      func(key, val);
+    }
+  }
+
+  // Cluster mode is enabled by attaching the cluster state; `nullptr` in standalone mode.
+  void SetCluster(cluster::Cluster *cluster) noexcept { m_cluster = cluster; }
+  [[nodiscard]] auto GetCluster() const noexcept -> cluster::Cluster * { return m_cluster; }
+
+  auto GetPubSub() noexcept -> pubsub::Registry & { return m_pubsub; }
+  auto GetTracking() noexcept -> tracking::Table & { return m_tracking; }
+  auto GetScripts() noexcept -> script::Cache & { return m_scripts; }
+  auto GetBlocking() noexcept -> blocking::Registry & { return m_blocking; }
+
+  void RegisterClient(Client &client) {
+    client.m_id = ++m_last_client_id;
+    client.m_db = this;
+    m_clients.emplace(client.m_id, &client);
+  }
+
+  void UnregisterClient(Client &client) {
+    m_blocking.Abort(client);
+    m_tracking.Disable(client);
+    m_pubsub.UnsubscribeAll(client);
+    m_clients.erase(client.m_id);
+  }
+
+  auto FindClient(ClientID id) const noexcept -> Client * {
+    auto it = m_clients.find(id);
+    return it == m_clients.end() ? nullptr : it->second;
+  }
+
+  // `func` must not register or unregister clients; closing their output is fine, as sessions end asynchronously.
+  template <typename Func>
+  void ForEachClient(Func &&func) const {
+    for (const auto &[id, client] : m_clients) {
+      func(*client);
+    }
+  }
 
  private:
+  template <typename T>
+  auto get_as(std::string_view key) -> T * {
+    auto it = m_key_vals.find(key);
+    if (it == m_key_vals.end()) {
+      return nullptr;
+    }
+    auto *val = it->second.As<T>();
+    if (val == nullptr) {
+      throw WrongTypeError();
+    }
+    return val;
+  }
+
+  auto string_value(std::pmr::string str) const -> Value {
+    if (m_compression_threshold == 0 || str.size() < m_compression_threshold) {
+      return Value(std::move(str));
+    }
+    lz::Compressed compressed{std::pmr::string(m_alloc), str.size()};
+    if (!lz::Compress(str, str.size() - str.size() / 8, compressed.data)) {
+      return Value(std::move(str));
+    }
+    compressed.data.shrink_to_fit();
+    const std::pmr::polymorphic_allocator<lz::Compressed> alloc(m_alloc);
+    return Value(SharedCompressed(boost::allocate_local_shared<lz::Compressed>(alloc, std::move(compressed))));
+  }
+
+  template <typename T>
+  auto create(std::string_view key) -> T & {
+    auto val = std::make_unique<T>(m_alloc);
+    auto &ref = *val;
+    m_key_vals.emplace(NewString(key), Value(std::move(val)));
+    return ref;
+  }
+
   std::pmr::memory_resource *m_alloc;
-  std::pmr::unordered_map<std::pmr::string, std::pmr::string, utils::string_hash, std::equal_to<>> m_key_vals{m_alloc};
+  cluster::Cluster *m_cluster = nullptr;
+  size_t m_compression_threshold = 0;
+  std::pmr::unordered_map<std::pmr::string, Value, utils::string_hash, std::equal_to<>> m_key_vals{m_alloc};
+  std::pmr::unordered_set<std::pmr::string, utils::string_hash, std::equal_to<>> m_migrating{m_alloc};
+  ClientID m_last_client_id = 0;
+  std::pmr::unordered_map<ClientID, Client *> m_clients;
+  pubsub::Registry m_pubsub;
+  tracking::Table m_tracking;
+  script::Cache m_scripts;
+  blocking::Registry m_blocking;
 };
 }  // namespace redispp
\ No newline at end of file
@@ -3,20 +3,33 @@
 #include <fmt/format.h>
 
 #include <boost/asio/awaitable.hpp>
-#include <boost/asio/detached.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include <boost/asio/use_awaitable.hpp>
 #include <boost/smart_ptr/make_local_shared.hpp>
 #include <boost/smart_ptr/make_local_shared_object.hpp>
+#include <algorithm>
+#include <cctype>
 #include <charconv>
+#include <chrono>
+#include <cmath>
+#include <span>
 #include <variant>
 
+#include "bitops.h"
+#include "cluster.h"
 #include "db.h"
+#include "hyperloglog.h"
 #include "resp_serde.h"
+#include "script.h"
 #include "string_hash.h"
+#include "tcp_io.h"
 
 using namespace boost::asio::experimental::awaitable_operators;
 using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
 
 namespace redispp {
 using namespace resp;
@@ -36,7 +49,8 @@ static auto to_int(std::string_view str) -> std::optional<Integer> {
   Integer i = 0;
   auto res = std::from_chars(str.begin(), str.end(), i);
 
-  if (res.ec != std::errc{}) {
+  // The whole string, or "12abc" would read as 12.
+  if (res.ec != std::errc{} || res.ptr != str.end()) {
     throw ExecutionException{"CONVERSION_ERROR Invalid Integer"};
   }
   return i;
@@ -70,274 +84,3237 @@ static auto get_int(Token tok) -> Integer {
   throw ExecutionException{"WRONG_INPUT_TYPE Expected Integer"};
 }
 
+// Arguments of a single command, received in full before it is parsed.
+class Arguments {
+ public:
+  explicit Arguments(std::vector<Token> tokens) : m_tokens(std::move(tokens)) {}
+
+  auto Next() -> Token {
+    if (Empty()) {
+      throw ExecutionException{"WRONG_NUMBER_OF_ARGUMENTS"};
+    }
+    return std::move(m_tokens[m_next++]);
+  }
+
+  [[nodiscard]] auto Empty() const noexcept -> bool { return m_next == m_tokens.size(); }
+
+ private:
+  std::vector<Token> m_tokens;
+  size_t m_next = 0;
+};
+
+static auto get_slot(Token tok) -> cluster::Slot {
+  auto slot = get_int(std::move(tok));
+  if (slot < 0 || slot >= Integer(cluster::SlotCount)) {
+    throw ExecutionException{"INVALID_SLOT"};
+  }
+  return static_cast<cluster::Slot>(slot);
+}
+
+static auto get_port(Token tok) -> uint16_t {
+  auto port = get_int(std::move(tok));
+  if (port <= 0 || port > UINT16_MAX) {
+    throw ExecutionException{"INVALID_PORT"};
+  }
+  return static_cast<uint16_t>(port);
+}
+
+// Bitmaps are limited to 512MB, like in Redis.
+static constexpr Integer MaxBitOffset = (Integer(1) << 32) - 1;
+
+static auto get_bit_offset(Token tok) -> Integer {
+  auto offset = get_int(std::move(tok));
+  if (offset < 0 || offset > MaxBitOffset) {
+    throw ExecutionException{"BIT_OFFSET_OUT_OF_RANGE"};
+  }
+  return offset;
+}
+
+static auto get_bit(Token tok) -> bool {
+  auto bit = get_int(std::move(tok));
+  if (bit != 0 && bit != 1) {
+    throw ExecutionException{"INVALID_BIT The bit argument must be 1 or 0"};
+  }
+  return bit == 1;
+}
+
+// Whether start and end of BITCOUNT / BITPOS are bit offsets rather than byte offsets.
+static auto get_bit_range_unit(Token tok) -> bool {
+  auto unit = get_str(std::move(tok));
+  if (unit != "BIT" && unit != "BYTE") {
+    throw ExecutionException{"SYNTAX_ERROR Expected BYTE or BIT"};
+  }
+  return unit == "BIT";
+}
+
+static auto get_list_end(Token tok) -> ListEnd {
+  auto end = get_str(std::move(tok));
+  if (end != "LEFT" && end != "RIGHT") {
+    throw ExecutionException{"SYNTAX_ERROR Expected LEFT or RIGHT"};
+  }
+  return end == "LEFT" ? ListEnd::Left : ListEnd::Right;
+}
+
+// Seconds as a decimal number, 0 meaning forever. Bounded so that it can be added to the clock.
+static constexpr double MaxTimeout = 1e9;
+
+static auto get_timeout(Token tok) -> double {
+  const auto str = get_str(std::move(tok));
+  double timeout = 0;
+  auto res = std::from_chars(str.data(), str.data() + str.size(), timeout);
+  if (res.ec != std::errc() || res.ptr != str.data() + str.size() || !std::isfinite(timeout)) {
+    throw ExecutionException{"INVALID_TIMEOUT Timeout is not a float or out of range"};
+  }
+  if (timeout < 0) {
+    throw ExecutionException{"INVALID_TIMEOUT Timeout is negative"};
+  }
+  if (timeout > MaxTimeout) {
+    throw ExecutionException{"INVALID_TIMEOUT Timeout is out of range"};
+  }
+  return timeout;
+}
+
 template <typename RealCommand>
-auto parse(Channel &ch) -> boost::asio::awaitable<Command>;
+auto parse(Arguments &args) -> Command;
+
+template <>
+auto parse<AskingCmd>(Arguments & /*args*/) -> Command {
+  return AskingCmd{};
+}
+
+template <>
+auto parse<BitCountCmd>(Arguments &args) -> Command {
+  BitCountCmd bitcount;
+
+  bitcount.key = get_str(args.Next());
+  if (!args.Empty()) {
+    bitcount.start = get_int(args.Next());
+    bitcount.end = get_int(args.Next());
+    if (!args.Empty()) {
+      bitcount.bit_range = get_bit_range_unit(args.Next());
+    }
+  }
+
+  return bitcount;
+}
+
+template <>
+auto parse<BitFieldCmd>(Arguments &args) -> Command {
+  using enum BitFieldCmd::Overflow;
+  using Kind = BitFieldCmd::Op::Kind;
+  BitFieldCmd bitfield;
+
+  bitfield.key = get_str(args.Next());
+  auto overflow = Wrap;
+  while (!args.Empty()) {
+    auto subcommand = get_str(args.Next());
+    if (subcommand == "OVERFLOW") {
+      auto behavior = get_str(args.Next());
+      if (behavior == "WRAP") {
+        overflow = Wrap;
+      } else if (behavior == "SAT") {
+        overflow = Sat;
+      } else if (behavior == "FAIL") {
+        overflow = Fail;
+      } else {
+        throw ExecutionException{"SYNTAX_ERROR Expected WRAP, SAT or FAIL"};
+      }
+      continue;
+    }
+
+    BitFieldCmd::Op op{};
+    if (subcommand == "GET") {
+      op.kind = Kind::Get;
+    } else if (subcommand == "SET") {
+      op.kind = Kind::Set;
+    } else if (subcommand == "INCRBY") {
+      op.kind = Kind::IncrBy;
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Expected GET, SET, INCRBY or OVERFLOW"};
+    }
+
+    // i1 .. i64 or u1 .. u63
+    auto type = get_str(args.Next());
+    Integer width = 0;
+    op.is_signed = !type.empty() && type.front() == 'i';
+    if (type.empty() || (type.front() != 'i' && type.front() != 'u') ||
+        std::from_chars(type.data() + 1, type.data() + type.size(), width).ptr != type.data() + type.size() ||
+        width < 1 || width > (op.is_signed ? 64 : 63)) {
+      throw ExecutionException{"INVALID_BITFIELD_TYPE Expected i1..i64 or u1..u63"};
+    }
+    op.width = static_cast<unsigned>(width);
+
+    // A `#` prefix counts in multiples of the width.
+    auto offset = get_str(args.Next());
+    const bool scaled = !offset.empty() && offset.front() == '#';
+    op.offset = get_int(offset.substr(scaled ? 1 : 0));
+    // Checked before scaling it and adding the width, which could overflow.
+    const Integer scale = scaled ? width : 1;
+    if (op.offset < 0 || op.offset > (MaxBitOffset - (width - 1)) / scale) {
+      throw ExecutionException{"BIT_OFFSET_OUT_OF_RANGE"};
+    }
+    op.offset *= scale;
+
+    if (op.kind != Kind::Get) {
+      op.value = get_int(args.Next());
+    }
+    op.overflow = overflow;
+    bitfield.ops.push_back(op);
+  }
+
+  return bitfield;
+}
+
+template <>
+auto parse<BitOpCmd>(Arguments &args) -> Command {
+  using enum BitOpCmd::Op;
+  BitOpCmd bitop;
+
+  auto op = get_str(args.Next());
+  if (op == "AND") {
+    bitop.op = And;
+  } else if (op == "OR") {
+    bitop.op = Or;
+  } else if (op == "XOR") {
+    bitop.op = Xor;
+  } else if (op == "NOT") {
+    bitop.op = Not;
+  } else {
+    throw ExecutionException{"SYNTAX_ERROR Expected AND, OR, XOR or NOT"};
+  }
+
+  bitop.keys.push_back(get_str(args.Next()));
+  do {
+    bitop.keys.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  if (bitop.op == Not && bitop.keys.size() != 2) {
+    throw ExecutionException{"INVALID_ARGUMENTS BITOP NOT takes a single source key"};
+  }
+
+  return bitop;
+}
+
+template <>
+auto parse<BitPosCmd>(Arguments &args) -> Command {
+  BitPosCmd bitpos;
+
+  bitpos.key = get_str(args.Next());
+  bitpos.bit = get_bit(args.Next());
+  if (!args.Empty()) {
+    bitpos.start = get_int(args.Next());
+    if (!args.Empty()) {
+      bitpos.end = get_int(args.Next());
+      if (!args.Empty()) {
+        bitpos.bit_range = get_bit_range_unit(args.Next());
+      }
+    }
+  }
+
+  return bitpos;
+}
+
+template <>
+auto parse<BLMoveCmd>(Arguments &args) -> Command {
+  BLMoveCmd blmove;
+
+  blmove.keys.push_back(get_str(args.Next()));
+  blmove.keys.push_back(get_str(args.Next()));
+  blmove.from = get_list_end(args.Next());
+  blmove.to = get_list_end(args.Next());
+  blmove.timeout = get_timeout(args.Next());
+
+  return blmove;
+}
+
+// The keys of BLPOP / BRPOP, followed by the timeout.
+template <typename Cmd>
+static auto parse_blocking_pop(Arguments &args) -> Command {
+  Cmd pop;
+
+  auto tok = args.Next();
+  do {
+    pop.keys.push_back(get_str(std::move(tok)));
+    tok = args.Next();
+  } while (!args.Empty());
+  pop.timeout = get_timeout(std::move(tok));
+
+  return pop;
+}
+
+template <>
+auto parse<BLPopCmd>(Arguments &args) -> Command {
+  return parse_blocking_pop<BLPopCmd>(args);
+}
+
+template <>
+auto parse<BRPopCmd>(Arguments &args) -> Command {
+  return parse_blocking_pop<BRPopCmd>(args);
+}
+
+template <>
+auto parse<ClientIdCmd>(Arguments & /*args*/) -> Command {
+  return ClientIdCmd{};
+}
+
+static auto get_client_type(Token tok) -> ClientKillCmd::Type {
+  auto type = get_str(std::move(tok));
+  if (type == "NORMAL") {
+    return ClientKillCmd::Type::Normal;
+  }
+  if (type == "PUBSUB") {
+    return ClientKillCmd::Type::PubSub;
+  }
+  throw ExecutionException{"SYNTAX_ERROR Unknown client type"};
+}
+
+template <>
+auto parse<ClientKillCmd>(Arguments &args) -> Command {
+  ClientKillCmd kill;
+
+  auto first = get_str(args.Next());
+  if (args.Empty()) {
+    kill.legacy_addr = std::move(first);
+    kill.skipme = false;
+    return kill;
+  }
+
+  for (auto filter = std::move(first);; filter = get_str(args.Next())) {
+    if (filter == "ID") {
+      kill.id = get_int(args.Next());
+    } else if (filter == "TYPE") {
+      kill.type = get_client_type(args.Next());
+    } else if (filter == "ADDR") {
+      kill.addr = get_str(args.Next());
+    } else if (filter == "LADDR") {
+      kill.laddr = get_str(args.Next());
+    } else if (filter == "SKIPME") {
+      auto skipme = get_str(args.Next());
+      if (skipme != "YES" && skipme != "NO") {
+        throw ExecutionException{"SYNTAX_ERROR Expected YES or NO"};
+      }
+      kill.skipme = skipme == "YES";
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Unknown kill filter"};
+    }
+    if (args.Empty()) {
+      break;
+    }
+  }
+
+  return kill;
+}
+
+template <>
+auto parse<ClientListCmd>(Arguments &args) -> Command {
+  ClientListCmd list;
+
+  while (!args.Empty()) {
+    auto option = get_str(args.Next());
+    if (option == "TYPE") {
+      list.type = get_client_type(args.Next());
+    } else if (option == "ID") {
+      do {
+        list.ids.push_back(get_int(args.Next()));
+      } while (!args.Empty());
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Unknown list option"};
+    }
+  }
+
+  return list;
+}
+
+template <>
+auto parse<ClientTrackingCmd>(Arguments &args) -> Command {
+  ClientTrackingCmd tracking;
+
+  auto status = get_str(args.Next());
+  if (status == "ON") {
+    tracking.on = true;
+  } else if (status != "OFF") {
+    throw ExecutionException{"SYNTAX_ERROR Expected ON or OFF"};
+  }
+
+  while (!args.Empty()) {
+    auto option = get_str(args.Next());
+    if (option == "BCAST") {
+      tracking.bcast = true;
+    } else if (option == "NOLOOP") {
+      tracking.noloop = true;
+    } else if (option == "REDIRECT") {
+      tracking.redirect = get_int(args.Next());
+    } else if (option == "PREFIX") {
+      tracking.prefixes.push_back(get_str(args.Next()));
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Unknown tracking option"};
+    }
+  }
+
+  return tracking;
+}
+
+template <>
+auto parse<ClusterCountKeysInSlotCmd>(Arguments &args) -> Command {
+  ClusterCountKeysInSlotCmd countkeys;
+
+  countkeys.slot = get_slot(args.Next());
+
+  return countkeys;
+}
+
+template <>
+auto parse<ClusterGetKeysInSlotCmd>(Arguments &args) -> Command {
+  ClusterGetKeysInSlotCmd getkeys;
+
+  getkeys.slot = get_slot(args.Next());
+  getkeys.count = get_int(args.Next());
+
+  return getkeys;
+}
+
+template <>
+auto parse<ClusterKeySlotCmd>(Arguments &args) -> Command {
+  ClusterKeySlotCmd keyslot;
+
+  keyslot.name = get_str(args.Next());
+
+  return keyslot;
+}
+
+template <>
+auto parse<ClusterMeetCmd>(Arguments &args) -> Command {
+  ClusterMeetCmd meet;
+
+  meet.host = get_str(args.Next());
+  meet.port = get_port(args.Next());
+
+  return meet;
+}
+
+template <>
+auto parse<ClusterNodesCmd>(Arguments & /*args*/) -> Command {
+  return ClusterNodesCmd{};
+}
+
+template <>
+auto parse<ClusterSetSlotCmd>(Arguments &args) -> Command {
+  using enum ClusterSetSlotCmd::State;
+  ClusterSetSlotCmd setslot;
+
+  setslot.slot = get_slot(args.Next());
+  auto state = get_str(args.Next());
+  if (state == "IMPORTING") {
+    setslot.state = Importing;
+  } else if (state == "MIGRATING") {
+    setslot.state = Migrating;
+  } else if (state == "NODE") {
+    setslot.state = Node;
+  } else if (state == "STABLE") {
+    setslot.state = Stable;
+    return setslot;
+  } else {
+    throw ExecutionException{"INVALID_SLOT_STATE"};
+  }
+  setslot.node_id = get_str(args.Next());
+
+  return setslot;
+}
+
+template <>
+auto parse<AppendCmd>(Arguments &args) -> Command {
+  AppendCmd append;
+
+  append.key = get_str(args.Next());
+  append.val = get_str(args.Next());
+
+  return append;
+}
+
+template <>
+auto parse<DecrCmd>(Arguments &args) -> Command {
+  DecrCmd decr;
+
+  decr.key = get_str(args.Next());
+
+  return decr;
+}
+
+template <>
+auto parse<DecrByCmd>(Arguments &args) -> Command {
+  DecrByCmd decr;
+
+  decr.key = get_str(args.Next());
+  decr.val = get_int(args.Next());
+
+  return decr;
+}
+
+// numkeys key [key ...] arg [arg ...]
+template <typename EvalCommand>
+static void parse_script_args(Arguments &args, EvalCommand &eval) {
+  const auto numkeys = get_int(args.Next());
+  if (numkeys < 0) {
+    throw ExecutionException{"INVALID_ARGUMENTS Number of keys can't be negative"};
+  }
+
+  for (Integer i = 0; i < numkeys; i++) {
+    eval.keys.push_back(get_str(args.Next()));
+  }
+  while (!args.Empty()) {
+    eval.args.push_back(get_str(args.Next()));
+  }
+}
+
+template <>
+auto parse<EvalCmd>(Arguments &args) -> Command {
+  EvalCmd eval;
+
+  eval.script = get_str(args.Next());
+  parse_script_args(args, eval);
+
+  return eval;
+}
+
+template <>
+auto parse<EvalShaCmd>(Arguments &args) -> Command {
+  EvalShaCmd evalsha;
+
+  evalsha.sha = get_str(args.Next());
+  parse_script_args(args, evalsha);
+
+  return evalsha;
+}
+
+template <>
+auto parse<ExistsCmd>(Arguments &args) -> Command {
+  ExistsCmd exists;
+
+  do {
+    exists.keys.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return exists;
+}
+
+template <>
+auto parse<GetCmd>(Arguments &args) -> Command {
+  GetCmd get;
+
+  get.key = get_str(args.Next());
+
+  return get;
+}
+
+template <>
+auto parse<GetBitCmd>(Arguments &args) -> Command {
+  GetBitCmd getbit;
+
+  getbit.key = get_str(args.Next());
+  getbit.offset = get_bit_offset(args.Next());
+
+  return getbit;
+}
+
+template <>
+auto parse<GetDelCmd>(Arguments &args) -> Command {
+  GetDelCmd getdel;
+
+  getdel.key = get_str(args.Next());
+
+  return getdel;
+}
+
+template <>
+auto parse<GetRangeCmd>(Arguments &args) -> Command {
+  GetRangeCmd getrange;
+
+  getrange.key = get_str(args.Next());
+  getrange.start = get_int(args.Next());
+  getrange.end = get_int(args.Next());
+
+  return getrange;
+}
+
+template <>
+auto parse<GetSetCmd>(Arguments &args) -> Command {
+  GetSetCmd getset;
+
+  getset.key = get_str(args.Next());
+  getset.val = get_str(args.Next());
+
+  return getset;
+}
+
+template <>
+auto parse<HelloCmd>(Arguments &args) -> Command {
+  HelloCmd hello;
+
+  if (!args.Empty()) {
+    hello.protover = get_int(args.Next());
+  }
+
+  return hello;
+}
+
+template <>
+auto parse<IncrCmd>(Arguments &args) -> Command {
+  IncrCmd incr;
+
+  incr.key = get_str(args.Next());
+
+  return incr;
+}
+
+template <>
+auto parse<IncrByCmd>(Arguments &args) -> Command {
+  IncrByCmd incr;
+
+  incr.key = get_str(args.Next());
+  incr.val = get_int(args.Next());
+
+  return incr;
+}
+
+template <>
+auto parse<LLenCmd>(Arguments &args) -> Command {
+  LLenCmd llen;
+
+  llen.key = get_str(args.Next());
+
+  return llen;
+}
+
+template <>
+auto parse<LMoveCmd>(Arguments &args) -> Command {
+  LMoveCmd lmove;
+
+  lmove.keys.push_back(get_str(args.Next()));
+  lmove.keys.push_back(get_str(args.Next()));
+  lmove.from = get_list_end(args.Next());
+  lmove.to = get_list_end(args.Next());
+
+  return lmove;
+}
+
+template <typename Cmd>
+static auto parse_pop(Arguments &args) -> Command {
+  Cmd pop;
+
+  pop.key = get_str(args.Next());
+  if (!args.Empty()) {
+    pop.count = get_int(args.Next());
+    if (*pop.count < 0) {
+      throw ExecutionException{"INVALID_COUNT Count must be positive"};
+    }
+  }
+
+  return pop;
+}
+
+template <typename Cmd>
+static auto parse_push(Arguments &args) -> Command {
+  Cmd push;
+
+  push.key = get_str(args.Next());
+  do {
+    push.elements.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return push;
+}
+
+template <>
+auto parse<LPopCmd>(Arguments &args) -> Command {
+  return parse_pop<LPopCmd>(args);
+}
+
+template <>
+auto parse<LPushCmd>(Arguments &args) -> Command {
+  return parse_push<LPushCmd>(args);
+}
+
+template <>
+auto parse<LRangeCmd>(Arguments &args) -> Command {
+  LRangeCmd lrange;
+
+  lrange.key = get_str(args.Next());
+  lrange.start = get_int(args.Next());
+  lrange.stop = get_int(args.Next());
+
+  return lrange;
+}
+
+template <>
+auto parse<MigrateCmd>(Arguments &args) -> Command {
+  MigrateCmd migrate;
+
+  migrate.host = get_str(args.Next());
+  migrate.port = get_port(args.Next());
+  migrate.key = get_str(args.Next());
+  migrate.db = get_int(args.Next());
+  migrate.timeout = get_int(args.Next());
+
+  return migrate;
+}
+
+template <>
+auto parse<PfAddCmd>(Arguments &args) -> Command {
+  PfAddCmd pfadd;
+
+  pfadd.key = get_str(args.Next());
+  while (!args.Empty()) {
+    pfadd.elements.push_back(get_str(args.Next()));
+  }
+
+  return pfadd;
+}
+
+template <>
+auto parse<PfCountCmd>(Arguments &args) -> Command {
+  PfCountCmd pfcount;
+
+  do {
+    pfcount.keys.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return pfcount;
+}
+
+template <>
+auto parse<PfMergeCmd>(Arguments &args) -> Command {
+  PfMergeCmd pfmerge;
+
+  do {
+    pfmerge.keys.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return pfmerge;
+}
+
+template <>
+auto parse<PSubscribeCmd>(Arguments &args) -> Command {
+  PSubscribeCmd psubscribe;
+
+  do {
+    psubscribe.patterns.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return psubscribe;
+}
+
+template <>
+auto parse<PublishCmd>(Arguments &args) -> Command {
+  PublishCmd publish;
+
+  publish.channel = get_str(args.Next());
+  publish.message = get_str(args.Next());
+
+  return publish;
+}
+
+template <>
+auto parse<PUnsubscribeCmd>(Arguments &args) -> Command {
+  PUnsubscribeCmd punsubscribe;
+
+  while (!args.Empty()) {
+    punsubscribe.patterns.push_back(get_str(args.Next()));
+  }
+
+  return punsubscribe;
+}
+
+template <>
+auto parse<RPopCmd>(Arguments &args) -> Command {
+  return parse_pop<RPopCmd>(args);
+}
+
+template <>
+auto parse<RPushCmd>(Arguments &args) -> Command {
+  return parse_push<RPushCmd>(args);
+}
+
+template <>
+auto parse<ScriptExistsCmd>(Arguments &args) -> Command {
+  ScriptExistsCmd exists;
+
+  do {
+    exists.shas.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return exists;
+}
+
+template <>
+auto parse<ScriptFlushCmd>(Arguments & /*args*/) -> Command {
+  return ScriptFlushCmd{};
+}
+
+template <>
+auto parse<ScriptLoadCmd>(Arguments &args) -> Command {
+  ScriptLoadCmd load;
+
+  load.script = get_str(args.Next());
+
+  return load;
+}
+
+template <>
+auto parse<SetBitCmd>(Arguments &args) -> Command {
+  SetBitCmd setbit;
+
+  setbit.key = get_str(args.Next());
+  setbit.offset = get_bit_offset(args.Next());
+  setbit.value = get_bit(args.Next());
+
+  return setbit;
+}
+
+template <>
+auto parse<SetCmd>(Arguments &args) -> Command {
+  SetCmd set;
+
+  set.key = get_str(args.Next());
+  set.val = get_str(args.Next());
+
+  return set;
+}
+
+template <>
+auto parse<StrLenCmd>(Arguments &args) -> Command {
+  StrLenCmd strlen;
+
+  strlen.key = get_str(args.Next());
+
+  return strlen;
+}
+
+template <>
+auto parse<SubscribeCmd>(Arguments &args) -> Command {
+  SubscribeCmd subscribe;
+
+  do {
+    subscribe.channels.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return subscribe;
+}
+
+template <>
+auto parse<UnsubscribeCmd>(Arguments &args) -> Command {
+  UnsubscribeCmd unsubscribe;
+
+  while (!args.Empty()) {
+    unsubscribe.channels.push_back(get_str(args.Next()));
+  }
+
+  return unsubscribe;
+}
+
+static constexpr const char *InvalidStreamID =
+    "INVALID_STREAM_ID Invalid stream ID specified as stream command argument";
+
+// "<ms>-<seq>", or "<ms>" with `seq` as the sequence number.
+static auto to_stream_id(std::string_view str, uint64_t seq = 0) -> stream::ID {
+  auto to_uint = [](std::string_view str) {
+    uint64_t i = 0;
+    auto res = std::from_chars(str.data(), str.data() + str.size(), i);
+    if (res.ec != std::errc{} || res.ptr != str.data() + str.size()) {
+      throw ExecutionException{InvalidStreamID};
+    }
+    return i;
+  };
+
+  const auto dash = str.find('-');
+  const auto ms = to_uint(str.substr(0, dash));
+  return {ms, dash == std::string_view::npos ? seq : to_uint(str.substr(dash + 1))};
+}
+
+static auto next_stream_id(stream::ID id) noexcept -> stream::ID {
+  return id.seq == UINT64_MAX ? stream::ID{id.ms + 1, 0} : stream::ID{id.ms, id.seq + 1};
+}
+
+static auto prev_stream_id(stream::ID id) noexcept -> stream::ID {
+  return id.seq == 0 ? stream::ID{id.ms - 1, UINT64_MAX} : stream::ID{id.ms, id.seq - 1};
+}
+
+// `-`, an ID or an exclusive `(<id>`; incomplete IDs start at sequence number 0.
+static auto get_range_start(Token tok) -> stream::ID {
+  const auto str = get_str(std::move(tok));
+  if (str == "-") {
+    return {};
+  }
+  if (str.starts_with('(')) {
+    const auto id = to_stream_id(std::string_view(str).substr(1));
+    if (id == stream::ID::Max()) {
+      throw ExecutionException{InvalidStreamID};
+    }
+    return next_stream_id(id);
+  }
+  return to_stream_id(str);
+}
+
+// `+`, an ID or an exclusive `(<id>`; incomplete IDs end at the last sequence number.
+static auto get_range_end(Token tok) -> stream::ID {
+  const auto str = get_str(std::move(tok));
+  if (str == "+") {
+    return stream::ID::Max();
+  }
+  if (str.starts_with('(')) {
+    const auto id = to_stream_id(std::string_view(str).substr(1), UINT64_MAX);
+    if (id == stream::ID{}) {
+      throw ExecutionException{InvalidStreamID};
+    }
+    return prev_stream_id(id);
+  }
+  return to_stream_id(str, UINT64_MAX);
+}
+
+// The threshold of MAXLEN / MINID, given the strategy, then the LIMIT option, which is ignored.
+static auto parse_stream_trim(std::string_view strategy, Arguments &args) -> StreamTrim {
+  StreamTrim trim;
+  trim.strategy = strategy == "MAXLEN" ? StreamTrim::Strategy::MaxLen : StreamTrim::Strategy::MinId;
+
+  auto threshold = get_str(args.Next());
+  if (threshold == "~" || threshold == "=") {
+    trim.approx = threshold == "~";
+    threshold = get_str(args.Next());
+  }
+  if (trim.strategy == StreamTrim::Strategy::MaxLen) {
+    const auto maxlen = *to_int(threshold);
+    if (maxlen < 0) {
+      throw ExecutionException{"INVALID_ARGUMENTS MAXLEN can't be negative"};
+    }
+    trim.maxlen = static_cast<uint64_t>(maxlen);
+  } else {
+    trim.minid = to_stream_id(threshold);
+  }
+  return trim;
+}
+
+// Milliseconds, 0 meaning forever.
+static auto get_block_timeout(Token tok) -> Integer {
+  const auto block = get_int(std::move(tok));
+  if (block < 0) {
+    throw ExecutionException{"INVALID_TIMEOUT Timeout is negative"};
+  }
+  if (static_cast<double>(block) > MaxTimeout * 1000) {
+    throw ExecutionException{"INVALID_TIMEOUT Timeout is out of range"};
+  }
+  return block;
+}
+
+// The keys, then as many IDs, after STREAMS. `special` stands for an ID to be resolved by the command.
+static void parse_streams(Arguments &args, std::string_view special, std::vector<String> &keys,
+                          std::vector<std::optional<stream::ID>> &ids) {
+  std::vector<String> args_left;
+  do {
+    args_left.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+  if (args_left.size() % 2 != 0) {
+    throw ExecutionException{"WRONG_NUMBER_OF_ARGUMENTS Unbalanced list of streams: a key and an ID each"};
+  }
+
+  const auto count = args_left.size() / 2;
+  keys.assign(std::make_move_iterator(args_left.begin()),
+              std::make_move_iterator(args_left.begin() + static_cast<ptrdiff_t>(count)));
+  for (size_t i = count; i < args_left.size(); i++) {
+    ids.push_back(args_left[i] == special ? std::nullopt : std::optional(to_stream_id(args_left[i])));
+  }
+}
+
+template <>
+auto parse<XAckCmd>(Arguments &args) -> Command {
+  XAckCmd xack;
+
+  xack.key = get_str(args.Next());
+  xack.group = get_str(args.Next());
+  do {
+    xack.ids.push_back(to_stream_id(get_str(args.Next())));
+  } while (!args.Empty());
+
+  return xack;
+}
+
+template <>
+auto parse<XAddCmd>(Arguments &args) -> Command {
+  XAddCmd xadd;
+
+  xadd.key = get_str(args.Next());
+  for (;;) {
+    auto arg = get_str(args.Next());
+    if (arg == "NOMKSTREAM") {
+      xadd.nomkstream = true;
+    } else if (arg == "MAXLEN" || arg == "MINID") {
+      xadd.trim = parse_stream_trim(arg, args);
+    } else if (arg == "LIMIT" && xadd.trim) {
+      get_int(args.Next());
+    } else if (arg == "*") {
+      break;
+    } else if (arg.ends_with("-*")) {
+      xadd.ms = to_stream_id(std::string_view(arg).substr(0, arg.size() - 2)).ms;
+      break;
+    } else {
+      const auto id = to_stream_id(arg);
+      xadd.ms = id.ms;
+      xadd.seq = id.seq;
+      break;
+    }
+  }
+
+  do {
+    xadd.fields.push_back(get_str(args.Next()));
+    xadd.fields.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return xadd;
+}
+
+template <>
+auto parse<XGroupCreateCmd>(Arguments &args) -> Command {
+  XGroupCreateCmd create;
+
+  create.key = get_str(args.Next());
+  create.group = get_str(args.Next());
+  if (auto id = get_str(args.Next()); id != "$") {
+    create.id = to_stream_id(id);
+  }
+  while (!args.Empty()) {
+    const auto option = get_str(args.Next());
+    if (option == "MKSTREAM") {
+      create.mkstream = true;
+    } else if (option == "ENTRIESREAD") {
+      get_int(args.Next());
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Expected MKSTREAM or ENTRIESREAD"};
+    }
+  }
+
+  return create;
+}
+
+template <>
+auto parse<XGroupDestroyCmd>(Arguments &args) -> Command {
+  XGroupDestroyCmd destroy;
+
+  destroy.key = get_str(args.Next());
+  destroy.group = get_str(args.Next());
+
+  return destroy;
+}
+
+template <>
+auto parse<XLenCmd>(Arguments &args) -> Command {
+  XLenCmd xlen;
+
+  xlen.key = get_str(args.Next());
+
+  return xlen;
+}
+
+template <>
+auto parse<XRangeCmd>(Arguments &args) -> Command {
+  XRangeCmd xrange;
+
+  xrange.key = get_str(args.Next());
+  xrange.start = get_range_start(args.Next());
+  xrange.end = get_range_end(args.Next());
+  if (!args.Empty()) {
+    if (get_str(args.Next()) != "COUNT") {
+      throw ExecutionException{"SYNTAX_ERROR Expected COUNT"};
+    }
+    xrange.count = get_int(args.Next());
+  }
+
+  return xrange;
+}
+
+template <>
+auto parse<XReadCmd>(Arguments &args) -> Command {
+  XReadCmd xread;
+
+  for (auto option = get_str(args.Next()); option != "STREAMS"; option = get_str(args.Next())) {
+    if (option == "COUNT") {
+      xread.count = get_int(args.Next());
+    } else if (option == "BLOCK") {
+      xread.block = get_block_timeout(args.Next());
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Expected COUNT, BLOCK or STREAMS"};
+    }
+  }
+  parse_streams(args, "$", xread.keys, xread.ids);
+
+  return xread;
+}
+
+template <>
+auto parse<XReadGroupCmd>(Arguments &args) -> Command {
+  XReadGroupCmd xreadgroup;
+
+  if (get_str(args.Next()) != "GROUP") {
+    throw ExecutionException{"SYNTAX_ERROR Expected GROUP"};
+  }
+  xreadgroup.group = get_str(args.Next());
+  xreadgroup.consumer = get_str(args.Next());
+  for (auto option = get_str(args.Next()); option != "STREAMS"; option = get_str(args.Next())) {
+    if (option == "COUNT") {
+      xreadgroup.count = get_int(args.Next());
+    } else if (option == "BLOCK") {
+      xreadgroup.block = get_block_timeout(args.Next());
+    } else if (option == "NOACK") {
+      xreadgroup.noack = true;
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Expected COUNT, BLOCK, NOACK or STREAMS"};
+    }
+  }
+  parse_streams(args, ">", xreadgroup.keys, xreadgroup.ids);
+
+  return xreadgroup;
+}
+
+template <>
+auto parse<XTrimCmd>(Arguments &args) -> Command {
+  XTrimCmd xtrim;
+
+  xtrim.key = get_str(args.Next());
+  auto strategy = get_str(args.Next());
+  if (strategy != "MAXLEN" && strategy != "MINID") {
+    throw ExecutionException{"SYNTAX_ERROR Expected MAXLEN or MINID"};
+  }
+  xtrim.trim = parse_stream_trim(strategy, args);
+  if (!args.Empty()) {
+    if (get_str(args.Next()) != "LIMIT") {
+      throw ExecutionException{"SYNTAX_ERROR Expected LIMIT"};
+    }
+    get_int(args.Next());
+  }
+
+  return xtrim;
+}
+
+// Scores are doubles, infinities included, but never NaN.
+static auto to_score(std::string_view str) -> std::optional<double> {
+  if (str.starts_with('+')) {
+    str.remove_prefix(1);
+  }
+  double score = 0;
+  auto res = std::from_chars(str.data(), str.data() + str.size(), score);
+  if (res.ec != std::errc() || res.ptr != str.data() + str.size() || std::isnan(score)) {
+    return {};
+  }
+  return score;
+}
+
+static auto get_score(Token tok) -> double {
+  if (auto score = to_score(get_str(std::move(tok)))) {
+    return *score;
+  }
+  throw ExecutionException{"INVALID_SCORE Score is not a valid float"};
+}
+
+static auto get_score_bound(Token tok) -> ScoreBound {
+  const auto str = get_str(std::move(tok));
+  const bool exclusive = str.starts_with('(');
+  if (auto score = to_score(std::string_view(str).substr(exclusive ? 1 : 0))) {
+    return {*score, exclusive};
+  }
+  throw ExecutionException{"INVALID_SCORE Min or max is not a float"};
+}
+
+template <>
+auto parse<ZAddCmd>(Arguments &args) -> Command {
+  ZAddCmd zadd;
+
+  zadd.key = get_str(args.Next());
+  auto arg = get_str(args.Next());
+  for (;; arg = get_str(args.Next())) {
+    if (arg == "NX") {
+      zadd.nx = true;
+    } else if (arg == "XX") {
+      zadd.xx = true;
+    } else if (arg == "GT") {
+      zadd.gt = true;
+    } else if (arg == "LT") {
+      zadd.lt = true;
+    } else if (arg == "CH") {
+      zadd.ch = true;
+    } else if (arg == "INCR") {
+      zadd.incr = true;
+    } else {
+      break;
+    }
+  }
+  if (zadd.nx && zadd.xx) {
+    throw ExecutionException{"INVALID_ARGUMENTS XX and NX options at the same time are not compatible"};
+  }
+  if ((zadd.gt && zadd.lt) || ((zadd.gt || zadd.lt) && zadd.nx)) {
+    throw ExecutionException{"INVALID_ARGUMENTS GT, LT, and/or NX options at the same time are not compatible"};
+  }
+
+  zadd.elements.emplace_back(get_score(std::move(arg)), get_str(args.Next()));
+  while (!args.Empty()) {
+    auto score = get_score(args.Next());
+    zadd.elements.emplace_back(score, get_str(args.Next()));
+  }
+  if (zadd.incr && zadd.elements.size() > 1) {
+    throw ExecutionException{"INVALID_ARGUMENTS INCR option supports a single increment-element pair"};
+  }
+
+  return zadd;
+}
+
+template <>
+auto parse<ZCardCmd>(Arguments &args) -> Command {
+  ZCardCmd zcard;
+
+  zcard.key = get_str(args.Next());
+
+  return zcard;
+}
+
+// ZRANGE and ZREVRANGE.
+template <typename Cmd>
+static auto parse_rank_range(Arguments &args) -> Command {
+  Cmd range;
+
+  range.key = get_str(args.Next());
+  range.start = get_int(args.Next());
+  range.stop = get_int(args.Next());
+  if (!args.Empty()) {
+    if (get_str(args.Next()) != "WITHSCORES") {
+      throw ExecutionException{"SYNTAX_ERROR Expected WITHSCORES"};
+    }
+    range.withscores = true;
+  }
+
+  return range;
+}
+
+template <>
+auto parse<ZRangeCmd>(Arguments &args) -> Command {
+  return parse_rank_range<ZRangeCmd>(args);
+}
+
+template <>
+auto parse<ZRangeByScoreCmd>(Arguments &args) -> Command {
+  ZRangeByScoreCmd zrange;
+
+  zrange.key = get_str(args.Next());
+  zrange.min = get_score_bound(args.Next());
+  zrange.max = get_score_bound(args.Next());
+  while (!args.Empty()) {
+    const auto option = get_str(args.Next());
+    if (option == "WITHSCORES") {
+      zrange.withscores = true;
+    } else if (option == "LIMIT") {
+      zrange.offset = get_int(args.Next());
+      zrange.count = get_int(args.Next());
+    } else {
+      throw ExecutionException{"SYNTAX_ERROR Expected WITHSCORES or LIMIT"};
+    }
+  }
+
+  return zrange;
+}
+
+template <>
+auto parse<ZRankCmd>(Arguments &args) -> Command {
+  ZRankCmd zrank;
+
+  zrank.key = get_str(args.Next());
+  zrank.member = get_str(args.Next());
+
+  return zrank;
+}
+
+template <>
+auto parse<ZRemCmd>(Arguments &args) -> Command {
+  ZRemCmd zrem;
+
+  zrem.key = get_str(args.Next());
+  do {
+    zrem.members.push_back(get_str(args.Next()));
+  } while (!args.Empty());
+
+  return zrem;
+}
+
+template <>
+auto parse<ZRevRangeCmd>(Arguments &args) -> Command {
+  return parse_rank_range<ZRevRangeCmd>(args);
+}
+
+template <>
+auto parse<ZScoreCmd>(Arguments &args) -> Command {
+  ZScoreCmd zscore;
+
+  zscore.key = get_str(args.Next());
+  zscore.member = get_str(args.Next());
+
+  return zscore;
+}
+
+using ParseFunc = auto (*)(Arguments &args) -> Command;
+using ParseFuncMap = std::unordered_map<std::string_view, ParseFunc, utils::string_hash, std::equal_to<>>;
+
+static const ParseFuncMap ClientParseFuncs = {{ClientIdCmd::Name, parse<ClientIdCmd>},
+                                              {ClientKillCmd::Name, parse<ClientKillCmd>},
+                                              {ClientListCmd::Name, parse<ClientListCmd>},
+                                              {ClientTrackingCmd::Name, parse<ClientTrackingCmd>}};
+
+template <>
+auto parse<ClientCmd>(Arguments &args) -> Command {
+  auto it = ClientParseFuncs.find(get_str(args.Next()));
+  if (it == ClientParseFuncs.end()) {
+    throw ExecutionException{"INVALID_COMMAND"};
+  }
+  return it->second(args);
+}
+
+static const ParseFuncMap ClusterParseFuncs = {{ClusterCountKeysInSlotCmd::Name, parse<ClusterCountKeysInSlotCmd>},
+                                               {ClusterGetKeysInSlotCmd::Name, parse<ClusterGetKeysInSlotCmd>},
+                                               {ClusterKeySlotCmd::Name, parse<ClusterKeySlotCmd>},
+                                               {ClusterMeetCmd::Name, parse<ClusterMeetCmd>},
+                                               {ClusterNodesCmd::Name, parse<ClusterNodesCmd>},
+                                               {ClusterSetSlotCmd::Name, parse<ClusterSetSlotCmd>}};
+
+template <>
+auto parse<ClusterCmd>(Arguments &args) -> Command {
+  auto it = ClusterParseFuncs.find(get_str(args.Next()));
+  if (it == ClusterParseFuncs.end()) {
+    throw ExecutionException{"INVALID_COMMAND"};
+  }
+  return it->second(args);
+}
+
+static const ParseFuncMap ScriptParseFuncs = {{ScriptExistsCmd::Name, parse<ScriptExistsCmd>},
+                                              {ScriptFlushCmd::Name, parse<ScriptFlushCmd>},
+                                              {ScriptLoadCmd::Name, parse<ScriptLoadCmd>}};
+
+template <>
+auto parse<ScriptCmd>(Arguments &args) -> Command {
+  auto it = ScriptParseFuncs.find(get_str(args.Next()));
+  if (it == ScriptParseFuncs.end()) {
+    throw ExecutionException{"INVALID_COMMAND"};
+  }
+  return it->second(args);
+}
+
+static const ParseFuncMap XGroupParseFuncs = {{XGroupCreateCmd::Name, parse<XGroupCreateCmd>},
+                                              {XGroupDestroyCmd::Name, parse<XGroupDestroyCmd>}};
+
+template <>
+auto parse<XGroupCmd>(Arguments &args) -> Command {
+  auto it = XGroupParseFuncs.find(get_str(args.Next()));
+  if (it == XGroupParseFuncs.end()) {
+    throw ExecutionException{"INVALID_COMMAND"};
+  }
+  return it->second(args);
+}
+
+static const ParseFuncMap ParseFuncs = {
+    {AppendCmd::Name, parse<AppendCmd>},
+    {AskingCmd::Name, parse<AskingCmd>},
+    {BitCountCmd::Name, parse<BitCountCmd>},
+    {BitFieldCmd::Name, parse<BitFieldCmd>},
+    {BitOpCmd::Name, parse<BitOpCmd>},
+    {BitPosCmd::Name, parse<BitPosCmd>},
+    {BLMoveCmd::Name, parse<BLMoveCmd>},
+    {BLPopCmd::Name, parse<BLPopCmd>},
+    {BRPopCmd::Name, parse<BRPopCmd>},
+    {ClientCmd::Name, parse<ClientCmd>},
+    {ClusterCmd::Name, parse<ClusterCmd>},
+    {DecrCmd::Name, parse<DecrCmd>},
+    {DecrByCmd::Name, parse<DecrByCmd>},
+    {EvalCmd::Name, parse<EvalCmd>},
+    {EvalShaCmd::Name, parse<EvalShaCmd>},
+    {ExistsCmd::Name, parse<ExistsCmd>},
+    {GetCmd::Name, parse<GetCmd>},
+    {GetBitCmd::Name, parse<GetBitCmd>},
+    {GetDelCmd::Name, parse<GetDelCmd>},
+    {GetRangeCmd::Name, parse<GetRangeCmd>},
+    {GetSetCmd::Name, parse<GetSetCmd>},
+    {HelloCmd::Name, parse<HelloCmd>},
+    {IncrCmd::Name, parse<IncrCmd>},
+    {IncrByCmd::Name, parse<IncrByCmd>},
+    {LLenCmd::Name, parse<LLenCmd>},
+    {LMoveCmd::Name, parse<LMoveCmd>},
+    {LPopCmd::Name, parse<LPopCmd>},
+    {LPushCmd::Name, parse<LPushCmd>},
+    {LRangeCmd::Name, parse<LRangeCmd>},
+    {MigrateCmd::Name, parse<MigrateCmd>},
+    {PfAddCmd::Name, parse<PfAddCmd>},
+    {PfCountCmd::Name, parse<PfCountCmd>},
+    {PfMergeCmd::Name, parse<PfMergeCmd>},
+    {PSubscribeCmd::Name, parse<PSubscribeCmd>},
+    {PublishCmd::Name, parse<PublishCmd>},
+    {PUnsubscribeCmd::Name, parse<PUnsubscribeCmd>},
+    {RPopCmd::Name, parse<RPopCmd>},
+    {RPushCmd::Name, parse<RPushCmd>},
+    {ScriptCmd::Name, parse<ScriptCmd>},
+    {SetBitCmd::Name, parse<SetBitCmd>},
+    {SetCmd::Name, parse<SetCmd>},
+    {StrLenCmd::Name, parse<StrLenCmd>},
+    {SubscribeCmd::Name, parse<SubscribeCmd>},
+    {UnsubscribeCmd::Name, parse<UnsubscribeCmd>},
+    {XAckCmd::Name, parse<XAckCmd>},
+    {XAddCmd::Name, parse<XAddCmd>},
+    {XGroupCmd::Name, parse<XGroupCmd>},
+    {XLenCmd::Name, parse<XLenCmd>},
+    {XRangeCmd::Name, parse<XRangeCmd>},
+    {XReadCmd::Name, parse<XReadCmd>},
+    {XReadGroupCmd::Name, parse<XReadGroupCmd>},
+    {XTrimCmd::Name, parse<XTrimCmd>},
+    {ZAddCmd::Name, parse<ZAddCmd>},
+    {ZCardCmd::Name, parse<ZCardCmd>},
+    {ZRangeCmd::Name, parse<ZRangeCmd>},
+    {ZRangeByScoreCmd::Name, parse<ZRangeByScoreCmd>},
+    {ZRankCmd::Name, parse<ZRankCmd>},
+    {ZRemCmd::Name, parse<ZRemCmd>},
+    {ZRevRangeCmd::Name, parse<ZRevRangeCmd>},
+    {ZScoreCmd::Name, parse<ZScoreCmd>}};
+
+void Response::Push(Token tok) { m_tokens.push_back(std::move(tok)); }
+
+auto Response::PushAggregate(TokenTypeMarker aggregate, size_t size) -> size_t {
+  m_nested.push_back({m_tokens.size(), aggregate, size});
+  return m_nested.size() - 1;
+}
+
+void Response::SetAggregateSize(size_t handle, size_t size) noexcept { m_nested[handle].size = size; }
+
+auto Response::elem_count() const noexcept -> size_t {
+  // Elements of nested aggregates aren't top level elements.
+  auto count = m_tokens.size() + m_nested.size();
+  for (const auto &nested : m_nested) {
+    count -= nested.size;
+  }
+  return m_aggregate == TokenTypeMarker::Map ? count / 2 : count;
+}
+
+static auto nested_size(TokenTypeMarker aggregate, size_t size) noexcept -> size_t {
+  return aggregate == TokenTypeMarker::Map ? size / 2 : size;
+}
+
+void Response::Encode(std::string &buf, Protocol proto) const {
+  if (m_value) {
+    EncodeBulkString(buf, *m_value);
+    return;
+  }
+  if (m_compressed) {
+    EncodeBulkStringHeader(buf, m_compressed->size);
+    lz::Append(*m_compressed, buf);
+    buf += MessagePartTerminator;
+    return;
+  }
+  if (m_aggregate) {
+    EncodeAggregateHeader(buf, *m_aggregate, elem_count(), proto);
+  }
+
+  auto nested = m_nested.begin();
+  for (size_t i = 0; i <= m_tokens.size(); i++) {
+    for (; nested != m_nested.end() && nested->pos == i; ++nested) {
+      EncodeAggregateHeader(buf, nested->aggregate, nested_size(nested->aggregate, nested->size), proto);
+    }
+    if (i < m_tokens.size()) {
+      resp::Encode(buf, m_tokens[i], proto);
+    }
+  }
+}
+
+void Response::Write(OutputQueue &output, Protocol proto) const {
+  if (!m_value) {
+    output.Append([&](std::string &buf) { Encode(buf, proto); });
+    return;
+  }
+
+  output.Append([&](std::string &buf) { EncodeBulkStringHeader(buf, m_value->size()); });
+  output.Borrow(m_value, *m_value);
+  output.Append([](std::string &buf) { buf += MessagePartTerminator; });
+}
+
+auto Response::Serialize(Serializer &resp_sender) const -> boost::asio::awaitable<void> {
+  if (m_value) {
+    co_return co_await resp_sender.SerializeBulkString(*m_value);
+  }
+  if (m_compressed) {
+    std::string str;
+    lz::Append(*m_compressed, str);
+    co_return co_await resp_sender.SerializeBulkString(str);
+  }
+  if (m_aggregate) {
+    co_await resp_sender.SerializeAggregateHeader(*m_aggregate, elem_count());
+  }
+
+  auto nested = m_nested.begin();
+  for (size_t i = 0; i <= m_tokens.size(); i++) {
+    for (; nested != m_nested.end() && nested->pos == i; ++nested) {
+      co_await resp_sender.SerializeAggregateHeader(nested->aggregate, nested_size(nested->aggregate, nested->size));
+    }
+    if (i < m_tokens.size()) {
+      co_await resp_sender.Serialize(m_tokens[i]);
+    }
+  }
+}
+
+static auto execute(DB &db, Client & /*cli*/, AppendCmd append) -> Response {
+  if (auto *val = db.Get(append.key)) {
+    (*val) += append.val;
+    return Token(Integer(val->length()));
+  }
+
+  auto len = static_cast<Integer>(append.val.length());
+  db.GetAndSet(std::move(append.key), std::move(append.val));
+  return Token(len);
+}
+
+// Redis' start / end handling: negative offsets count from the end, then the range is clamped to [0, len).
+static auto clamp_range(Integer start, Integer end, Integer len) -> std::optional<std::pair<Integer, Integer>> {
+  start = start < 0 ? std::max<Integer>(start + len, 0) : start;
+  end = end < 0 ? std::max<Integer>(end + len, 0) : std::min(end, len - 1);
+  if (len == 0 || start > end) {
+    return {};
+  }
+  return std::pair{start, end};
+}
+
+// LRANGE's and ZRANGE's: the same, but an end before the first element leaves the range empty rather than clamped.
+static auto clamp_index_range(Integer start, Integer end, Integer len) -> std::optional<std::pair<Integer, Integer>> {
+  if (end < -len) {
+    return {};
+  }
+  return clamp_range(start, end, len);
+}
+
+// The bit range of BITCOUNT / BITPOS, with byte offsets converted to bit offsets.
+static auto clamp_bit_range(std::string_view val, Integer start, Integer end, bool bit_range)
+    -> std::optional<std::pair<Integer, Integer>> {
+  const auto len = Integer(val.size());
+  if (bit_range) {
+    return clamp_range(start, end, len * 8);
+  }
+  if (auto bytes = clamp_range(start, end, len)) {
+    return std::pair{bytes->first * 8, bytes->second * 8 + 7};
+  }
+  return {};
+}
+
+static auto test_bit(std::string_view val, Integer pos) noexcept -> bool {
+  return (static_cast<unsigned char>(val[pos / 8]) & (0x80 >> (pos % 8))) != 0;
+}
+
+static auto execute(DB &db, Client & /*cli*/, const BitCountCmd &bitcount) -> Response {
+  std::pmr::string scratch;
+  auto val = db.Get(bitcount.key, scratch);
+  if (!val) {
+    return Token(0);
+  }
+  if (!bitcount.start) {
+    return Token(Integer(bits::Count(*val)));
+  }
+
+  auto range = clamp_bit_range(*val, *bitcount.start, *bitcount.end, bitcount.bit_range);
+  if (!range) {
+    return Token(0);
+  }
+
+  // Whole bytes are counted, then the bits outside the range are taken off.
+  const auto [first, last] = *range;
+  auto count = Integer(bits::Count(val->substr(first / 8, last / 8 - first / 8 + 1)));
+  for (auto pos = first / 8 * 8; pos < first; pos++) {
+    count -= test_bit(*val, pos) ? 1 : 0;
+  }
+  for (auto pos = last + 1; pos < (last / 8 + 1) * 8; pos++) {
+    count -= test_bit(*val, pos) ? 1 : 0;
+  }
+  return Token(count);
+}
+
+// Signed fields are sign extended from `width` bits.
+static auto bitfield_value(uint64_t raw, const BitFieldCmd::Op &op) noexcept -> Integer {
+  if (op.is_signed && op.width < 64 && ((raw >> (op.width - 1)) & 1) != 0) {
+    raw |= ~uint64_t{0} << op.width;
+  }
+  return static_cast<Integer>(raw);
+}
+
+// `base + incr` with the overflow behavior of the operation applied; nothing when it fails.
+static auto bitfield_fit(Integer base, Integer incr, const BitFieldCmd::Op &op) -> std::optional<Integer> {
+  using enum BitFieldCmd::Overflow;
+  const auto max = static_cast<Integer>((uint64_t{1} << (op.width - (op.is_signed ? 1 : 0))) - 1);
+  const auto min = op.is_signed ? -max - 1 : 0;
+
+  Integer sum = 0;
+  const bool overflow = __builtin_add_overflow(base, incr, &sum);
+  if (!overflow && sum >= min && sum <= max) {
+    return sum;
+  }
+
+  switch (op.overflow) {
+    case Fail:
+      return {};
+    case Sat:
+      return (overflow ? incr > 0 : sum > max) ? max : min;
+    case Wrap:
+      break;
+  }
+  const auto mask = op.width == 64 ? ~uint64_t{0} : (uint64_t{1} << op.width) - 1;
+  return bitfield_value((static_cast<uint64_t>(base) + static_cast<uint64_t>(incr)) & mask, op);
+}
+
+static auto execute(DB &db, Client & /*cli*/, const BitFieldCmd &bitfield) -> Response {
+  using Kind = BitFieldCmd::Op::Kind;
+  Response results(TokenTypeMarker::Array);
+  auto *val = db.Get(bitfield.key);
+
+  for (const auto &op : bitfield.ops) {
+    const auto offset = static_cast<uint64_t>(op.offset);
+    if (op.kind == Kind::Get) {
+      results.Push(bitfield_value(val != nullptr ? bits::GetField(*val, offset, op.width) : 0, op));
+      continue;
+    }
+
+    if (val == nullptr) {
+      db.GetAndSet(String(bitfield.key), db.NewString());
+      val = db.Get(bitfield.key);
+    }
+    const auto old = bitfield_value(bits::GetField(*val, offset, op.width), op);
+    auto updated = bitfield_fit(op.kind == Kind::Set ? 0 : old, op.value, op);
+    if (!updated) {
+      results.Push(NullStr);
+      continue;
+    }
+
+    val->resize(std::max<size_t>(val->size(), (offset + op.width + 7) / 8), '\0');
+    bits::SetField(*val, offset, op.width, static_cast<uint64_t>(*updated));
+    results.Push(op.kind == Kind::Set ? old : *updated);
+  }
+  return results;
+}
+
+static auto execute(DB &db, Client & /*cli*/, const BitOpCmd &bitop) -> Response {
+  const auto keys = std::span(bitop.keys).subspan(1);
+  std::vector<std::pmr::string> scratch(keys.size());
+  std::vector<std::string_view> srcs;
+  for (size_t i = 0; i < keys.size(); i++) {
+    srcs.push_back(db.Get(keys[i], scratch[i]).value_or(std::string_view{}));
+  }
+
+  auto op = bits::Op::Not;
+  switch (bitop.op) {
+    case BitOpCmd::Op::And:
+      op = bits::Op::And;
+      break;
+    case BitOpCmd::Op::Or:
+      op = bits::Op::Or;
+      break;
+    case BitOpCmd::Op::Xor:
+      op = bits::Op::Xor;
+      break;
+    case BitOpCmd::Op::Not:
+      break;
+  }
+
+  auto result = db.NewString();
+  bits::Apply(op, srcs, result);
+
+  const auto len = Integer(result.size());
+  if (len == 0) {
+    db.Erase(bitop.keys.front());
+  } else {
+    db.Set(String(bitop.keys.front()), std::move(result));
+  }
+  return Token(len);
+}
+
+static auto execute(DB &db, Client & /*cli*/, const BitPosCmd &bitpos) -> Response {
+  std::pmr::string scratch;
+  auto val = db.Get(bitpos.key, scratch);
+  if (!val) {
+    return Token(Integer(bitpos.bit ? -1 : 0));
+  }
+
+  auto range = clamp_bit_range(*val, bitpos.start.value_or(0), bitpos.end.value_or(-1), bitpos.bit_range);
+  if (!range) {
+    return Token(Integer(-1));
+  }
+
+  // Bits up to the first byte boundary, whole bytes, then the rest.
+  auto [pos, last] = *range;
+  for (; pos <= last && pos % 8 != 0; pos++) {
+    if (test_bit(*val, pos) == bitpos.bit) {
+      return Token(pos);
+    }
+  }
+  if (const auto whole_end = (last + 1) / 8; pos <= last && pos / 8 < whole_end) {
+    if (auto found = bits::FindFirst(val->substr(pos / 8, whole_end - pos / 8), bitpos.bit)) {
+      return Token(pos + Integer(*found));
+    }
+    pos = whole_end * 8;
+  }
+  for (; pos <= last; pos++) {
+    if (test_bit(*val, pos) == bitpos.bit) {
+      return Token(pos);
+    }
+  }
+
+  // Looking for a clear bit without an explicit end: the string is as if padded with zeros.
+  if (!bitpos.bit && !bitpos.end) {
+    return Token(last + 1);
+  }
+  return Token(Integer(-1));
+}
+
+static auto get_cluster(DB &db) -> cluster::Cluster & {
+  if (auto *cluster = db.GetCluster()) {
+    return *cluster;
+  }
+  throw ExecutionException{"CLUSTER_SUPPORT_DISABLED"};
+}
+
+static auto execute(DB &db, Client &cli, AskingCmd /*asking*/) -> Response {
+  get_cluster(db);
+  cli.SetAsking(true);
+  return Token("OK");
+}
+
+static auto execute(DB & /*db*/, Client &cli, ClientIdCmd /*id*/) -> Response {
+  return Token(Integer(cli.Id()));
+}
+
+static auto client_type(const Client &cli) noexcept -> ClientKillCmd::Type {
+  const auto *pubsub = cli.GetPubSub();
+  return pubsub != nullptr && pubsub->Count() != 0 ? ClientKillCmd::Type::PubSub : ClientKillCmd::Type::Normal;
+}
+
+static auto execute(DB &db, Client &cli, const ClientKillCmd &kill) -> Response {
+  Integer killed = 0;
+  db.ForEachClient([&](Client &target) {
+    if ((kill.skipme && &target == &cli) || (kill.legacy_addr && target.Address() != *kill.legacy_addr) ||
+        (kill.id && target.Id() != static_cast<ClientID>(*kill.id)) ||
+        (kill.type && client_type(target) != *kill.type) || (kill.addr && target.Address() != *kill.addr) ||
+        (kill.laddr && target.LocalAddress() != *kill.laddr)) {
+      return;
+    }
+    // The caller still gets its reply.
+    if (&target == &cli) {
+      target.Output().CloseWhenDrained();
+    } else {
+      target.Output().Close();
+    }
+    killed++;
+  });
+
+  if (!kill.legacy_addr) {
+    return Token(killed);
+  }
+  if (killed == 0) {
+    return Token(Error{"NO_SUCH_CLIENT No such client"});
+  }
+  return Token("OK");
+}
+
+// One line per client, in the format of Redis' CLIENT LIST, for the fields that apply.
+static auto execute(DB &db, Client & /*cli*/, const ClientListCmd &list) -> Response {
+  using std::chrono::duration_cast;
+  using std::chrono::seconds;
+
+  const auto now = Client::Clock::now();
+  auto out = db.NewString();
+  db.ForEachClient([&](Client &target) {
+    if ((list.type && client_type(target) != *list.type) ||
+        (!list.ids.empty() && std::find(list.ids.begin(), list.ids.end(), Integer(target.Id())) == list.ids.end())) {
+      return;
+    }
+
+    const auto *pubsub = target.GetPubSub();
+    std::string cmd(target.LastCommand());
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), [](unsigned char c) { return std::tolower(c); });
+    const auto *input = target.Input();
+    fmt::format_to(std::back_inserter(out),
+                   "id={} addr={} laddr={} age={} idle={} flags={}{} db=0 sub={} psub={} qbuf={} rbs={} omem={} "
+                   "cmd={} resp={}\n",
+                   target.Id(),
+                   target.Address(),
+                   target.LocalAddress(),
+                   duration_cast<seconds>(now - target.Created()).count(),
+                   duration_cast<seconds>(now - target.LastActive()).count(),
+                   client_type(target) == ClientKillCmd::Type::PubSub ? 'P' : 'N',
+                   target.GetTracking() != nullptr ? "t" : "",
+                   pubsub != nullptr ? pubsub->channels.size() : 0,
+                   pubsub != nullptr ? pubsub->patterns.size() : 0,
+                   input != nullptr ? input->Buffered() : 0,
+                   input != nullptr && input->HasBuffer() ? resp::BufferPool::BufferSize : 0,
+                   target.Output().Size(),
+                   cmd,
+                   static_cast<int>(target.GetProtocol()));
+  });
+  return Token(std::move(out));
+}
+
+static auto execute(DB &db, Client &cli, ClientTrackingCmd tracking) -> Response {
+  if (!tracking.on) {
+    db.GetTracking().Disable(cli);
+    return Token("OK");
+  }
+
+  if (!tracking.prefixes.empty() && !tracking.bcast) {
+    return Token(Error{"INVALID_ARGUMENTS PREFIX requires BCAST"});
+  }
+  if (tracking.redirect != 0 && db.FindClient(tracking.redirect) == nullptr) {
+    return Token(Error{"INVALID_ARGUMENTS No client with the REDIRECT id"});
+  }
+
+  tracking::ClientState state;
+  state.bcast = tracking.bcast;
+  state.noloop = tracking.noloop;
+  state.redirect = static_cast<ClientID>(tracking.redirect);
+  state.prefixes = std::move(tracking.prefixes);
+  db.GetTracking().Enable(cli, std::move(state));
+  return Token("OK");
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ClusterCountKeysInSlotCmd &countkeys) -> Response {
+  get_cluster(db);
+
+  Integer count = 0;
+  db.ForEach([&](const auto &key, const auto & /*val*/) {
+    count += cluster::KeyHashSlot(key) == countkeys.slot ? 1 : 0;
+  });
+  return Token(count);
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ClusterGetKeysInSlotCmd &getkeys) -> Response {
+  get_cluster(db);
+
+  Response keys(TokenTypeMarker::Array);
+  Integer count = 0;
+  db.ForEach([&](const auto &key, const auto & /*val*/) {
+    if (count < getkeys.count && cluster::KeyHashSlot(key) == getkeys.slot) {
+      keys.Push(String(key, key.get_allocator()));
+      count++;
+    }
+  });
+  return keys;
+}
+
+static auto execute(DB & /*db*/, Client & /*cli*/, const ClusterKeySlotCmd &keyslot) -> Response {
+  return Token(Integer(cluster::KeyHashSlot(keyslot.name)));
+}
+
+static auto execute(DB &db, Client & /*cli*/, ClusterMeetCmd meet) -> Response {
+  get_cluster(db).AddNode({std::string(meet.host), static_cast<uint16_t>(meet.port)});
+  return Token("OK");
+}
+
+static auto execute(DB &db, Client & /*cli*/, ClusterNodesCmd /*nodes*/) -> Response {
+  return Token(db.NewString(get_cluster(db).Describe()));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ClusterSetSlotCmd &setslot) -> Response {
+  using enum ClusterSetSlotCmd::State;
+  auto &cluster = get_cluster(db);
+  const auto slot = static_cast<cluster::Slot>(setslot.slot);
+
+  if (setslot.state == Stable) {
+    cluster.SetStable(slot);
+    return Token("OK");
+  }
+
+  const auto *node = cluster.FindNode(setslot.node_id);
+  if (node == nullptr) {
+    return Token(Error{"UNKNOWN_NODE"});
+  }
+
+  switch (setslot.state) {
+    case Importing:
+      cluster.SetImporting(slot, *node);
+      break;
+    case Migrating:
+      cluster.SetMigrating(slot, *node);
+      break;
+    case Node:
+    case Stable:
+      cluster.SetOwner(slot, *node);
+      break;
+  }
+  return Token("OK");
+}
+
+static auto execute(DB &db, Client & /*cli*/, DecrByCmd decr) -> Response {
+  if (auto *val = db.Get(decr.key)) {
+    if (auto i = to_int(*val)) {
+      *i -= decr.val;
+      to_str(*val, *i);
+      return Token(*i);
+    }
+
+    return Token(Error{"CONVERSION_ERROR"});
+  }
+
+  auto str = db.NewString();
+  to_str(str, -decr.val);
+  db.GetAndSet(std::move(decr.key), std::move(str));
+
+  return Token(-decr.val);
+}
+
+static auto execute(DB &db, Client &cli, DecrCmd decr) -> Response {
+  return execute(db, cli, DecrByCmd{std::move(decr.key), 1});
+}
+
+// Defined with the dispatch, it maps the commands scripts may call to their `execute` overloads.
+static auto resolve_script_command(std::string_view name) -> script::CommandFunc;
+
+static auto run_script(DB &db, Client &cli, const script::Program &program, const EvalCmd &eval) -> Response {
+  return Token(program.Run(db, cli, eval.keys, eval.args));
+}
+
+static auto execute(DB &db, Client &cli, const EvalCmd &eval) -> Response try {
+  return run_script(db, cli, *db.GetScripts().Load(eval.script, resolve_script_command).second, eval);
+} catch (const script::ScriptError &e) {
+  return Token(Error{db.NewString(e.what())});
+}
+
+static auto execute(DB &db, Client &cli, EvalShaCmd evalsha) -> Response try {
+  const auto *program = db.GetScripts().Find(evalsha.sha);
+  if (program == nullptr) {
+    return Token(Error{"NOSCRIPT No matching script. Please use EVAL."});
+  }
+  return run_script(db, cli, *program, EvalCmd{{}, std::move(evalsha.keys), std::move(evalsha.args)});
+} catch (const script::ScriptError &e) {
+  return Token(Error{db.NewString(e.what())});
+}
+
+// A key given several times is counted each time, as in Redis.
+static auto execute(DB &db, Client & /*cli*/, const ExistsCmd &exists) -> Response {
+  return Token(Integer(std::ranges::count_if(exists.keys, [&](const String &key) { return db.Exists(key); })));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const GetCmd &get) -> Response {
+  const auto *val = db.Find(get.key);
+  if (val == nullptr) {
+    return Token(NullStr);
+  }
+  if (auto compressed = val->ShareCompressed()) {
+    return Response(std::move(compressed));
+  }
+  if (val->Size() >= DB::SharedValueSize) {
+    return Response(db.Share(get.key));
+  }
+  auto str = db.NewString();
+  val->Read(0, val->Size(), str);
+  return Token(std::move(str));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const GetBitCmd &getbit) -> Response {
+  // Only the bytes up to the bit are decompressed.
+  const auto *val = db.Find(getbit.key);
+  if (val == nullptr || Integer(val->Size()) <= getbit.offset / 8) {
+    return Token(0);
+  }
+  std::pmr::string byte;
+  val->Read(size_t(getbit.offset / 8), 1, byte);
+  return Token(Integer(test_bit(byte, getbit.offset % 8) ? 1 : 0));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const GetDelCmd &getdel) -> Response {
+  if (auto val = db.Delete(getdel.key)) {
+    return Token(std::move(*val));
+  }
+
+  return Token(NullStr);
+}
+
+// Compressed strings are only decoded up to the end of the range.
+static auto execute(DB &db, Client & /*cli*/, GetRangeCmd getrange) -> Response {
+  if (const auto *val = db.Find(getrange.key)) {
+    if ((getrange.start < 0 && getrange.end >= 0) || (getrange.end < 0 && getrange.start >= 0)) {
+      return Token(Error{"INVALID RANGE"});
+    }
+
+    const auto len = Integer(val->Size());
+    getrange.start = getrange.start < 0 ? len - getrange.start : getrange.start;
+    getrange.end = getrange.end < 0 ? len - getrange.end : getrange.end;
+    const auto start = std::min({getrange.start, getrange.end, len});
+    const auto end = std::min({std::max({getrange.start, getrange.end}), len});
+
+    if (start != len) {
+      auto substr = db.NewString();
+      val->Read(size_t(start), size_t(std::min(end + 1, len) - start), substr);
+      return Token(std::move(substr));
+    }
+
+    return Token("");
+  }
+
+  return Token(NullStr);
+}
+
+static auto execute(DB &db, Client & /*cli*/, GetSetCmd getset) -> Response {
+  if (auto oldval = db.GetAndSet(std::move(getset.key), std::move(getset.val))) {
+    return Token(*oldval);
+  }
+  return Token("");
+}
+
+static auto execute(DB &db, Client &cli, const HelloCmd &hello) -> Response {
+  if (hello.protover) {
+    if (*hello.protover != Integer(Protocol::Resp2) && *hello.protover != Integer(Protocol::Resp3)) {
+      return Token(Error{"NOPROTO unsupported protocol version"});
+    }
+    // The reply is already encoded in the new protocol.
+    cli.SetProtocol(static_cast<Protocol>(*hello.protover));
+  }
+
+  Response info(TokenTypeMarker::Map);
+  info.Push(db.NewString("server"));
+  info.Push(db.NewString("redispp"));
+  info.Push(db.NewString("version"));
+  info.Push(db.NewString(REDISPP_VERSION));
+  info.Push(db.NewString("proto"));
+  info.Push(Integer(cli.GetProtocol()));
+  info.Push(db.NewString("mode"));
+  info.Push(db.NewString(db.GetCluster() != nullptr ? "cluster" : "standalone"));
+  info.Push(db.NewString("role"));
+  info.Push(db.NewString("master"));
+  return info;
+}
+
+static auto execute(DB &db, Client & /*cli*/, IncrByCmd incr) -> Response {
+  if (auto *val = db.Get(incr.key)) {
+    if (auto i = to_int(*val)) {
+      *i += incr.val;
+      to_str(*val, *i);
+      return Token(*i);
+    }
+    return Token(Error{"CONVERSION_ERROR"});
+  }
+  auto str = db.NewString();
+  to_str(str, incr.val);
+  db.GetAndSet(std::move(incr.key), std::move(str));
+  return Token(incr.val);
+}
+
+static auto execute(DB &db, Client &cli, IncrCmd incr) -> Response {
+  return execute(db, cli, IncrByCmd{std::move(incr.key), 1});
+}
+
+static auto execute(DB &db, Client & /*cli*/, const LLenCmd &llen) -> Response {
+  const auto *list = db.GetList(llen.key);
+  return Token(Integer(list != nullptr ? list->size() : 0));
+}
+
+// Moves an element between lists, or rotates a list onto itself. Nothing when the source doesn't exist.
+static auto move_element(DB &db, const std::vector<String> &keys, ListEnd from, ListEnd to) -> std::optional<String> {
+  auto *src = db.GetList(keys[0]);
+  if (src == nullptr) {
+    return {};
+  }
+  auto *dest = db.GetList(keys[1]);
+
+  auto element = PopElement(*src, from);
+  if (dest == nullptr) {
+    dest = &db.CreateList(keys[1]);
+  }
+  PushElement(*dest, to, String(element, element.get_allocator()));
+  if (src->empty()) {
+    db.Erase(keys[0]);
+  }
+
+  db.GetBlocking().SignalReady(keys[1]);
+  return element;
+}
+
+static auto execute(DB &db, Client & /*cli*/, const LMoveCmd &lmove) -> Response {
+  if (auto element = move_element(db, lmove.keys, lmove.from, lmove.to)) {
+    return Token(std::move(*element));
+  }
+  return Token(NullStr);
+}
+
+// Without a count, a single element is popped and the reply isn't an array.
+static auto pop_elements(DB &db, const String &key, ListEnd end, std::optional<Integer> count) -> Response {
+  auto *list = db.GetList(key);
+  if (list == nullptr) {
+    return count ? Token(NullArr) : Token(NullStr);
+  }
+
+  Response response = count ? Response(TokenTypeMarker::Array) : Response();
+  for (Integer i = 0; i < count.value_or(1) && !list->empty(); i++) {
+    response.Push(PopElement(*list, end));
+  }
+  if (list->empty()) {
+    db.Erase(key);
+  }
+  return response;
+}
+
+static auto execute(DB &db, Client & /*cli*/, const LPopCmd &lpop) -> Response {
+  return pop_elements(db, lpop.key, ListEnd::Left, lpop.count);
+}
+
+// Elements are pushed one by one, so LPUSH reverses their order.
+static auto push_elements(DB &db, const String &key, ListEnd end, std::vector<String> elements) -> Response {
+  auto *list = db.GetList(key);
+  if (list == nullptr) {
+    list = &db.CreateList(key);
+  }
+  for (auto &element : elements) {
+    PushElement(*list, end, std::move(element));
+  }
+
+  db.GetBlocking().SignalReady(key);
+  return Token(Integer(list->size()));
+}
+
+static auto execute(DB &db, Client & /*cli*/, LPushCmd lpush) -> Response {
+  return push_elements(db, lpush.key, ListEnd::Left, std::move(lpush.elements));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const LRangeCmd &lrange) -> Response {
+  Response elements(TokenTypeMarker::Array);
+
+  const auto *list = db.GetList(lrange.key);
+  if (list == nullptr) {
+    return elements;
+  }
+  if (auto range = clamp_index_range(lrange.start, lrange.stop, Integer(list->size()))) {
+    for (auto i = range->first; i <= range->second; i++) {
+      elements.Push((*list)[static_cast<size_t>(i)]);
+    }
+  }
+  return elements;
+}
+
+// Subscription changes are confirmed with one frame per channel or pattern.
+static void push_subscription_frame(Client &cli, std::string_view kind, std::optional<std::string_view> name) {
+  const auto count = Integer(cli.PubSub().Count());
+  const auto proto = cli.GetProtocol();
+
+  cli.Output().Append([&](std::string &buf) {
+    EncodeAggregateHeader(buf, TokenTypeMarker::Push, 3, proto);
+    EncodeBulkString(buf, kind);
+    if (name) {
+      EncodeBulkString(buf, *name);
+    } else {
+      resp::Encode(buf, NullStr, proto);
+    }
+    resp::Encode(buf, count, proto);
+  });
+}
+
+// For PFCOUNT and PFMERGE's sources, a compressed HyperLogLog is decompressed into `scratch` rather than in the DB.
+static auto get_hll(DB &db, std::string_view key, std::pmr::string *scratch = nullptr) -> std::pmr::string * {
+  auto *val = scratch;
+  if (const auto *stored = db.Find(key); scratch != nullptr && stored != nullptr && stored->ShareCompressed()) {
+    scratch->clear();
+    stored->Read(0, stored->Size(), *scratch);
+  } else {
+    val = db.Get(key);
+  }
+  if (val != nullptr && !hll::IsValid(*val)) {
+    throw ExecutionException{"WRONGTYPE Key is not a valid HyperLogLog string value."};
+  }
+  return val;
+}
+
+static auto execute(DB &db, Client & /*cli*/, const PfAddCmd &pfadd) -> Response {
+  auto *val = get_hll(db, pfadd.key);
+  bool changed = false;
+  if (val == nullptr) {
+    auto hll = db.NewString();
+    hll::Init(hll);
+    db.GetAndSet(String(pfadd.key), std::move(hll));
+    val = db.Get(pfadd.key);
+    changed = true;
+  }
+
+  for (const auto &element : pfadd.elements) {
+    changed |= hll::Add(*val, element);
+  }
+  return Token(Integer(changed ? 1 : 0));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const PfCountCmd &pfcount) -> Response {
+  if (pfcount.keys.size() == 1) {
+    std::pmr::string scratch;
+    auto *val = get_hll(db, pfcount.keys.front(), &scratch);
+    return Token(Integer(val != nullptr ? hll::Count(*val) : 0));
+  }
+
+  // The union of several HyperLogLogs is estimated from the merged registers.
+  hll::RawRegisters raw{};
+  std::pmr::string scratch;
+  for (const auto &key : pfcount.keys) {
+    if (const auto *val = get_hll(db, key, &scratch)) {
+      hll::Merge(raw, *val);
+    }
+  }
+  return Token(Integer(hll::Estimate(raw)));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const PfMergeCmd &pfmerge) -> Response {
+  hll::RawRegisters raw{};
+  std::pmr::string scratch;
+  for (const auto &key : pfmerge.keys) {
+    if (const auto *val = get_hll(db, key, &scratch)) {
+      hll::Merge(raw, *val);
+    }
+  }
+
+  auto *dest = db.Get(pfmerge.keys.front());
+  if (dest == nullptr) {
+    db.GetAndSet(String(pfmerge.keys.front()), db.NewString());
+    dest = db.Get(pfmerge.keys.front());
+  }
+  hll::StoreDense(*dest, raw);
+  return Token("OK");
+}
+
+static auto execute(DB &db, Client &cli, const PSubscribeCmd &psubscribe) -> Response {
+  for (const auto &pattern : psubscribe.patterns) {
+    db.GetPubSub().PSubscribe(cli, pattern);
+    push_subscription_frame(cli, "psubscribe", pattern);
+  }
+  return Response();
+}
+
+static auto execute(DB &db, Client & /*cli*/, const PublishCmd &publish) -> Response {
+  return Token(Integer(db.GetPubSub().Publish(publish.channel, publish.message)));
+}
+
+static auto execute(DB &db, Client &cli, PUnsubscribeCmd punsubscribe) -> Response {
+  auto &state = cli.PubSub();
+
+  if (punsubscribe.patterns.empty()) {
+    punsubscribe.patterns.assign(state.patterns.begin(), state.patterns.end());
+    if (punsubscribe.patterns.empty()) {
+      push_subscription_frame(cli, "punsubscribe", std::nullopt);
+    }
+  }
+
+  for (const auto &pattern : punsubscribe.patterns) {
+    db.GetPubSub().PUnsubscribe(cli, pattern);
+    push_subscription_frame(cli, "punsubscribe", pattern);
+  }
+  return Response();
+}
+
+static auto execute(DB &db, Client & /*cli*/, const RPopCmd &rpop) -> Response {
+  return pop_elements(db, rpop.key, ListEnd::Right, rpop.count);
+}
+
+static auto execute(DB &db, Client & /*cli*/, RPushCmd rpush) -> Response {
+  return push_elements(db, rpush.key, ListEnd::Right, std::move(rpush.elements));
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ScriptExistsCmd &exists) -> Response {
+  Response found(TokenTypeMarker::Array);
+  for (const auto &sha : exists.shas) {
+    found.Push(Integer(db.GetScripts().Find(sha) != nullptr ? 1 : 0));
+  }
+  return found;
+}
+
+static auto execute(DB &db, Client & /*cli*/, ScriptFlushCmd /*flush*/) -> Response {
+  db.GetScripts().Flush();
+  return Token("OK");
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ScriptLoadCmd &load) -> Response try {
+  return Token(db.NewString(db.GetScripts().Load(load.script, resolve_script_command).first));
+} catch (const script::ScriptError &e) {
+  return Token(Error{db.NewString(e.what())});
+}
+
+static auto execute(DB &db, Client & /*cli*/, const SetBitCmd &setbit) -> Response {
+  auto *val = db.Get(setbit.key);
+  if (val == nullptr) {
+    db.GetAndSet(String(setbit.key), db.NewString());
+    val = db.Get(setbit.key);
+  }
+
+  const auto byte = static_cast<size_t>(setbit.offset / 8);
+  if (val->size() <= byte) {
+    val->resize(byte + 1, '\0');
+  }
+  const auto mask = static_cast<char>(0x80 >> (setbit.offset % 8));
+  const bool old = ((*val)[byte] & mask) != 0;
+  (*val)[byte] = static_cast<char>(setbit.value ? (*val)[byte] | mask : (*val)[byte] & ~mask);
+  return Token(Integer(old ? 1 : 0));
+}
+
+static auto execute(DB &db, Client & /*cli*/, SetCmd set) -> Response {
+  db.Set(std::move(set.key), std::move(set.val));
+  return Token("OK");
+}
 
-template <>
-auto parse<AppendCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  AppendCmd append;
+static auto execute(DB &db, Client & /*cli*/, const StrLenCmd &strlen) -> Response {
+  if (const auto *val = db.Find(strlen.key)) {
+    return Token(Integer(val->Size()));
+  }
+  return Token(0);
+}
+
+static auto read_reply(Deserializer &reply_reader) -> boost::asio::awaitable<Token> {
+  auto executor = co_await boost::asio::this_coro::executor;
+  auto ch = boost::make_local_shared<Channel>(executor);
 
-  append.key = get_str(co_await ch.async_receive(use_awaitable));
-  append.val = get_str(co_await ch.async_receive(use_awaitable));
+  // As in Execute: a failed read, e.g. on the deadline closing the socket, must fail the wait for the reply.
+  co_spawn(executor, reply_reader.SendTokens(ch), [ch](const std::exception_ptr &e) {
+    if (e) {
+      ch->close();
+    }
+  });
 
-  co_return append;
+  auto reply = co_await ch->async_receive(use_awaitable);
+  while (!std::holds_alternative<EndOfCommand_t>(co_await ch->async_receive(use_awaitable))) {
+  }
+  co_return reply;
 }
 
-template <>
-auto parse<DecrCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  DecrCmd decr;
+// Encodes the commands that recreate a list, a sorted set or a stream on another node, each preceded by ASKING, into
+// `buf`, and returns their number. Streams are moved entry by entry with their IDs; their consumer groups, and empty
+// streams, can't be recreated that way, so they aren't moved.
+static auto encode_restore(DB &db, std::string_view key, const Value &value, std::string &buf) -> size_t {
+  size_t count = 0;
+  std::vector<std::string_view> args;
+  const auto encode = [&] {
+    EncodeArrayHeader(buf, 1);
+    EncodeBulkString(buf, AskingCmd::Name);
+    EncodeArrayHeader(buf, args.size());
+    count++;
+    for (const auto &arg : args) {
+      EncodeBulkString(buf, arg);
+    }
+  };
+
+  switch (value.GetType()) {
+    case Value::Type::List: {
+      const auto &list = *db.GetList(key);
+      args = {RPushCmd::Name, key};
+      args.insert(args.end(), list.begin(), list.end());
+      encode();
+      break;
+    }
+
+    case Value::Type::SortedSet: {
+      const auto &zset = *db.GetSortedSet(key);
+      std::vector<std::string> scores;
+      scores.reserve(zset.Size());
+      args = {ZAddCmd::Name, key};
+      for (auto it = zset.At(0); it.Valid(); it.Next()) {
+        scores.push_back(fmt::format("{}", it.Score()));
+        args.push_back(scores.back());
+        args.push_back(it.Member());
+      }
+      encode();
+      break;
+    }
 
-  decr.key = get_str(co_await ch.async_receive(use_awaitable));
+    case Value::Type::Stream: {
+      auto &stream = *db.GetStream(key);
+      if (stream.GroupCount() != 0 || stream.Length() == 0) {
+        throw ExecutionException{"ERR MIGRATE can't move streams with consumer groups, or empty streams"};
+      }
+      stream.Range(stream::ID{}, stream::ID::Max(), stream.Length(), [&](const stream::Node::Cursor &entry) {
+        const auto id = stream::FormatID(entry.Id(), db.Allocator());
+        args = {XAddCmd::Name, key, id};
+        entry.ForEachField([&](std::string_view name, std::string_view field) {
+          args.push_back(name);
+          args.push_back(field);
+        });
+        encode();
+      });
+      break;
+    }
 
-  co_return decr;
+    case Value::Type::String:
+      break;
+  }
+  return count;
 }
 
-template <>
-auto parse<DecrByCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  DecrByCmd decr;
+// Moves the key to the target node, each command preceded by ASKING so that it's accepted while the slot is being
+// imported: strings with SET, straight from the DB's buffer, other types with the commands that build them again. A key
+// that already exists there is refused with BUSYKEY; the check and the transfer aren't atomic, though.
+// Other sessions run while the transfer is in flight; writes to the key are refused until it's deleted. As in Redis,
+// the timeout is in milliseconds, 1 s when it isn't positive; when it expires the connection is closed, which fails the
+// transfer and leaves the key here.
+static auto execute(DB &db, Client & /*cli*/, MigrateCmd migrate) -> boost::asio::awaitable<Response> {
+  if (migrate.db != 0) {
+    throw ExecutionException{"INVALID_DB_INDEX"};
+  }
+
+  const auto *stored = db.Find(migrate.key);
+  if (stored == nullptr) {
+    co_return Token("NOKEY");
+  }
+  SharedValue value;
+  std::string requests;
+  size_t request_count = 1;
+  if (stored->GetType() == Value::Type::String) {
+    value = db.Share(migrate.key);
+  } else {
+    request_count = encode_restore(db, migrate.key, *stored, requests);
+  }
+
+  db.SetMigrating(migrate.key, true);
+  struct MigratingGuard {
+    DB &db;
+    const String &key;
+    ~MigratingGuard() { db.SetMigrating(key, false); }
+  } guard{db, migrate.key};
+
+  // Shared with the deadline's handler, which may run after the command is done.
+  struct Target {
+    explicit Target(const boost::asio::any_io_executor &executor) : resolver(executor), socket(executor) {}
+
+    tcp::resolver resolver;
+    tcp::socket socket;
+    bool timed_out = false;
+  };
+  auto executor = co_await boost::asio::this_coro::executor;
+  auto target = boost::make_local_shared<Target>(executor);
+  boost::asio::steady_timer deadline(executor, std::chrono::milliseconds(migrate.timeout > 0 ? migrate.timeout : 1000));
+  deadline.async_wait([target](boost::system::error_code ec) {
+    if (!ec) {
+      target->timed_out = true;
+      target->resolver.cancel();
+      target->socket.close(ec);
+    }
+  });
+
+  try {
+    auto &socket = target->socket;
+    co_await boost::asio::async_connect(
+        socket,
+        co_await target->resolver.async_resolve(migrate.host, std::to_string(migrate.port), use_awaitable),
+        use_awaitable);
+
+    Serializer request_writer(socket);
+    Deserializer reply_reader(socket);
+
+    // As in Redis without REPLACE, a key that's already on the target is neither overwritten nor merged into.
+    std::string exists;
+    EncodeArrayHeader(exists, 1);
+    EncodeBulkString(exists, AskingCmd::Name);
+    EncodeArrayHeader(exists, 2);
+    EncodeBulkString(exists, ExistsCmd::Name);
+    EncodeBulkString(exists, migrate.key);
+    co_await boost::asio::async_write(socket, boost::asio::buffer(exists), use_awaitable);
+    for (size_t i = 0; i < 2; i++) {
+      auto reply = co_await read_reply(reply_reader);
+      if (auto *err = std::get_if<Error>(&reply)) {
+        co_return Token(Error{db.NewString(fmt::format("IOERR {}", err->msg))});
+      }
+      if (auto *count = std::get_if<Integer>(&reply); count != nullptr && *count != 0) {
+        co_return Token(Error{"BUSYKEY Target key name already exists."});
+      }
+    }
+
+    if (value) {
+      co_await request_writer.SerializeArrayHeader(1);
+      co_await request_writer.Serialize(String(AskingCmd::Name));
+      co_await request_writer.SerializeArrayHeader(3);
+      co_await request_writer.Serialize(String(SetCmd::Name));
+      co_await request_writer.Serialize(migrate.key);
+      co_await request_writer.SerializeBulkString(*value);
+    } else {
+      co_await boost::asio::async_write(socket, boost::asio::buffer(requests), use_awaitable);
+    }
+
+    // Replies to ASKING and to the command.
+    for (size_t i = 0; i < 2 * request_count; i++) {
+      auto reply = co_await read_reply(reply_reader);
+      if (auto *err = std::get_if<Error>(&reply)) {
+        co_return Token(Error{db.NewString(fmt::format("IOERR {}", err->msg))});
+      }
+    }
+  } catch (const boost::system::system_error &e) {
+    co_return Token(Error{db.NewString(
+        target->timed_out ? "IOERR Timeout migrating to the target node" : fmt::format("IOERR {}", e.what()))});
+  }
+  deadline.cancel();
+
+  db.Erase(migrate.key);
+  co_return Token("OK");
+}
 
-  decr.key = get_str(co_await ch.async_receive(use_awaitable));
-  decr.val = get_int(co_await ch.async_receive(use_awaitable));
+// Suspends the command until a push serves the waiter, the timeout expires or the client goes away. Waiters on the same
+// key are served in the order they blocked.
+static auto block(DB &db, blocking::Waiter &waiter, double timeout) -> boost::asio::awaitable<void> {
+  if (timeout == 0) {
+    waiter.timer.expires_at(boost::asio::steady_timer::time_point::max());
+  } else {
+    waiter.timer.expires_after(
+        std::chrono::duration_cast<boost::asio::steady_timer::duration>(std::chrono::duration<double>(timeout)));
+  }
 
-  co_return decr;
+  auto &registry = db.GetBlocking();
+  registry.Block(waiter);
+  boost::system::error_code ec;
+  co_await waiter.timer.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+  registry.Unblock(waiter);
 }
 
-template <>
-auto parse<GetCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  GetCmd get;
+// BLPOP / BRPOP: [key, element] from the first non-empty list.
+static auto blocking_pop(DB &db, Client &cli, std::vector<String> keys, ListEnd from, double timeout)
+    -> boost::asio::awaitable<Response> {
+  for (const auto &key : keys) {
+    if (auto *list = db.GetList(key)) {
+      Response response(TokenTypeMarker::Array);
+      response.Push(key);
+      response.Push(PopElement(*list, from));
+      if (list->empty()) {
+        db.Erase(key);
+      }
+      co_return response;
+    }
+  }
 
-  get.key = get_str(co_await ch.async_receive(use_awaitable));
+  blocking::Waiter waiter(cli, keys, from, co_await boost::asio::this_coro::executor);
+  co_await block(db, waiter, timeout);
+  if (!waiter.served) {
+    co_return Token(NullArr);
+  }
 
-  co_return get;
+  Response response(TokenTypeMarker::Array);
+  response.Push(keys[waiter.served->first]);
+  response.Push(std::move(waiter.served->second));
+  co_return response;
 }
 
-template <>
-auto parse<GetDelCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  GetDelCmd getdel;
+static auto execute(DB &db, Client &cli, BLPopCmd blpop) -> boost::asio::awaitable<Response> {
+  return blocking_pop(db, cli, std::move(blpop.keys), ListEnd::Left, blpop.timeout);
+}
+
+static auto execute(DB &db, Client &cli, BRPopCmd brpop) -> boost::asio::awaitable<Response> {
+  return blocking_pop(db, cli, std::move(brpop.keys), ListEnd::Right, brpop.timeout);
+}
+
+static auto execute(DB &db, Client &cli, BLMoveCmd blmove) -> boost::asio::awaitable<Response> {
+  // The destination's type is checked before blocking, as it would be by LMOVE.
+  db.GetList(blmove.keys[1]);
+  if (auto element = move_element(db, blmove.keys, blmove.from, blmove.to)) {
+    co_return Token(std::move(*element));
+  }
 
-  getdel.key = get_str(co_await ch.async_receive(use_awaitable));
+  blocking::Waiter waiter(cli, std::span(blmove.keys).first(1), blmove.from, co_await boost::asio::this_coro::executor);
+  waiter.destination = &blmove.keys[1];
+  waiter.to = blmove.to;
+  co_await block(db, waiter, blmove.timeout);
+  if (!waiter.served) {
+    co_return Token(NullStr);
+  }
+  co_return Token(std::move(waiter.served->second));
+}
 
-  co_return getdel;
+static auto execute(DB &db, Client &cli, const SubscribeCmd &subscribe) -> Response {
+  for (const auto &channel : subscribe.channels) {
+    db.GetPubSub().Subscribe(cli, channel);
+    push_subscription_frame(cli, "subscribe", channel);
+  }
+  return Response();
 }
 
-template <>
-auto parse<GetRangeCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  GetRangeCmd getrange;
+static auto execute(DB &db, Client &cli, UnsubscribeCmd unsubscribe) -> Response {
+  auto &state = cli.PubSub();
 
-  getrange.key = get_str(co_await ch.async_receive(use_awaitable));
-  getrange.start = get_int(co_await ch.async_receive(use_awaitable));
-  getrange.end = get_int(co_await ch.async_receive(use_awaitable));
+  if (unsubscribe.channels.empty()) {
+    unsubscribe.channels.assign(state.channels.begin(), state.channels.end());
+    if (unsubscribe.channels.empty()) {
+      push_subscription_frame(cli, "unsubscribe", std::nullopt);
+    }
+  }
 
-  co_return getrange;
+  for (const auto &channel : unsubscribe.channels) {
+    db.GetPubSub().Unsubscribe(cli, channel);
+    push_subscription_frame(cli, "unsubscribe", channel);
+  }
+  return Response();
 }
 
-template <>
-auto parse<GetSetCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  GetSetCmd getset;
+static auto execute(DB &db, Client & /*cli*/, const XAckCmd &xack) -> Response {
+  auto *stream = db.GetStream(xack.key);
+  auto *group = stream != nullptr ? stream->GetGroup(xack.group) : nullptr;
+  if (group == nullptr) {
+    return Token(Integer(0));
+  }
 
-  getset.key = get_str(co_await ch.async_receive(use_awaitable));
-  getset.val = get_str(co_await ch.async_receive(use_awaitable));
+  Integer acked = 0;
+  for (const auto &id : xack.ids) {
+    acked += group->Ack(id) ? 1 : 0;
+  }
+  return Token(acked);
+}
 
-  co_return getset;
+static auto trim_stream(stream::Stream &stream, const StreamTrim &trim) -> size_t {
+  if (trim.strategy == StreamTrim::Strategy::MaxLen) {
+    return stream.TrimMaxLen(trim.maxlen, trim.approx);
+  }
+  return stream.TrimMinId(trim.minid, trim.approx);
 }
 
-template <>
-auto parse<IncrCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  IncrCmd incr;
+// The ID of a new entry: explicit, or generated from the clock and the last ID, as IDs only grow.
+static auto new_stream_id(const XAddCmd &xadd, stream::ID last) -> stream::ID {
+  static constexpr const char *IDNotIncreasing =
+      "INVALID_STREAM_ID The ID specified in XADD is equal or smaller than the target stream top item";
 
-  incr.key = get_str(co_await ch.async_receive(use_awaitable));
+  if (xadd.ms && xadd.seq) {
+    const stream::ID id{*xadd.ms, *xadd.seq};
+    if (id == stream::ID{}) {
+      throw ExecutionException{"INVALID_STREAM_ID The ID specified in XADD must be greater than 0-0"};
+    }
+    if (id <= last) {
+      throw ExecutionException{IDNotIncreasing};
+    }
+    return id;
+  }
 
-  co_return incr;
+  const auto now = std::chrono::system_clock::now().time_since_epoch();
+  const auto ms = xadd.ms.value_or(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+  if (ms > last.ms) {
+    return {ms, 0};
+  }
+  if ((xadd.ms && ms < last.ms) || last == stream::ID::Max()) {
+    throw ExecutionException{IDNotIncreasing};
+  }
+  return next_stream_id(last);
 }
 
-template <>
-auto parse<IncrByCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  IncrByCmd incr;
+static auto execute(DB &db, Client & /*cli*/, const XAddCmd &xadd) -> Response {
+  auto *stream = db.GetStream(xadd.key);
+  if (stream == nullptr && xadd.nomkstream) {
+    return Token(NullStr);
+  }
 
-  incr.key = get_str(co_await ch.async_receive(use_awaitable));
-  incr.val = get_int(co_await ch.async_receive(use_awaitable));
+  const auto id = new_stream_id(xadd, stream != nullptr ? stream->LastId() : stream::ID{});
+  if (stream == nullptr) {
+    stream = &db.CreateStream(xadd.key);
+  }
+  stream->Add(id, xadd.fields);
+  if (xadd.trim) {
+    trim_stream(*stream, *xadd.trim);
+  }
 
-  co_return incr;
+  db.GetBlocking().SignalReady(xadd.key);
+  return Token(stream::FormatID(id, db.Allocator()));
 }
 
-template <>
-auto parse<SetCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  SetCmd set;
+static auto execute(DB &db, Client & /*cli*/, const XGroupCreateCmd &create) -> Response {
+  auto *stream = db.GetStream(create.key);
+  if (stream == nullptr) {
+    if (!create.mkstream) {
+      throw ExecutionException{"NO_SUCH_KEY The stream must exist, MKSTREAM creates an empty one"};
+    }
+    stream = &db.CreateStream(create.key);
+  }
 
-  set.key = get_str(co_await ch.async_receive(use_awaitable));
-  set.val = get_str(co_await ch.async_receive(use_awaitable));
+  if (!stream->CreateGroup(create.group, create.id.value_or(stream->LastId()))) {
+    throw ExecutionException{"BUSYGROUP Consumer Group name already exists"};
+  }
+  return Token("OK");
+}
 
-  co_return set;
+static auto execute(DB &db, Client & /*cli*/, const XGroupDestroyCmd &destroy) -> Response {
+  auto *stream = db.GetStream(destroy.key);
+  if (stream == nullptr) {
+    throw ExecutionException{"NO_SUCH_KEY The stream must exist"};
+  }
+  return Token(Integer(stream->DestroyGroup(destroy.group) ? 1 : 0));
 }
 
-template <>
-auto parse<StrLenCmd>(Channel &ch) -> boost::asio::awaitable<Command> {
-  StrLenCmd strlen;
+static auto execute(DB &db, Client & /*cli*/, const XLenCmd &xlen) -> Response {
+  const auto *stream = db.GetStream(xlen.key);
+  return Token(Integer(stream != nullptr ? stream->Length() : 0));
+}
 
-  strlen.key = get_str(co_await ch.async_receive(use_awaitable));
+// [id, [name, value, ...]]
+static void push_stream_entry(DB &db, Response &response, const stream::Node::Cursor &entry) {
+  response.PushAggregate(TokenTypeMarker::Array, 2);
+  response.Push(stream::FormatID(entry.Id(), db.Allocator()));
+  response.PushAggregate(TokenTypeMarker::Array, 2 * entry.FieldCount());
+  entry.ForEachField([&](std::string_view name, std::string_view value) {
+    response.Push(db.NewString(name));
+    response.Push(db.NewString(value));
+  });
+}
 
-  co_return strlen;
+static auto stream_count(const std::optional<Integer> &count) noexcept -> size_t {
+  return count ? static_cast<size_t>(std::max<Integer>(*count, 0)) : SIZE_MAX;
 }
 
-using ParseFunc = auto(*)(Channel &ch) -> boost::asio::awaitable<Command>;
+static auto execute(DB &db, Client & /*cli*/, const XRangeCmd &xrange) -> Response {
+  Response entries(TokenTypeMarker::Array);
 
-static const std::unordered_map<std::string_view, ParseFunc, utils::string_hash, std::equal_to<>> ParseFuncs = {
-    {AppendCmd::Name, parse<AppendCmd>},
-    {DecrCmd::Name, parse<DecrCmd>},
-    {DecrByCmd::Name, parse<DecrByCmd>},
-    {GetCmd::Name, parse<GetCmd>},
-    {GetDelCmd::Name, parse<GetDelCmd>},
-    {GetRangeCmd::Name, parse<GetRangeCmd>},
-    {GetSetCmd::Name, parse<GetSetCmd>},
-    {IncrCmd::Name, parse<IncrCmd>},
-    {IncrByCmd::Name, parse<IncrByCmd>},
-    {SetCmd::Name, parse<SetCmd>},
-    {StrLenCmd::Name, parse<StrLenCmd>}};
+  auto *stream = db.GetStream(xrange.key);
+  if (stream != nullptr && xrange.start <= xrange.end) {
+    stream->Range(xrange.start, xrange.end, stream_count(xrange.count),
+                  [&](const auto &entry) { push_stream_entry(db, entries, entry); });
+  }
+  return entries;
+}
 
-void Response::Push(Token tok) { m_tokens.push_back(std::move(tok)); }
+// Pushes [key, [entry, ...]] with the entries following `after`, unless there are none.
+template <typename Func>
+static auto push_new_entries(DB &db, Response &response, const String &key, stream::ID after, size_t count,
+                             Func &&on_entry) -> bool {
+  auto *stream = db.GetStream(key);
+  if (stream == nullptr || stream->Length() == 0 || stream->LastId() <= after) {
+    return false;
+  }
 
-auto Response::Serialize(Serializer &resp_sender) const -> boost::asio::awaitable<void> {
-  if (m_is_array) {
-    co_await resp_sender.SerializeArrayHeader(m_tokens.size());
+  response.PushAggregate(TokenTypeMarker::Array, 2);
+  response.Push(key);
+  const auto entries = response.PushAggregate(TokenTypeMarker::Array);
+  size_t read = 0;
+  stream->Range(next_stream_id(after), stream::ID::Max(), count, [&](const auto &entry) {
+    push_stream_entry(db, response, entry);
+    on_entry(entry.Id());
+    read++;
+  });
+  response.SetAggregateSize(entries, read);
+  return true;
+}
+
+// XREAD replies [[key, [entry, ...]], ...] for the streams with new entries, NullArr when there are none.
+static auto read_streams(DB &db, const XReadCmd &xread) -> Response {
+  Response response(TokenTypeMarker::Array);
+  bool found = false;
+  for (size_t i = 0; i < xread.keys.size(); i++) {
+    found |= push_new_entries(db, response, xread.keys[i], *xread.ids[i], stream_count(xread.count),
+                              [](stream::ID /*id*/) {});
   }
+  return found ? response : Response(Token(NullArr));
+}
 
-  for (const auto &tok : m_tokens) {
-    co_await resp_sender.Serialize(tok);
+// Suspends a stream read until an entry is added to one of the keys. Returns whether one was.
+static auto wait_for_entries(DB &db, Client &cli, std::span<const String> keys, double timeout)
+    -> boost::asio::awaitable<bool> {
+  blocking::Waiter waiter(cli, keys, ListEnd::Left, co_await boost::asio::this_coro::executor);
+  waiter.wake_only = true;
+  co_await block(db, waiter, timeout);
+  co_return waiter.woken;
+}
+
+// Blocks a stream read until `read` finds entries or BLOCK's timeout passes. Being woken up doesn't mean there are
+// some, e.g. another consumer of the group may have taken them first: the read then blocks again for the time left.
+template <typename Read>
+static auto read_blocking(DB &db, Client &cli, std::span<const String> keys, Integer block_ms, Read read)
+    -> boost::asio::awaitable<Response> {
+  using Clock = std::chrono::steady_clock;
+  const auto deadline = Clock::now() + std::chrono::milliseconds(block_ms);
+  for (;;) {
+    double timeout = 0;  // Forever
+    if (block_ms != 0) {
+      timeout = std::chrono::duration<double>(deadline - Clock::now()).count();
+      if (timeout <= 0) {
+        co_return Token(NullArr);
+      }
+    }
+    if (!co_await wait_for_entries(db, cli, keys, timeout)) {
+      co_return Token(NullArr);
+    }
+    auto response = read();
+    if (response.Single() == nullptr) {
+      co_return response;
+    }
   }
 }
 
-static auto execute(DB &db, Client & /*cli*/, AppendCmd append) -> Response {
-  if (auto *val = db.Get(append.key)) {
-    (*val) += append.val;
-    return Token(Integer(val->length()));
+static auto execute(DB &db, Client &cli, XReadCmd xread) -> boost::asio::awaitable<Response> {
+  // `$` is resolved once, so that a blocked read returns the entries added while it waited.
+  for (size_t i = 0; i < xread.keys.size(); i++) {
+    if (!xread.ids[i]) {
+      const auto *stream = db.GetStream(xread.keys[i]);
+      xread.ids[i] = stream != nullptr ? stream->LastId() : stream::ID{};
+    }
   }
 
-  auto len = static_cast<Integer>(append.val.length());
-  db.GetAndSet(std::move(append.key), std::move(append.val));
-  return Token(len);
+  auto response = read_streams(db, xread);
+  if (response.Single() == nullptr || !xread.block) {
+    co_return response;
+  }
+  co_return co_await read_blocking(db, cli, xread.keys, *xread.block, [&] { return read_streams(db, xread); });
 }
 
-static auto execute(DB &db, Client & /*cli*/, DecrByCmd decr) -> Response {
-  if (auto *val = db.Get(decr.key)) {
-    if (auto i = to_int(*val)) {
-      *i -= decr.val;
-      to_str(*val, *i);
-      return Token(*i);
+// New entries are delivered to the consumer and added to the PEL; with an ID, the consumer's pending entries after it
+// are delivered again. Entries trimmed since they were delivered are replied as [id, nil].
+static auto read_group(DB &db, const XReadGroupCmd &xreadgroup) -> Response {
+  Response response(TokenTypeMarker::Array);
+  bool found = false;
+  for (size_t i = 0; i < xreadgroup.keys.size(); i++) {
+    const auto &key = xreadgroup.keys[i];
+    auto *stream = db.GetStream(key);
+    auto *group = stream != nullptr ? stream->GetGroup(xreadgroup.group) : nullptr;
+    if (group == nullptr) {
+      throw ExecutionException{
+          String(fmt::format("NOGROUP No such key '{}' or consumer group '{}'", key, xreadgroup.group))};
     }
+    auto &consumer = group->GetConsumer(xreadgroup.consumer);
 
-    return Token(Error{"CONVERSION_ERROR"});
+    if (!xreadgroup.ids[i]) {
+      found |= push_new_entries(db, response, key, group->LastDelivered(), stream_count(xreadgroup.count),
+                                [&](stream::ID id) { group->Deliver(consumer, id, xreadgroup.noack); });
+      continue;
+    }
+
+    response.PushAggregate(TokenTypeMarker::Array, 2);
+    response.Push(key);
+    const auto entries = response.PushAggregate(TokenTypeMarker::Array);
+    size_t read = 0;
+    for (const auto *pending = consumer.pending.Next(stream::ToKey(*xreadgroup.ids[i]));
+         pending != nullptr && read < stream_count(xreadgroup.count); pending = consumer.pending.Next(pending->first)) {
+      const auto id = stream::FromKey(pending->first);
+      bool exists = false;
+      stream->Range(id, id, 1, [&](const auto &entry) {
+        push_stream_entry(db, response, entry);
+        exists = true;
+      });
+      if (!exists) {
+        response.PushAggregate(TokenTypeMarker::Array, 2);
+        response.Push(stream::FormatID(id, db.Allocator()));
+        response.Push(NullArr);
+      }
+      group->Redeliver(id);
+      read++;
+    }
+    response.SetAggregateSize(entries, read);
+    found = true;
   }
+  return found ? response : Response(Token(NullArr));
+}
 
-  auto str = db.NewString();
-  to_str(str, -decr.val);
-  db.GetAndSet(std::move(decr.key), str);
+static auto execute(DB &db, Client &cli, XReadGroupCmd xreadgroup) -> boost::asio::awaitable<Response> {
+  auto response = read_group(db, xreadgroup);
+  // Only reads of new entries block, as in Redis.
+  const bool new_only = std::all_of(xreadgroup.ids.begin(), xreadgroup.ids.end(), [](const auto &id) { return !id; });
+  if (response.Single() == nullptr || !xreadgroup.block || !new_only) {
+    co_return response;
+  }
+  co_return co_await read_blocking(db, cli, xreadgroup.keys, *xreadgroup.block,
+                                   [&] { return read_group(db, xreadgroup); });
+}
 
-  return Token(std::move(str));
+static auto execute(DB &db, Client & /*cli*/, const XTrimCmd &xtrim) -> Response {
+  auto *stream = db.GetStream(xtrim.key);
+  return Token(Integer(stream != nullptr ? trim_stream(*stream, xtrim.trim) : 0));
 }
 
-static auto execute(DB &db, Client &cli, DecrCmd decr) -> Response {
-  return execute(db, cli, DecrByCmd{std::move(decr.key), 1});
+static auto execute(DB &db, Client & /*cli*/, const ZAddCmd &zadd) -> Response {
+  auto *zset = db.GetSortedSet(zadd.key);
+  if (zset == nullptr) {
+    if (zadd.xx) {
+      return zadd.incr ? Token(NullStr) : Token(0);
+    }
+    zset = &db.CreateSortedSet(zadd.key);
+  }
+
+  Integer changed = 0;
+  std::optional<double> incremented;
+  for (const auto &[score, member] : zadd.elements) {
+    const auto old = zset->Score(member);
+    auto new_score = zadd.incr && old ? *old + score : score;
+    if (std::isnan(new_score)) {
+      throw ExecutionException{"INVALID_SCORE Resulting score is not a number (NaN)"};
+    }
+    if (old ? zadd.nx || (zadd.gt && new_score <= *old) || (zadd.lt && new_score >= *old) : zadd.xx) {
+      continue;
+    }
+    if (!old || new_score != *old) {
+      zset->Add(member, new_score);
+      changed += !old || zadd.ch ? 1 : 0;
+    }
+    incremented = new_score;
+  }
+
+  if (zadd.incr) {
+    return incremented ? Token(Double{*incremented}) : Token(NullStr);
+  }
+  return Token(changed);
 }
 
-static auto execute(DB &db, Client & /*cli*/, const GetCmd &get) -> Response {
-  if (auto *val = db.Get(get.key)) {
-    return Token(*val);
+static auto execute(DB &db, Client & /*cli*/, const ZCardCmd &zcard) -> Response {
+  const auto *zset = db.GetSortedSet(zcard.key);
+  return Token(Integer(zset != nullptr ? zset->Size() : 0));
+}
+
+// A member of a range, followed by its score with WITHSCORES: in a pair with RESP3, inline with RESP2.
+static void push_range_element(Response &response, Client &cli, const zset::ScoreTree::Iterator &it,
+                               bool withscores) {
+  if (!withscores) {
+    response.Push(String(it.Member()));
+    return;
   }
-  return Token(NullStr);
+  if (cli.GetProtocol() == Protocol::Resp3) {
+    response.PushAggregate(TokenTypeMarker::Array, 2);
+  }
+  response.Push(String(it.Member()));
+  response.Push(Double{it.Score()});
 }
 
-static auto execute(DB &db, Client & /*cli*/, const GetDelCmd &getdel) -> Response {
-  if (auto val = db.Delete(getdel.key)) {
-    return Token(std::move(*val));
+// Elements are read from the leaves of the tree one after another, from the highest rank backwards with `reverse`.
+static auto rank_range(DB &db, Client &cli, const String &key, Integer start, Integer stop, bool withscores,
+                       bool reverse) -> Response {
+  Response elements(TokenTypeMarker::Array);
+
+  const auto *zset = db.GetSortedSet(key);
+  if (zset == nullptr) {
+    return elements;
+  }
+  const auto len = Integer(zset->Size());
+  if (auto range = clamp_index_range(start, stop, len)) {
+    auto it = zset->At(static_cast<size_t>(reverse ? len - 1 - range->first : range->first));
+    for (auto i = range->first; i <= range->second; i++) {
+      push_range_element(elements, cli, it, withscores);
+      if (reverse) {
+        it.Prev();
+      } else {
+        it.Next();
+      }
+    }
   }
+  return elements;
+}
 
-  return Token(NullStr);
+static auto execute(DB &db, Client &cli, const ZRangeCmd &zrange) -> Response {
+  return rank_range(db, cli, zrange.key, zrange.start, zrange.stop, zrange.withscores, false);
 }
 
-static auto execute(DB &db, Client & /*cli*/, GetRangeCmd getrange) -> Response {
-  if (auto *val = db.Get(getrange.key)) {
-    if ((getrange.start < 0 && getrange.end >= 0) || (getrange.end < 0 && getrange.start >= 0)) {
-      return Token(Error{"INVALID RANGE"});
-    }
+static auto execute(DB &db, Client &cli, const ZRangeByScoreCmd &zrange) -> Response {
+  Response elements(TokenTypeMarker::Array);
 
-    getrange.start = getrange.start < 0 ? Integer(val->length()) - getrange.start : getrange.start;
-    getrange.end = getrange.end < 0 ? Integer(val->length()) - getrange.end : getrange.end;
-    const auto start = std::min({getrange.start, getrange.end, Integer(val->length())});
-    const auto end = std::min({std::max({getrange.start, getrange.end}), Integer(val->length())});
+  const auto *zset = db.GetSortedSet(zrange.key);
+  if (zset == nullptr || zrange.offset < 0) {
+    return elements;
+  }
 
-    if (start != Integer(val->length())) {
-      return Token(val->substr(start, end + 1 - start));
-    }
+  auto it = zset->LowerBound(zrange.min.score, zrange.min.exclusive);
+  auto in_range = [&] { return zrange.max.exclusive ? it.Score() < zrange.max.score : it.Score() <= zrange.max.score; };
+  for (Integer skipped = 0; it.Valid() && skipped < zrange.offset; skipped++) {
+    it.Next();
+  }
+  auto count = zrange.count.value_or(-1);
+  for (; it.Valid() && count != 0 && in_range(); it.Next(), count--) {
+    push_range_element(elements, cli, it, zrange.withscores);
+  }
+  return elements;
+}
 
-    return Token("");
+static auto execute(DB &db, Client & /*cli*/, const ZRankCmd &zrank) -> Response {
+  const auto *zset = db.GetSortedSet(zrank.key);
+  const auto rank = zset != nullptr ? zset->Rank(zrank.member) : std::nullopt;
+  return rank ? Token(Integer(*rank)) : Token(NullStr);
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ZRemCmd &zrem) -> Response {
+  auto *zset = db.GetSortedSet(zrem.key);
+  if (zset == nullptr) {
+    return Token(0);
   }
 
-  return Token(NullStr);
+  Integer removed = 0;
+  for (const auto &member : zrem.members) {
+    removed += zset->Remove(member) ? 1 : 0;
+  }
+  if (zset->Size() == 0) {
+    db.Erase(zrem.key);
+  }
+  return Token(removed);
 }
 
-static auto execute(DB &db, Client & /*cli*/, GetSetCmd getset) -> Response {
-  if (auto oldval = db.GetAndSet(std::move(getset.key), std::move(getset.val))) {
-    return Token(*oldval);
+static auto execute(DB &db, Client &cli, const ZRevRangeCmd &zrevrange) -> Response {
+  return rank_range(db, cli, zrevrange.key, zrevrange.start, zrevrange.stop, zrevrange.withscores, true);
+}
+
+static auto execute(DB &db, Client & /*cli*/, const ZScoreCmd &zscore) -> Response {
+  const auto *zset = db.GetSortedSet(zscore.key);
+  const auto score = zset != nullptr ? zset->Score(zscore.member) : std::nullopt;
+  return score ? Token(Double{*score}) : Token(NullStr);
+}
+
+// Commands whose execution suspends the session, e.g. on network I/O.
+template <typename Cmd>
+concept AsyncCommand = requires(DB &db, Client &cli, Cmd cmd) {
+  { execute(db, cli, std::move(cmd)) } -> std::same_as<boost::asio::awaitable<Response>>;
+};
+
+static auto execute(DB &db, Client &cli, Command command) -> boost::asio::awaitable<Response> {
+  co_return co_await std::visit(
+      [&](auto command) -> boost::asio::awaitable<Response> {
+        if constexpr (AsyncCommand<decltype(command)>) {
+          co_return co_await execute(db, cli, std::move(command));
+        } else {
+          co_return execute(db, cli, std::move(command));
+        }
+      },
+      command);
+}
+
+template <typename Cmd>
+  requires requires(const Cmd &cmd) {
+    { cmd.key } -> std::convertible_to<const String &>;
   }
-  return Token("");
+static auto command_keys(const Cmd &cmd) noexcept -> std::span<const String> {
+  return {&cmd.key, 1};
 }
 
-static auto execute(DB &db, Client & /*cli*/, IncrByCmd incr) -> Response {
-  if (auto *val = db.Get(incr.key)) {
-    if (auto i = to_int(*val)) {
-      *i += incr.val;
-      to_str(*val, *i);
-      return Token(*i);
-    }
-    return Token(Error{"CONVERSION_ERROR"});
+template <typename Cmd>
+  requires requires(const Cmd &cmd) {
+    { cmd.keys } -> std::convertible_to<const std::vector<String> &>;
   }
-  auto str = db.NewString();
-  to_str(str, incr.val);
-  db.GetAndSet(std::move(incr.key), str);
-  return Token(std::move(str));
+static auto command_keys(const Cmd &cmd) noexcept -> std::span<const String> {
+  return cmd.keys;
 }
 
-static auto execute(DB &db, Client &cli, IncrCmd incr) -> Response {
-  return execute(db, cli, IncrByCmd{std::move(incr.key), 1});
+template <typename Cmd>
+static auto command_keys(const Cmd & /*cmd*/) noexcept -> std::span<const String> {
+  return {};
 }
 
-static auto execute(DB &db, Client & /*cli*/, SetCmd set) -> Response {
-  db.GetAndSet(std::move(set.key), std::move(set.val));
-  return Token("OK");
+template <typename Cmd>
+  requires requires { Cmd::KeyAccess; }
+static auto command_access(const Cmd & /*cmd*/) noexcept -> std::optional<Access> {
+  return Cmd::KeyAccess;
 }
 
-static auto execute(DB &db, Client & /*cli*/, const StrLenCmd &strlen) -> Response {
-  if (auto *val = db.Get(strlen.key)) {
-    return Token(Integer(val->length()));
+template <typename Cmd>
+static auto command_access(const Cmd & /*cmd*/) noexcept -> std::optional<Access> {
+  return {};
+}
+
+// Cluster redirection for the keys of `command`, the way Redis' getNodeByQuery() decides it.
+static auto redirect(DB &db, const Command &command, bool asking) -> std::optional<Error> {
+  const auto *cluster = db.GetCluster();
+  if (cluster == nullptr) {
+    return {};
   }
-  return Token(0);
+
+  const auto keys = std::visit([](const auto &cmd) { return command_keys(cmd); }, command);
+  if (keys.empty()) {
+    return {};
+  }
+
+  const auto slot = cluster::KeyHashSlot(keys.front());
+  size_t missing = 0;
+  for (const auto &key : keys) {
+    if (cluster::KeyHashSlot(key) != slot) {
+      return Error{db.NewString("CROSSSLOT Keys in request don't hash to the same slot")};
+    }
+    missing += db.Exists(key) ? 0 : 1;
+  }
+
+  const auto *owner = cluster->Owner(slot);
+  if (owner == nullptr) {
+    return Error{db.NewString("CLUSTERDOWN Hash slot not served")};
+  }
+
+  if (owner == &cluster->Myself()) {
+    const auto *target = cluster->MigratingTo(slot);
+    if (target == nullptr || missing == 0) {
+      return {};
+    }
+    if (missing == keys.size()) {
+      return Error{db.NewString(fmt::format("ASK {} {}:{}", slot, target->host, target->port))};
+    }
+    return Error{db.NewString("TRYAGAIN Multiple keys request during rehashing of slot")};
+  }
+
+  if (asking && cluster->ImportingFrom(slot) != nullptr) {
+    if (missing != 0 && keys.size() > 1) {
+      return Error{db.NewString("TRYAGAIN Multiple keys request during rehashing of slot")};
+    }
+    return {};
+  }
+
+  return Error{db.NewString(fmt::format("MOVED {} {}:{}", slot, owner->host, owner->port))};
+}
+
+// Writes to a key MIGRATE is sending would be lost when it deletes the key.
+static void check_migrating(const DB &db, const Command &command) {
+  if (std::visit([](const auto &cmd) { return command_access(cmd); }, command) != Access::Write) {
+    return;
+  }
+  for (const auto &key : std::visit([](const auto &cmd) { return command_keys(cmd); }, command)) {
+    if (db.IsMigrating(key)) {
+      throw ExecutionException{"TRYAGAIN Key is being migrated"};
+    }
+  }
+}
+
+// Client side caching: reads of tracking clients are remembered, writes invalidate the readers once they're done.
+// Keys are only copied when needed, since executing the command consumes them.
+class KeyTracker {
+ public:
+  KeyTracker(DB &db, Client &client, const Command &command)
+      : m_tracking(db.GetTracking()),
+        m_client(client),
+        m_access(std::visit([](const auto &cmd) { return command_access(cmd); }, command)) {
+    if ((m_access == Access::Read && client.GetTracking() != nullptr) ||
+        (m_access == Access::Write && m_tracking.Active())) {
+      const auto keys = std::visit([](const auto &cmd) { return command_keys(cmd); }, command);
+      m_keys.assign(keys.begin(), keys.end());
+    }
+  }
+
+  void Done() {
+    for (const auto &key : m_keys) {
+      if (m_access == Access::Read) {
+        m_tracking.Remember(m_client, key);
+      } else {
+        m_tracking.Invalidate(key, m_client.Id());
+      }
+    }
+  }
+
+ private:
+  tracking::Table &m_tracking;
+  Client &m_client;
+  std::optional<Access> m_access;
+  std::vector<String> m_keys;
+};
+
+// Runs a command for a script, straight through its `execute` overload. Keys the script didn't declare are still
+// checked against the cluster slots.
+template <typename Cmd>
+static auto script_call(DB &db, Client &cli, std::vector<Token> tokens) -> Token try {
+  Arguments args{std::move(tokens)};
+  auto command = parse<Cmd>(args);
+  if (!args.Empty()) {
+    throw ExecutionException("EXTRA_ARGUMENTS_TO_COMMAND");
+  }
+  if (auto err = redirect(db, command, false)) {
+    return std::move(*err);
+  }
+  check_migrating(db, command);
+
+  KeyTracker tracker(db, cli, command);
+  auto response = execute(db, cli, std::get<Cmd>(std::move(command)));
+  tracker.Done();
+
+  if (const auto *tok = response.Single()) {
+    return *tok;
+  }
+  if (const auto &value = response.Shared()) {
+    return db.NewString(*value);
+  }
+  if (const auto &compressed = response.Compressed()) {
+    auto str = db.NewString();
+    lz::Append(*compressed, str);
+    return str;
+  }
+  return Error{db.NewString("SCRIPT_ERROR Aggregate replies are not supported in scripts")};
+} catch (ExecutionException &e) {
+  return Error{db.NewString(e.what())};
+} catch (const WrongTypeError &e) {
+  return Error{db.NewString(e.what())};
 }
 
-static auto execute(DB &db, Client &cli, Command command) -> Response {
-  return std::visit([&](auto command) { return execute(db, cli, std::move(command)); }, command);
+// Keyspace commands that complete without suspending; anything else would break the atomicity of scripts.
+static const std::unordered_map<std::string_view, script::CommandFunc, utils::string_hash, std::equal_to<>>
+    ScriptFuncs = {{AppendCmd::Name, script_call<AppendCmd>},
+                   {BitCountCmd::Name, script_call<BitCountCmd>},
+                   {BitOpCmd::Name, script_call<BitOpCmd>},
+                   {BitPosCmd::Name, script_call<BitPosCmd>},
+                   {DecrCmd::Name, script_call<DecrCmd>},
+                   {DecrByCmd::Name, script_call<DecrByCmd>},
+                   {ExistsCmd::Name, script_call<ExistsCmd>},
+                   {GetCmd::Name, script_call<GetCmd>},
+                   {GetBitCmd::Name, script_call<GetBitCmd>},
+                   {GetDelCmd::Name, script_call<GetDelCmd>},
+                   {GetRangeCmd::Name, script_call<GetRangeCmd>},
+                   {GetSetCmd::Name, script_call<GetSetCmd>},
+                   {IncrCmd::Name, script_call<IncrCmd>},
+                   {IncrByCmd::Name, script_call<IncrByCmd>},
+                   {LLenCmd::Name, script_call<LLenCmd>},
+                   {LMoveCmd::Name, script_call<LMoveCmd>},
+                   {LPopCmd::Name, script_call<LPopCmd>},
+                   {LPushCmd::Name, script_call<LPushCmd>},
+                   {PfAddCmd::Name, script_call<PfAddCmd>},
+                   {PfCountCmd::Name, script_call<PfCountCmd>},
+                   {PfMergeCmd::Name, script_call<PfMergeCmd>},
+                   {RPopCmd::Name, script_call<RPopCmd>},
+                   {RPushCmd::Name, script_call<RPushCmd>},
+                   {SetBitCmd::Name, script_call<SetBitCmd>},
+                   {SetCmd::Name, script_call<SetCmd>},
+                   {StrLenCmd::Name, script_call<StrLenCmd>},
+                   {XAckCmd::Name, script_call<XAckCmd>},
+                   {XAddCmd::Name, script_call<XAddCmd>},
+                   {XLenCmd::Name, script_call<XLenCmd>},
+                   {XTrimCmd::Name, script_call<XTrimCmd>},
+                   {ZAddCmd::Name, script_call<ZAddCmd>},
+                   {ZCardCmd::Name, script_call<ZCardCmd>},
+                   {ZRankCmd::Name, script_call<ZRankCmd>},
+                   {ZRemCmd::Name, script_call<ZRemCmd>},
+                   {ZScoreCmd::Name, script_call<ZScoreCmd>}};
+
+static auto resolve_script_command(std::string_view name) -> script::CommandFunc {
+  auto it = ScriptFuncs.find(name);
+  return it == ScriptFuncs.end() ? nullptr : it->second;
 }
 
 auto Execute(DB &db, Client &client, Deserializer &query_reader) -> boost::asio::awaitable<Response> try {
   auto executor = co_await boost::asio::this_coro::executor;
-  auto ch = boost::make_local_shared<Channel>(std::move(executor));
+  auto ch = boost::make_local_shared<Channel>(executor);
+
+  // A failed read (e.g. the peer went away) must end the session instead of leaving it waiting for tokens.
+  co_spawn(executor, query_reader.SendTokens(ch), [ch](const std::exception_ptr &e) {
+    if (e) {
+      ch->close();
+    }
+  });
 
-  co_spawn(executor, query_reader.SendTokens(ch), boost::asio::detached);
+  std::vector<Token> tokens;
+  for (auto tok = co_await ch->async_receive(use_awaitable); !std::holds_alternative<EndOfCommand_t>(tok);
+       tok = co_await ch->async_receive(use_awaitable)) {
+    tokens.push_back(std::move(tok));
+  }
 
-  auto tok = co_await ch->async_receive(use_awaitable);
-  auto it = ParseFuncs.find(get_str(tok));
+  if (tokens.empty()) {
+    throw ExecutionException{"INVALID_COMMAND"};
+  }
+  auto it = ParseFuncs.find(get_str(std::move(tokens.front())));
   if (it == ParseFuncs.end()) {
     throw ExecutionException{"INVALID_COMMAND"};
   }
 
+  client.SetLastCommand(it->first);
+  tokens.erase(tokens.begin());
+  Arguments args{std::move(tokens)};
   const auto parse_func = it->second;
-  auto command = co_await parse_func(*ch);
+  auto command = parse_func(args);
 
-  if (!std::holds_alternative<EndOfCommand_t>(co_await ch->async_receive(use_awaitable))) {
+  if (!args.Empty()) {
     throw ExecutionException("EXTRA_ARGUMENTS_TO_COMMAND");
   }
 
-  co_return execute(db, client, std::move(command));
+  // RESP3 tells pushes from replies, so subscribed RESP3 clients may run any command.
+  if (const auto *pubsub = client.GetPubSub();
+      pubsub != nullptr && pubsub->Count() != 0 && client.GetProtocol() != Protocol::Resp3) {
+    if (!std::holds_alternative<SubscribeCmd>(command) && !std::holds_alternative<UnsubscribeCmd>(command) &&
+        !std::holds_alternative<PSubscribeCmd>(command) && !std::holds_alternative<PUnsubscribeCmd>(command)) {
+      throw ExecutionException{"SUBSCRIBE_MODE Only (P)SUBSCRIBE / (P)UNSUBSCRIBE are allowed in this context"};
+    }
+  }
+
+  const auto asking = client.IsAsking();
+  client.SetAsking(false);
+  if (auto err = redirect(db, command, asking)) {
+    co_return Token(std::move(*err));
+  }
+  check_migrating(db, command);
+
+  KeyTracker tracker(db, client, command);
+  auto response = co_await execute(db, client, std::move(command));
+  tracker.Done();
+  // Hands the elements pushed by the command to the clients blocked on them.
+  db.GetBlocking().ServeReady();
+  co_return response;
 } catch (ExecutionException &e) {
   co_return Error{db.NewString(e.what())};
+} catch (const WrongTypeError &e) {
+  co_return Error{db.NewString(e.what())};
 }
 }  // namespace redispp
\ No newline at end of file
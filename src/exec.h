@@ -1,20 +1,205 @@
 #pragma once
 
+#include <boost/smart_ptr/local_shared_ptr.hpp>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "list.h"
+#include "lz.h"
+#include "output_queue.h"
 #include "resp_serde.h"
+#include "stream.h"
 
 namespace redispp {
 namespace exec {
+// How a command uses its keys, e.g. reads are remembered and writes invalidated for client side caching.
+enum class Access { Read, Write };
+
 struct AppendCmd {
   resp::String key;
   resp::String val;
 
   static constexpr std::string_view Name = "APPEND";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct AskingCmd {
+  static constexpr std::string_view Name = "ASKING";
+};
+
+struct BitCountCmd {
+  resp::String key;
+  std::optional<resp::Integer> start;
+  std::optional<resp::Integer> end;
+  bool bit_range = false;  // BIT instead of BYTE offsets
+
+  static constexpr std::string_view Name = "BITCOUNT";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct BitFieldCmd {
+  enum class Overflow { Wrap, Sat, Fail };
+
+  struct Op {
+    enum class Kind { Get, Set, IncrBy };
+
+    Kind kind;
+    bool is_signed;
+    unsigned width;
+    resp::Integer offset;  // in bits
+    resp::Integer value = 0;
+    Overflow overflow = Overflow::Wrap;
+  };
+
+  resp::String key;
+  std::vector<Op> ops;
+
+  static constexpr std::string_view Name = "BITFIELD";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct BitOpCmd {
+  enum class Op { And, Or, Xor, Not };
+
+  Op op;
+  std::vector<resp::String> keys;  // The destination, then the sources
+
+  static constexpr std::string_view Name = "BITOP";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct BitPosCmd {
+  resp::String key;
+  bool bit;
+  std::optional<resp::Integer> start;
+  std::optional<resp::Integer> end;
+  bool bit_range = false;
+
+  static constexpr std::string_view Name = "BITPOS";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+// Blocks for up to `timeout` seconds, 0 meaning forever, until the source list has an element to move.
+struct BLMoveCmd {
+  std::vector<resp::String> keys;  // The source, then the destination
+  ListEnd from;
+  ListEnd to;
+  double timeout;
+
+  static constexpr std::string_view Name = "BLMOVE";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// Pops from the first non-empty list, blocking for up to `timeout` seconds (0 meaning forever) when all are empty.
+struct BLPopCmd {
+  std::vector<resp::String> keys;
+  double timeout;
+
+  static constexpr std::string_view Name = "BLPOP";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct BRPopCmd {
+  std::vector<resp::String> keys;
+  double timeout;
+
+  static constexpr std::string_view Name = "BRPOP";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// CLIENT subcommands, named by the second word of the command.
+struct ClientCmd {
+  static constexpr std::string_view Name = "CLIENT";
+};
+
+struct ClientIdCmd {
+  static constexpr std::string_view Name = "ID";
+};
+
+struct ClientKillCmd {
+  enum class Type { Normal, PubSub };
+
+  // CLIENT KILL addr: an error when no client matches.
+  std::optional<resp::String> legacy_addr;
+  // CLIENT KILL [ID id] [TYPE type] [ADDR addr] [LADDR laddr] [SKIPME yes|no]: returns the number of clients killed.
+  std::optional<resp::Integer> id;
+  std::optional<Type> type;
+  std::optional<resp::String> addr;
+  std::optional<resp::String> laddr;
+  bool skipme = true;
+
+  static constexpr std::string_view Name = "KILL";
+};
+
+struct ClientListCmd {
+  std::optional<ClientKillCmd::Type> type;
+  std::vector<resp::Integer> ids;
+
+  static constexpr std::string_view Name = "LIST";
+};
+
+struct ClientTrackingCmd {
+  bool on = false;
+  bool bcast = false;
+  bool noloop = false;
+  resp::Integer redirect = 0;
+  std::vector<resp::String> prefixes;
+
+  static constexpr std::string_view Name = "TRACKING";
+};
+
+// CLUSTER subcommands, named by the second word of the command.
+struct ClusterCmd {
+  static constexpr std::string_view Name = "CLUSTER";
+};
+
+struct ClusterCountKeysInSlotCmd {
+  resp::Integer slot;
+
+  static constexpr std::string_view Name = "COUNTKEYSINSLOT";
+};
+
+struct ClusterGetKeysInSlotCmd {
+  resp::Integer slot;
+  resp::Integer count;
+
+  static constexpr std::string_view Name = "GETKEYSINSLOT";
+};
+
+struct ClusterKeySlotCmd {
+  resp::String name;
+
+  static constexpr std::string_view Name = "KEYSLOT";
+};
+
+struct ClusterMeetCmd {
+  resp::String host;
+  resp::Integer port;
+
+  static constexpr std::string_view Name = "MEET";
+};
+
+struct ClusterNodesCmd {
+  static constexpr std::string_view Name = "NODES";
+};
+
+struct ClusterSetSlotCmd {
+  enum class State { Importing, Migrating, Node, Stable };
+
+  resp::Integer slot;
+  State state;
+  resp::String node_id;
+
+  static constexpr std::string_view Name = "SETSLOT";
 };
 
 struct DecrCmd {
   resp::String key;
 
   static constexpr std::string_view Name = "DECR";
+  static constexpr Access KeyAccess = Access::Write;
 };
 
 struct DecrByCmd {
@@ -22,18 +207,52 @@ struct DecrByCmd {
   resp::Integer val;
 
   static constexpr std::string_view Name = "DECRBY";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct EvalCmd {
+  resp::String script;
+  std::vector<resp::String> keys;
+  std::vector<resp::String> args;
+
+  static constexpr std::string_view Name = "EVAL";
+};
+
+struct EvalShaCmd {
+  resp::String sha;
+  std::vector<resp::String> keys;
+  std::vector<resp::String> args;
+
+  static constexpr std::string_view Name = "EVALSHA";
+};
+
+struct ExistsCmd {
+  std::vector<resp::String> keys;
+
+  static constexpr std::string_view Name = "EXISTS";
+  static constexpr Access KeyAccess = Access::Read;
 };
 
 struct GetCmd {
   resp::String key;
 
   static constexpr std::string_view Name = "GET";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct GetBitCmd {
+  resp::String key;
+  resp::Integer offset;
+
+  static constexpr std::string_view Name = "GETBIT";
+  static constexpr Access KeyAccess = Access::Read;
 };
 
 struct GetDelCmd {
   resp::String key;
 
   static constexpr std::string_view Name = "GETDEL";
+  static constexpr Access KeyAccess = Access::Write;
 };
 
 struct GetRangeCmd {
@@ -42,6 +261,7 @@ struct GetRangeCmd {
   resp::Integer end;
 
   static constexpr std::string_view Name = "GETRANGE";
+  static constexpr Access KeyAccess = Access::Read;
 };
 
 struct GetSetCmd {
@@ -49,12 +269,20 @@ struct GetSetCmd {
   resp::String val;
 
   static constexpr std::string_view Name = "GETSET";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct HelloCmd {
+  std::optional<resp::Integer> protover;
+
+  static constexpr std::string_view Name = "HELLO";
 };
 
 struct IncrCmd {
   resp::String key;
 
   static constexpr std::string_view Name = "INCR";
+  static constexpr Access KeyAccess = Access::Write;
 };
 
 struct IncrByCmd {
@@ -62,6 +290,137 @@ struct IncrByCmd {
   resp::Integer val;
 
   static constexpr std::string_view Name = "INCRBY";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct LLenCmd {
+  resp::String key;
+
+  static constexpr std::string_view Name = "LLEN";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct LMoveCmd {
+  std::vector<resp::String> keys;  // The source, then the destination
+  ListEnd from;
+  ListEnd to;
+
+  static constexpr std::string_view Name = "LMOVE";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct LPopCmd {
+  resp::String key;
+  std::optional<resp::Integer> count;
+
+  static constexpr std::string_view Name = "LPOP";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct LPushCmd {
+  resp::String key;
+  std::vector<resp::String> elements;
+
+  static constexpr std::string_view Name = "LPUSH";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct LRangeCmd {
+  resp::String key;
+  resp::Integer start;
+  resp::Integer stop;
+
+  static constexpr std::string_view Name = "LRANGE";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct MigrateCmd {
+  resp::String host;
+  resp::Integer port;
+  resp::String key;
+  resp::Integer db;
+  resp::Integer timeout;
+
+  static constexpr std::string_view Name = "MIGRATE";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct PfAddCmd {
+  resp::String key;
+  std::vector<resp::String> elements;
+
+  static constexpr std::string_view Name = "PFADD";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct PfCountCmd {
+  std::vector<resp::String> keys;
+
+  static constexpr std::string_view Name = "PFCOUNT";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct PfMergeCmd {
+  std::vector<resp::String> keys;  // The destination, then the sources
+
+  static constexpr std::string_view Name = "PFMERGE";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct PSubscribeCmd {
+  std::vector<resp::String> patterns;
+
+  static constexpr std::string_view Name = "PSUBSCRIBE";
+};
+
+struct PublishCmd {
+  resp::String channel;
+  resp::String message;
+
+  static constexpr std::string_view Name = "PUBLISH";
+};
+
+struct PUnsubscribeCmd {
+  std::vector<resp::String> patterns;
+
+  static constexpr std::string_view Name = "PUNSUBSCRIBE";
+};
+
+struct RPopCmd {
+  resp::String key;
+  std::optional<resp::Integer> count;
+
+  static constexpr std::string_view Name = "RPOP";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct RPushCmd {
+  resp::String key;
+  std::vector<resp::String> elements;
+
+  static constexpr std::string_view Name = "RPUSH";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// SCRIPT subcommands, named by the second word of the command.
+struct ScriptCmd {
+  static constexpr std::string_view Name = "SCRIPT";
+};
+
+struct ScriptExistsCmd {
+  std::vector<resp::String> shas;
+
+  static constexpr std::string_view Name = "EXISTS";
+};
+
+struct ScriptFlushCmd {
+  static constexpr std::string_view Name = "FLUSH";
+};
+
+struct ScriptLoadCmd {
+  resp::String script;
+
+  static constexpr std::string_view Name = "LOAD";
 };
 
 struct SetCmd {
@@ -69,42 +428,363 @@ struct SetCmd {
   resp::String val;
 
   static constexpr std::string_view Name = "SET";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct SetBitCmd {
+  resp::String key;
+  resp::Integer offset;
+  bool value;
+
+  static constexpr std::string_view Name = "SETBIT";
+  static constexpr Access KeyAccess = Access::Write;
 };
 
 struct StrLenCmd {
   resp::String key;
 
   static constexpr std::string_view Name = "STRLEN";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct SubscribeCmd {
+  std::vector<resp::String> channels;
+
+  static constexpr std::string_view Name = "SUBSCRIBE";
+};
+
+struct UnsubscribeCmd {
+  std::vector<resp::String> channels;
+
+  static constexpr std::string_view Name = "UNSUBSCRIBE";
+};
+
+struct XAckCmd {
+  resp::String key;
+  resp::String group;
+  std::vector<stream::ID> ids;
+
+  static constexpr std::string_view Name = "XACK";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// MAXLEN or MINID trimming of XADD and XTRIM. `~` makes it approximate.
+struct StreamTrim {
+  enum class Strategy { MaxLen, MinId };
+
+  Strategy strategy;
+  bool approx = false;
+  uint64_t maxlen = 0;
+  stream::ID minid;
+};
+
+struct XAddCmd {
+  resp::String key;
+  bool nomkstream = false;
+  std::optional<StreamTrim> trim;
+  // `*` leaves both parts out, `<ms>-*` the sequence number.
+  std::optional<uint64_t> ms;
+  std::optional<uint64_t> seq;
+  std::vector<resp::String> fields;  // Names and values alternately
+
+  static constexpr std::string_view Name = "XADD";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// XGROUP subcommands, named by the second word of the command.
+struct XGroupCmd {
+  static constexpr std::string_view Name = "XGROUP";
+};
+
+struct XGroupCreateCmd {
+  resp::String key;
+  resp::String group;
+  std::optional<stream::ID> id;  // `$`, the last ID of the stream, when empty
+  bool mkstream = false;
+
+  static constexpr std::string_view Name = "CREATE";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct XGroupDestroyCmd {
+  resp::String key;
+  resp::String group;
+
+  static constexpr std::string_view Name = "DESTROY";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct XLenCmd {
+  resp::String key;
+
+  static constexpr std::string_view Name = "XLEN";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+// Exclusive bounds, `(<id>`, are converted to the next or previous ID.
+struct XRangeCmd {
+  resp::String key;
+  stream::ID start;
+  stream::ID end;
+  std::optional<resp::Integer> count;
+
+  static constexpr std::string_view Name = "XRANGE";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+// Reads the entries following `ids`, one per key. BLOCK waits up to `block` ms, 0 meaning forever, for new entries.
+struct XReadCmd {
+  std::vector<resp::String> keys;
+  std::vector<std::optional<stream::ID>> ids;  // `$`, only entries added from now on, when empty
+  std::optional<resp::Integer> count;
+  std::optional<resp::Integer> block;
+
+  static constexpr std::string_view Name = "XREAD";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+// Reads new entries for the consumer, or with an ID, the entries it has pending after that ID.
+struct XReadGroupCmd {
+  resp::String group;
+  resp::String consumer;
+  std::vector<resp::String> keys;
+  std::vector<std::optional<stream::ID>> ids;  // `>`, entries never delivered to the group, when empty
+  std::optional<resp::Integer> count;
+  std::optional<resp::Integer> block;
+  bool noack = false;
+
+  static constexpr std::string_view Name = "XREADGROUP";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct XTrimCmd {
+  resp::String key;
+  StreamTrim trim;
+
+  static constexpr std::string_view Name = "XTRIM";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// NX and XX only add new members, respectively update existing ones. GT and LT only update scores upwards,
+// respectively downwards. CH counts the updated members along with the added ones, and INCR adds to the member's score
+// like ZINCRBY, replying with the new score.
+struct ZAddCmd {
+  resp::String key;
+  bool nx = false;
+  bool xx = false;
+  bool gt = false;
+  bool lt = false;
+  bool ch = false;
+  bool incr = false;
+  std::vector<std::pair<double, resp::String>> elements;  // Scores and members
+
+  static constexpr std::string_view Name = "ZADD";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+struct ZCardCmd {
+  resp::String key;
+
+  static constexpr std::string_view Name = "ZCARD";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+// Ranks, with negative ones counting from the end, like LRANGE.
+struct ZRangeCmd {
+  resp::String key;
+  resp::Integer start;
+  resp::Integer stop;
+  bool withscores = false;
+
+  static constexpr std::string_view Name = "ZRANGE";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+// A bound of ZRANGEBYSCORE: `(<score>` is exclusive, `-inf` and `+inf` leave the range open.
+struct ScoreBound {
+  double score;
+  bool exclusive = false;
+};
+
+struct ZRangeByScoreCmd {
+  resp::String key;
+  ScoreBound min;
+  ScoreBound max;
+  bool withscores = false;
+  resp::Integer offset = 0;
+  std::optional<resp::Integer> count;  // All the elements after `offset` when empty or negative
+
+  static constexpr std::string_view Name = "ZRANGEBYSCORE";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct ZRankCmd {
+  resp::String key;
+  resp::String member;
+
+  static constexpr std::string_view Name = "ZRANK";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct ZRemCmd {
+  resp::String key;
+  std::vector<resp::String> members;
+
+  static constexpr std::string_view Name = "ZREM";
+  static constexpr Access KeyAccess = Access::Write;
+};
+
+// Ranks from the highest score.
+struct ZRevRangeCmd {
+  resp::String key;
+  resp::Integer start;
+  resp::Integer stop;
+  bool withscores = false;
+
+  static constexpr std::string_view Name = "ZREVRANGE";
+  static constexpr Access KeyAccess = Access::Read;
+};
+
+struct ZScoreCmd {
+  resp::String key;
+  resp::String member;
+
+  static constexpr std::string_view Name = "ZSCORE";
+  static constexpr Access KeyAccess = Access::Read;
 };
 
 using Command = std::variant<AppendCmd,
+                             AskingCmd,
+                             BitCountCmd,
+                             BitFieldCmd,
+                             BitOpCmd,
+                             BitPosCmd,
+                             BLMoveCmd,
+                             BLPopCmd,
+                             BRPopCmd,
+                             ClientIdCmd,
+                             ClientKillCmd,
+                             ClientListCmd,
+                             ClientTrackingCmd,
+                             ClusterCountKeysInSlotCmd,
+                             ClusterGetKeysInSlotCmd,
+                             ClusterKeySlotCmd,
+                             ClusterMeetCmd,
+                             ClusterNodesCmd,
+                             ClusterSetSlotCmd,
                              DecrCmd,
                              DecrByCmd,
+                             EvalCmd,
+                             EvalShaCmd,
+                             ExistsCmd,
                              GetCmd,
+                             GetBitCmd,
                              GetDelCmd,
                              GetRangeCmd,
                              GetSetCmd,
+                             HelloCmd,
                              IncrCmd,
                              IncrByCmd,
+                             LLenCmd,
+                             LMoveCmd,
+                             LPopCmd,
+                             LPushCmd,
+                             LRangeCmd,
+                             MigrateCmd,
+                             PfAddCmd,
+                             PfCountCmd,
+                             PfMergeCmd,
+                             PSubscribeCmd,
+                             PublishCmd,
+                             PUnsubscribeCmd,
+                             RPopCmd,
+                             RPushCmd,
+                             ScriptExistsCmd,
+                             ScriptFlushCmd,
+                             ScriptLoadCmd,
+                             SetBitCmd,
                              SetCmd,
-                             StrLenCmd>;
+                             StrLenCmd,
+                             SubscribeCmd,
+                             UnsubscribeCmd,
+                             XAckCmd,
+                             XAddCmd,
+                             XGroupCreateCmd,
+                             XGroupDestroyCmd,
+                             XLenCmd,
+                             XRangeCmd,
+                             XReadCmd,
+                             XReadGroupCmd,
+                             XTrimCmd,
+                             ZAddCmd,
+                             ZCardCmd,
+                             ZRangeCmd,
+                             ZRangeByScoreCmd,
+                             ZRankCmd,
+                             ZRemCmd,
+                             ZRevRangeCmd,
+                             ZScoreCmd>;
 }  // namespace exec
 
 class DB;
 class Client;
 
+// A value that stays readable while it's being sent, even if its key is modified or deleted in the meantime.
+using SharedValue = boost::local_shared_ptr<const resp::String>;
+// A compressed string value, which stays readable the same way.
+using SharedCompressed = boost::local_shared_ptr<const lz::Compressed>;
+
 class Response {
  public:
-  explicit Response(bool is_array = false) : m_is_array(is_array) {}
+  Response() = default;
+
+  // `aggregate` is one of Array, Map, Set or Push. Maps hold their keys and values alternately.
+  explicit Response(resp::TokenTypeMarker aggregate) : m_aggregate(aggregate) {}
 
   Response(resp::Token tok) { m_tokens.push_back(std::move(tok)); }  // NOLINT(hicpp-explicit-conversions)
 
+  // A bulk string written straight from the value's buffer.
+  explicit Response(SharedValue value) : m_value(std::move(value)) {}
+  // A bulk string decompressed straight into the output buffer.
+  explicit Response(SharedCompressed value) : m_compressed(std::move(value)) {}
+
   void Push(resp::Token tok);
+  // Opens a nested aggregate of `size` elements, the next ones pushed. Nested aggregates count as one element of their
+  // parent, map sizes count keys and values. The size can be set once the elements are pushed, through the handle.
+  auto PushAggregate(resp::TokenTypeMarker aggregate, size_t size = 0) -> size_t;
+  void SetAggregateSize(size_t handle, size_t size) noexcept;
   auto Serialize(resp::Serializer &resp_sender) const -> boost::asio::awaitable<void>;
+  void Encode(std::string &buf, resp::Protocol proto) const;
+  // Queues the reply; shared values are referenced rather than copied, compressed ones are decompressed into the
+  // queue's buffer.
+  void Write(OutputQueue &output, resp::Protocol proto) const;
+
+  [[nodiscard]] auto Empty() const noexcept -> bool {
+    return !m_aggregate && m_tokens.empty() && m_nested.empty() && !m_value && !m_compressed;
+  }
+
+  // The reply token unless the response is an aggregate, a shared or a compressed value, e.g. for commands called by scripts.
+  [[nodiscard]] auto Single() const noexcept -> const resp::Token * {
+    return !m_aggregate && m_tokens.size() == 1 && m_nested.empty() ? &m_tokens.front() : nullptr;
+  }
+  [[nodiscard]] auto Shared() const noexcept -> const SharedValue & { return m_value; }
+  [[nodiscard]] auto Compressed() const noexcept -> const SharedCompressed & { return m_compressed; }
 
  private:
+  // The header of a nested aggregate, written before the token at `pos`.
+  struct Nested {
+    size_t pos;
+    resp::TokenTypeMarker aggregate;
+    size_t size;
+  };
+
+  [[nodiscard]] auto elem_count() const noexcept -> size_t;
+
   std::vector<resp::Token> m_tokens;
-  bool m_is_array = false;
+  std::vector<Nested> m_nested;
+  std::optional<resp::TokenTypeMarker> m_aggregate;
+  SharedValue m_value;
+  SharedCompressed m_compressed;
 };
 
 auto Execute(DB &db, Client &client, resp::Deserializer &query_reader) -> boost::asio::awaitable<Response>;
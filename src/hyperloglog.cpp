@@ -0,0 +1,483 @@
+#include "hyperloglog.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+
+#include "cpu_features.h"
+
+#if defined(REDISPP_X86)
+#include <immintrin.h>
+#endif
+
+namespace redispp::hll {
+static constexpr std::string_view Magic = "HYLL";
+static constexpr size_t EncodingPos = 4;
+static constexpr size_t CardinalityPos = 8;
+static constexpr char Dense = 0;
+static constexpr char Sparse = 1;
+
+// Bits of the hash left to count the run of zeros in, after the register index.
+static constexpr size_t Q = 64 - Precision;
+static constexpr size_t DenseBytes = DenseSize - HeaderSize;
+static constexpr uint8_t SparseMaxValue = 32;
+
+static constexpr unsigned char SparseXZeroBit = 0x40;
+static constexpr unsigned char SparseValBit = 0x80;
+static constexpr size_t SparseZeroMaxRun = 64;
+static constexpr size_t SparseXZeroMaxRun = 16384;
+static constexpr size_t SparseValMaxRun = 4;
+
+// MurmurHash64A with Redis' seed, so that the registers match the ones Redis computes.
+static auto murmur_hash64a(std::string_view key) noexcept -> uint64_t {
+  static constexpr uint64_t M = 0xc6a4a7935bd1e995;
+  static constexpr int R = 47;
+  static constexpr uint64_t Seed = 0xadc83b19;
+
+  const auto *data = reinterpret_cast<const unsigned char *>(key.data());
+  const auto len = key.size();
+  uint64_t h = Seed ^ (len * M);
+
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t k = 0;
+    std::memcpy(&k, data + i, sizeof(k));
+    if constexpr (std::endian::native == std::endian::big) {
+      k = __builtin_bswap64(k);
+    }
+    k *= M;
+    k ^= k >> R;
+    k *= M;
+    h ^= k;
+    h *= M;
+  }
+
+  if (const auto rest = len - i; rest != 0) {
+    for (size_t j = rest; j-- > 0;) {
+      h ^= uint64_t{data[i + j]} << (j * 8);
+    }
+    h *= M;
+  }
+
+  h ^= h >> R;
+  h *= M;
+  h ^= h >> R;
+  return h;
+}
+
+struct Register {
+  size_t index;
+  uint8_t count;  // Position of the first set bit after the index bits, starting at 1
+};
+
+static auto register_of(std::string_view element) noexcept -> Register {
+  auto hash = murmur_hash64a(element);
+  const auto index = hash & (Registers - 1);
+  hash >>= Precision;
+  hash |= uint64_t{1} << Q;
+  return {index, static_cast<uint8_t>(std::countr_zero(hash) + 1)};
+}
+
+// Sparse opcodes: ZERO 00xxxxxx and XZERO 01xxxxxx xxxxxxxx are runs of empty registers, VAL 1vvvvvxx is a run of up
+// to 4 registers with the value v + 1.
+struct SparseOp {
+  uint8_t value;
+  size_t run;
+  size_t bytes;
+};
+
+static auto decode_op(std::string_view hll, size_t pos) noexcept -> SparseOp {
+  const auto byte = static_cast<unsigned char>(hll[pos]);
+  if ((byte & SparseValBit) != 0) {
+    return {static_cast<uint8_t>(((byte >> 2) & 0x1f) + 1), size_t(byte & 0x3) + 1, 1};
+  }
+  if ((byte & SparseXZeroBit) != 0) {
+    if (pos + 1 == hll.size()) {
+      return {0, 0, 0};
+    }
+    return {0, ((size_t(byte & 0x3f) << 8) | static_cast<unsigned char>(hll[pos + 1])) + 1, 2};
+  }
+  return {0, size_t(byte & 0x3f) + 1, 1};
+}
+
+static void encode_run(std::string &buf, uint8_t value, size_t run) {
+  while (run != 0) {
+    if (value != 0) {
+      const auto len = std::min(run, SparseValMaxRun);
+      buf.push_back(static_cast<char>(SparseValBit | ((value - 1) << 2) | (len - 1)));
+      run -= len;
+    } else if (run <= SparseZeroMaxRun) {
+      buf.push_back(static_cast<char>(run - 1));
+      run = 0;
+    } else {
+      const auto len = std::min(run, SparseXZeroMaxRun);
+      buf.push_back(static_cast<char>(SparseXZeroBit | ((len - 1) >> 8)));
+      buf.push_back(static_cast<char>((len - 1) & 0xff));
+      run -= len;
+    }
+  }
+}
+
+template <typename Func>
+static void for_each_run(std::string_view hll, Func &&func) noexcept {
+  size_t first = 0;
+  for (size_t pos = HeaderSize; pos < hll.size();) {
+    const auto op = decode_op(hll, pos);
+    func(first, op.value, op.run);
+    first += op.run;
+    pos += op.bytes;
+  }
+}
+
+static auto dense_get(const char *regs, size_t index) noexcept -> uint8_t {
+  const auto bit = index * 6;
+  const auto byte = bit / 8;
+  const auto shift = bit % 8;
+  unsigned value = static_cast<unsigned char>(regs[byte]) >> shift;
+  if (shift > 2) {
+    value |= unsigned(static_cast<unsigned char>(regs[byte + 1])) << (8 - shift);
+  }
+  return static_cast<uint8_t>(value & 0x3f);
+}
+
+static void dense_set(char *regs, size_t index, uint8_t value) noexcept {
+  const auto bit = index * 6;
+  const auto byte = bit / 8;
+  const auto shift = bit % 8;
+  regs[byte] = static_cast<char>((static_cast<unsigned char>(regs[byte]) & ~(0x3f << shift)) | (value << shift));
+  if (shift > 2) {
+    const auto high = 8 - shift;
+    regs[byte + 1] =
+        static_cast<char>((static_cast<unsigned char>(regs[byte + 1]) & ~(0x3f >> high)) | (value >> high));
+  }
+}
+
+// Every 3 bytes hold 4 registers, least significant bits first.
+static void unpack_scalar(const unsigned char *p, uint8_t *raw, size_t groups) noexcept {
+  for (size_t g = 0; g < groups; g++, p += 3, raw += 4) {
+    const uint32_t v = p[0] | (uint32_t{p[1]} << 8) | (uint32_t{p[2]} << 16);
+    raw[0] = v & 0x3f;
+    raw[1] = (v >> 6) & 0x3f;
+    raw[2] = (v >> 12) & 0x3f;
+    raw[3] = (v >> 18) & 0x3f;
+  }
+}
+
+static void pack_scalar(const uint8_t *raw, unsigned char *p, size_t groups) noexcept {
+  for (size_t g = 0; g < groups; g++, p += 3, raw += 4) {
+    const uint32_t v = raw[0] | (uint32_t{raw[1]} << 6) | (uint32_t{raw[2]} << 12) | (uint32_t{raw[3]} << 18);
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+  }
+}
+
+static void max_scalar(uint8_t *raw, const uint8_t *other, size_t len) noexcept {
+  for (size_t i = 0; i < len; i++) {
+    raw[i] = std::max(raw[i], other[i]);
+  }
+}
+
+#if defined(REDISPP_X86)
+// 24 bytes become 32 registers: each 128 bit lane spreads 12 bytes to 4 dwords, whose 24 bits are split into bytes.
+// The last block is left to the scalar code, since loading its high lane would read past the registers.
+[[gnu::target("avx2")]] static auto unpack_avx2(const unsigned char *p, uint8_t *raw) noexcept -> size_t {
+  const auto spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1,
+                                       6, 7, 8, -1, 9, 10, 11, -1);
+  const auto mask = _mm256_set1_epi32(0x3f);
+
+  size_t i = 0;
+  for (; i + 28 <= DenseBytes; i += 24, raw += 32) {
+    const auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    const auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 12));
+    const auto v = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+
+    auto regs = _mm256_and_si256(v, mask);
+    regs = _mm256_or_si256(regs, _mm256_and_si256(_mm256_slli_epi32(v, 2), _mm256_slli_epi32(mask, 8)));
+    regs = _mm256_or_si256(regs, _mm256_and_si256(_mm256_slli_epi32(v, 4), _mm256_slli_epi32(mask, 16)));
+    regs = _mm256_or_si256(regs, _mm256_and_si256(_mm256_slli_epi32(v, 6), _mm256_slli_epi32(mask, 24)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(raw), regs);
+  }
+  return i;
+}
+
+// The inverse of unpack_avx2. Each lane store writes 4 bytes past its 12, which the next store overwrites.
+[[gnu::target("avx2")]] static auto pack_avx2(const uint8_t *raw, unsigned char *p) noexcept -> size_t {
+  const auto compact = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9,
+                                        10, 12, 13, 14, -1, -1, -1, -1);
+  const auto mask = _mm256_set1_epi32(0x3f);
+
+  size_t i = 0;
+  for (; i + 28 <= DenseBytes; i += 24, raw += 32) {
+    const auto regs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw));
+
+    auto v = _mm256_and_si256(regs, mask);
+    v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(regs, 2), _mm256_slli_epi32(mask, 6)));
+    v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(regs, 4), _mm256_slli_epi32(mask, 12)));
+    v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(regs, 6), _mm256_slli_epi32(mask, 18)));
+    v = _mm256_shuffle_epi8(v, compact);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i), _mm256_castsi256_si128(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i + 12), _mm256_extracti128_si256(v, 1));
+  }
+  return i;
+}
+
+[[gnu::target("avx2")]] static void max_avx2(uint8_t *raw, const uint8_t *other) noexcept {
+  for (size_t i = 0; i < Registers; i += sizeof(__m256i)) {
+    const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw + i));
+    const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(other + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(raw + i), _mm256_max_epu8(a, b));
+  }
+}
+#endif
+
+static void unpack(const char *regs, RawRegisters &raw) noexcept {
+  const auto *p = reinterpret_cast<const unsigned char *>(regs);
+  size_t done = 0;
+#if defined(REDISPP_X86)
+  if (utils::HasAvx2()) {
+    done = unpack_avx2(p, raw.data());
+  }
+#endif
+  unpack_scalar(p + done, raw.data() + done / 3 * 4, (DenseBytes - done) / 3);
+}
+
+static void pack(const RawRegisters &raw, char *regs) noexcept {
+  auto *p = reinterpret_cast<unsigned char *>(regs);
+  size_t done = 0;
+#if defined(REDISPP_X86)
+  if (utils::HasAvx2()) {
+    done = pack_avx2(raw.data(), p);
+  }
+#endif
+  pack_scalar(raw.data() + done / 3 * 4, p + done, (DenseBytes - done) / 3);
+}
+
+static void merge_max(RawRegisters &raw, const RawRegisters &other) noexcept {
+#if defined(REDISPP_X86)
+  if (utils::HasAvx2()) {
+    max_avx2(raw.data(), other.data());
+    return;
+  }
+#endif
+  max_scalar(raw.data(), other.data(), Registers);
+}
+
+static auto is_dense(std::string_view hll) noexcept -> bool { return hll[EncodingPos] == Dense; }
+
+static void invalidate_cache(std::pmr::string &hll) noexcept {
+  hll[CardinalityPos + 7] = static_cast<char>(hll[CardinalityPos + 7] | 0x80);
+}
+
+void Init(std::pmr::string &hll) {
+  hll.assign(HeaderSize, '\0');
+  hll.replace(0, Magic.size(), Magic);
+  hll[EncodingPos] = Sparse;
+
+  std::string ops;
+  encode_run(ops, 0, Registers);
+  hll += ops;
+}
+
+auto IsValid(std::string_view hll) noexcept -> bool {
+  if (hll.size() < HeaderSize || !hll.starts_with(Magic)) {
+    return false;
+  }
+  if (is_dense(hll)) {
+    return hll.size() == DenseSize;
+  }
+  if (hll[EncodingPos] != Sparse) {
+    return false;
+  }
+
+  size_t registers = 0;
+  for (size_t pos = HeaderSize; pos < hll.size();) {
+    const auto op = decode_op(hll, pos);
+    if (op.bytes == 0) {
+      return false;
+    }
+    registers += op.run;
+    pos += op.bytes;
+  }
+  return registers == Registers;
+}
+
+static void promote(std::pmr::string &hll) {
+  RawRegisters raw{};
+  Merge(raw, hll);
+  StoreDense(hll, raw);
+}
+
+// Splits the run holding the register into up to 3 runs. Fails when the value needs a dense register.
+static auto sparse_set(std::pmr::string &hll, Register reg) -> std::optional<bool> {
+  size_t first = 0;
+  size_t pos = HeaderSize;
+  SparseOp op{};
+  for (; pos < hll.size(); pos += op.bytes) {
+    op = decode_op(hll, pos);
+    if (reg.index < first + op.run) {
+      break;
+    }
+    first += op.run;
+  }
+
+  if (op.value >= reg.count) {
+    return false;
+  }
+  if (reg.count > SparseMaxValue) {
+    return {};
+  }
+
+  std::string ops;
+  encode_run(ops, op.value, reg.index - first);
+  encode_run(ops, reg.count, 1);
+  encode_run(ops, op.value, first + op.run - reg.index - 1);
+  hll.replace(pos, op.bytes, ops);
+  return true;
+}
+
+auto Add(std::pmr::string &hll, std::string_view element) -> bool {
+  const auto reg = register_of(element);
+
+  if (!is_dense(hll)) {
+    auto changed = sparse_set(hll, reg);
+    if (changed && hll.size() <= SparseMaxBytes) {
+      if (*changed) {
+        invalidate_cache(hll);
+      }
+      return *changed;
+    }
+    promote(hll);
+    if (changed) {
+      return true;
+    }
+  }
+
+  auto *regs = hll.data() + HeaderSize;
+  if (dense_get(regs, reg.index) >= reg.count) {
+    return false;
+  }
+  dense_set(regs, reg.index, reg.count);
+  invalidate_cache(hll);
+  return true;
+}
+
+void Merge(RawRegisters &raw, std::string_view hll) noexcept {
+  if (is_dense(hll)) {
+    RawRegisters other;
+    unpack(hll.data() + HeaderSize, other);
+    merge_max(raw, other);
+    return;
+  }
+
+  for_each_run(hll, [&](size_t first, uint8_t value, size_t run) {
+    if (value == 0) {
+      return;
+    }
+    for (size_t i = first; i < first + run && i < Registers; i++) {
+      raw[i] = std::max(raw[i], value);
+    }
+  });
+}
+
+// Ertl, "New cardinality estimation algorithms for HyperLogLog sketches", as in Redis.
+static auto sigma(double x) noexcept -> double {
+  if (x == 1.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double prev = 0;
+  double y = 1;
+  double z = x;
+  do {
+    x *= x;
+    prev = z;
+    z += x * y;
+    y += y;
+  } while (prev != z);
+  return z;
+}
+
+static auto tau(double x) noexcept -> double {
+  if (x == 0.0 || x == 1.0) {
+    return 0.0;
+  }
+  double prev = 0;
+  double y = 1.0;
+  double z = 1 - x;
+  do {
+    x = std::sqrt(x);
+    prev = z;
+    y *= 0.5;
+    z -= std::pow(1 - x, 2) * y;
+  } while (prev != z);
+  return z / 3;
+}
+
+static auto estimate(const std::array<uint32_t, 64> &histogram) noexcept -> uint64_t {
+  static constexpr double AlphaInf = 0.721347520444481703680;
+  constexpr auto m = static_cast<double>(Registers);
+
+  double z = m * tau((m - histogram[Q + 1]) / m);
+  for (size_t j = Q; j >= 1; j--) {
+    z += histogram[j];
+    z *= 0.5;
+  }
+  z += m * sigma(histogram[0] / m);
+  return static_cast<uint64_t>(std::llround(AlphaInf * m * m / z));
+}
+
+auto Estimate(const RawRegisters &raw) noexcept -> uint64_t {
+  // Separate tables break the dependency between consecutive increments of the same counter.
+  std::array<std::array<uint32_t, 64>, 4> tables{};
+  for (size_t i = 0; i < Registers; i += 4) {
+    tables[0][raw[i]]++;
+    tables[1][raw[i + 1]]++;
+    tables[2][raw[i + 2]]++;
+    tables[3][raw[i + 3]]++;
+  }
+
+  std::array<uint32_t, 64> histogram{};
+  for (size_t j = 0; j < histogram.size(); j++) {
+    histogram[j] = tables[0][j] + tables[1][j] + tables[2][j] + tables[3][j];
+  }
+  return estimate(histogram);
+}
+
+auto Count(std::pmr::string &hll) -> uint64_t {
+  auto *cache = reinterpret_cast<unsigned char *>(hll.data() + CardinalityPos);
+  if ((cache[7] & 0x80) == 0) {
+    uint64_t card = 0;
+    for (size_t i = 0; i < 8; i++) {
+      card |= uint64_t{cache[i]} << (i * 8);
+    }
+    return card;
+  }
+
+  uint64_t card = 0;
+  if (is_dense(hll)) {
+    RawRegisters raw;
+    unpack(hll.data() + HeaderSize, raw);
+    card = Estimate(raw);
+  } else {
+    std::array<uint32_t, 64> histogram{};
+    for_each_run(hll, [&](size_t /*first*/, uint8_t value, size_t run) { histogram[value] += run; });
+    card = estimate(histogram);
+  }
+
+  for (size_t i = 0; i < 8; i++) {
+    cache[i] = static_cast<unsigned char>(card >> (i * 8));
+  }
+  return card;
+}
+
+void StoreDense(std::pmr::string &hll, const RawRegisters &raw) {
+  hll.assign(DenseSize, '\0');
+  hll.replace(0, Magic.size(), Magic);
+  hll[EncodingPos] = Dense;
+  invalidate_cache(hll);
+  pack(raw, hll.data() + HeaderSize);
+}
+}  // namespace redispp::hll
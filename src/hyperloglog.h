@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+// HyperLogLog strings in the Redis format: a 16 byte header holding the cached cardinality, then either the sparse
+// run-length encoding or the 16384 dense 6 bit registers (12 KB).
+namespace redispp::hll {
+static constexpr size_t Precision = 14;
+static constexpr size_t Registers = size_t{1} << Precision;
+static constexpr size_t HeaderSize = 16;
+static constexpr size_t DenseSize = HeaderSize + Registers * 6 / 8;
+// Sparse strings are promoted to dense past this size, as updates get slower than the memory saved is worth.
+static constexpr size_t SparseMaxBytes = 3000;
+
+// One register per byte, the form registers are merged and counted in.
+using RawRegisters = std::array<uint8_t, Registers>;
+
+// An empty, sparse HyperLogLog.
+void Init(std::pmr::string &hll);
+
+[[nodiscard]] auto IsValid(std::string_view hll) noexcept -> bool;
+
+// Returns whether a register changed, which invalidates the cached cardinality.
+auto Add(std::pmr::string &hll, std::string_view element) -> bool;
+
+// Uses the cached cardinality when it's valid and updates it otherwise.
+auto Count(std::pmr::string &hll) -> uint64_t;
+
+// raw = max(raw, registers of hll)
+void Merge(RawRegisters &raw, std::string_view hll) noexcept;
+
+[[nodiscard]] auto Estimate(const RawRegisters &raw) noexcept -> uint64_t;
+
+// Replaces `hll` with a dense HyperLogLog of the registers.
+void StoreDense(std::pmr::string &hll, const RawRegisters &raw);
+}  // namespace redispp::hll
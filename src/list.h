@@ -0,0 +1,33 @@
+#pragma once
+
+#include <deque>
+#include <memory_resource>
+#include <string>
+#include <utility>
+
+namespace redispp {
+// A list value, from its head (LEFT) to its tail (RIGHT). Keys never hold empty lists.
+using List = std::pmr::deque<std::pmr::string>;
+
+enum class ListEnd { Left, Right };
+
+inline void PushElement(List &list, ListEnd end, std::pmr::string element) {
+  if (end == ListEnd::Left) {
+    list.push_front(std::move(element));
+  } else {
+    list.push_back(std::move(element));
+  }
+}
+
+// `list` must not be empty.
+inline auto PopElement(List &list, ListEnd end) -> std::pmr::string {
+  if (end == ListEnd::Left) {
+    auto element = std::move(list.front());
+    list.pop_front();
+    return element;
+  }
+  auto element = std::move(list.back());
+  list.pop_back();
+  return element;
+}
+}  // namespace redispp
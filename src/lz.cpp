@@ -0,0 +1,130 @@
+#include "lz.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace redispp::lz {
+static constexpr size_t MinMatch = 4;
+static constexpr size_t MaxOffset = 0xffff;
+static constexpr unsigned HashBits = 12;
+// Length nibbles of the sequence token; longer lengths continue in bytes of 255 and a last byte below it.
+static constexpr size_t RunMask = 0xf;
+
+static auto load32(const char *ptr) noexcept -> uint32_t {
+  uint32_t val = 0;
+  std::memcpy(&val, ptr, sizeof(val));
+  return val;
+}
+
+static auto hash(uint32_t seq) noexcept -> size_t { return (seq * 2654435761U) >> (32 - HashBits); }
+
+static void write_length(std::pmr::string &dst, size_t len) {
+  for (; len >= 0xff; len -= 0xff) {
+    dst += static_cast<char>(0xff);
+  }
+  dst += static_cast<char>(len);
+}
+
+// A sequence without a match ends the data.
+static void write_sequence(std::pmr::string &dst, std::string_view literals, size_t offset, size_t match) {
+  const auto lit_nibble = std::min(literals.size(), RunMask);
+  const auto match_nibble = match != 0 ? std::min(match - MinMatch, RunMask) : 0;
+  dst += static_cast<char>(lit_nibble << 4 | match_nibble);
+  if (lit_nibble == RunMask) {
+    write_length(dst, literals.size() - RunMask);
+  }
+  dst += literals;
+  if (match == 0) {
+    return;
+  }
+  dst += static_cast<char>(offset & 0xff);
+  dst += static_cast<char>(offset >> 8);
+  if (match_nibble == RunMask) {
+    write_length(dst, match - MinMatch - RunMask);
+  }
+}
+
+auto Compress(std::string_view src, size_t max_size, std::pmr::string &dst) -> bool {
+  // Positions of the last 4 byte sequences seen, by hash; they're checked against the data, so collisions are fine.
+  std::array<uint32_t, size_t{1} << HashBits> table{};
+  const auto start = dst.size();
+  max_size += start;
+  size_t anchor = 0;
+  size_t pos = 0;
+
+  while (pos + MinMatch <= src.size()) {
+    const auto seq = load32(src.data() + pos);
+    auto &slot = table[hash(seq)];
+    const size_t candidate = slot;
+    slot = static_cast<uint32_t>(pos);
+    if (candidate >= pos || pos - candidate > MaxOffset || load32(src.data() + candidate) != seq) {
+      // Skips ahead faster and faster through data that doesn't compress.
+      pos += 1 + ((pos - anchor) >> 6);
+      continue;
+    }
+
+    auto match = MinMatch;
+    while (pos + match < src.size() && src[candidate + match] == src[pos + match]) {
+      match++;
+    }
+    write_sequence(dst, src.substr(anchor, pos - anchor), pos - candidate, match);
+    if (dst.size() >= max_size) {
+      return false;
+    }
+    pos += match;
+    anchor = pos;
+  }
+
+  write_sequence(dst, src.substr(anchor), 0, 0);
+  return dst.size() < max_size;
+}
+
+static auto read_length(const uint8_t *&in) noexcept -> size_t {
+  size_t len = 0;
+  uint8_t byte = 0;
+  do {
+    byte = *in++;
+    len += byte;
+  } while (byte == 0xff);
+  return len;
+}
+
+void Decompress(std::string_view src, char *dst, size_t size) noexcept {
+  const auto *in = reinterpret_cast<const uint8_t *>(src.data());
+  const auto *end = in + src.size();
+  size_t out = 0;
+
+  while (out < size && in < end) {
+    const auto token = *in++;
+    size_t literals = token >> 4;
+    if (literals == RunMask) {
+      literals += read_length(in);
+    }
+    std::memcpy(dst + out, in, std::min(literals, size - out));
+    out += std::min(literals, size - out);
+    in += literals;
+    if (out == size || in == end) {
+      return;
+    }
+
+    const size_t offset = in[0] | size_t{in[1]} << 8;
+    in += 2;
+    size_t match = (token & RunMask) + MinMatch;
+    if ((token & RunMask) == RunMask) {
+      match += read_length(in);
+    }
+    match = std::min(match, size - out);
+    if (offset >= match) {
+      std::memcpy(dst + out, dst + out - offset, match);
+    } else {
+      // Overlapping: the match repeats the last `offset` bytes.
+      for (size_t i = 0; i < match; i++) {
+        dst[out + i] = dst[out + i - offset];
+      }
+    }
+    out += match;
+  }
+}
+}  // namespace redispp::lz
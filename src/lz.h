@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+namespace redispp::lz {
+// LZ77 compression in the LZ4 block format: sequences of literals followed by a match, an offset back into the
+// output and a length. It's fast enough to run inline with SET, and decoding is sequential, so a prefix of the data
+// can be decoded without the rest.
+
+// A compressed string and its original length.
+struct Compressed {
+  std::pmr::string data;
+  size_t size = 0;
+};
+
+// Appends the compressed `src` to `dst`. Gives up, returning false, once the output reaches `max_size` bytes.
+auto Compress(std::string_view src, size_t max_size, std::pmr::string &dst) -> bool;
+
+// Decompresses the first `size` bytes of the original string, `size` not more than its length, into `dst`.
+void Decompress(std::string_view src, char *dst, size_t size) noexcept;
+
+// Decompresses the whole string at the end of `buf`, e.g. an output buffer.
+template <typename String>
+void Append(const Compressed &compressed, String &buf) {
+  const auto pos = buf.size();
+  buf.resize(pos + compressed.size);
+  Decompress(compressed.data, buf.data() + pos, compressed.size);
+}
+}  // namespace redispp::lz
@@ -1,18 +1,30 @@
 #include <fmt/core.h>
 
 #include <boost/asio/awaitable.hpp>
-#include <boost/asio/buffer.hpp>
 #include <boost/asio/co_spawn.hpp>
 #include <boost/asio/detached.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/redirect_error.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/use_awaitable.hpp>
 #include <boost/asio/write.hpp>
+#include <boost/smart_ptr/local_shared_ptr.hpp>
+#include <boost/smart_ptr/make_local_shared.hpp>
+#include <charconv>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 
+#include "capture.h"
+#include "cluster.h"
 #include "db.h"
 #include "exec.h"
 #include "resp_serde.h"
+#include "tcp_io.h"
 
 using boost::asio::awaitable;
 using boost::asio::co_spawn;
@@ -25,57 +37,309 @@ namespace this_coro = boost::asio::this_coro;
 #define use_awaitable boost::asio::use_awaitable_t(__FILE__, __LINE__, __PRETTY_FUNCTION__)
 #endif
 
-namespace boost::asio {
-auto ReadSome(tcp::socket& socket, char* buf, size_t bufsize) -> awaitable<size_t> {
-  return socket.async_read_some(boost::asio::buffer(buf, bufsize), use_awaitable);
+static constexpr uint16_t DefaultPort = 55555;
+
+struct Config {
+  uint16_t port = DefaultPort;
+  std::optional<std::string_view> cluster_nodes;
+  redispp::OutputLimits output_limits;
+  size_t tracking_table_max_keys = redispp::tracking::DefaultMaxKeys;
+  // Connections that send no command for this long are closed; 0 disables the timeout.
+  std::chrono::seconds timeout{0};
+  // Strings at least this long are stored compressed when it pays off; 0 disables compression.
+  size_t compression_threshold = 0;
+  // What clients send is recorded into this file, for redis-replay.
+  std::optional<std::string_view> capture_path;
+};
+
+static auto format_endpoint(const tcp::endpoint& endpoint) -> std::string {
+  return fmt::format("{}:{}", endpoint.address().to_string(), endpoint.port());
 }
 
-auto Write(tcp::socket& socket, const char* buf, size_t bufsize) -> awaitable<void> {
-  co_await boost::asio::async_write(socket, boost::asio::buffer(buf, bufsize), use_awaitable);
+// The socket as requests are read from it: when traffic is captured, what's read is also recorded.
+struct SessionInput {
+  tcp::socket* socket;
+  const redispp::Client* client;
+  redispp::capture::Recorder* recorder;
+};
+
+static auto read_recorded(SessionInput input, char* buf, size_t len) -> awaitable<size_t> {
+  const auto n = co_await ReadSome(*input.socket, buf, len);
+  input.recorder->Record(input.client->Id(), {buf, n});
+  co_return n;
 }
-}  // namespace boost::asio
 
-auto send_result(redispp::Response response, tcp::socket& socket) -> boost::asio::awaitable<void> {
-  redispp::resp::Serializer serializer(socket);
-  co_await response.Serialize(serializer);
+static auto ReadSome(SessionInput& input, char* buf, size_t len) -> awaitable<size_t> {
+  if (input.recorder == nullptr) {
+    return ReadSome(*input.socket, buf, len);
+  }
+  return read_recorded(input, buf, len);
 }
 
-auto run_session(redispp::DB& db, tcp::socket socket) -> awaitable<void> {
+static auto WaitReadable(SessionInput& input) -> awaitable<void> { return WaitReadable(*input.socket); }
+
+static auto PeerClosed(SessionInput& input) -> bool { return PeerClosed(*input.socket); }
+
+struct Session {
+  // Requests are read with the DB's allocator, so that values are stored without being copied. The read buffer is
+  // borrowed from the pool only while there's input to parse, so idle sessions don't hold one.
+  Session(tcp::socket sock,
+          redispp::DB& db,
+          redispp::resp::BufferPool& buffers,
+          redispp::capture::Recorder* recorder,
+          const Config& config)
+      : socket(std::move(sock)),
+        client(socket.get_executor(), config.output_limits),
+        input{&socket, &client, recorder},
+        deserializer(input, db.Allocator(), &buffers),
+        idle_timer(socket.get_executor()) {
+    boost::system::error_code ec;
+    auto addr = socket.remote_endpoint(ec);
+    auto laddr = socket.local_endpoint(ec);
+    client.SetAddresses(format_endpoint(addr), format_endpoint(laddr));
+    client.SetInput(&deserializer);
+  }
+
+  tcp::socket socket;
+  redispp::Client client;
+  SessionInput input;
+  redispp::resp::Deserializer deserializer;
+  // Only armed with a timeout.
+  boost::asio::steady_timer idle_timer;
+};
+
+// Closes the connection once it has been idle for longer than the timeout. The timer is set to when that would be,
+// so a client costs one wakeup per timeout at most. Subscribers only receive and blocked clients wait for other
+// clients, so they're exempt, as in Redis.
+auto close_when_idle(boost::local_shared_ptr<Session> session, std::chrono::seconds timeout) -> awaitable<void> {
+  auto& client = session->client;
+  for (;;) {
+    const auto now = redispp::Client::Clock::now();
+    const auto* pubsub = client.GetPubSub();
+    auto deadline = client.LastActive() + timeout;
+    if ((pubsub != nullptr && pubsub->Count() != 0) || client.GetWaiter() != nullptr) {
+      deadline = now + timeout;
+    } else if (deadline <= now) {
+      client.Output().Close();
+      break;
+    }
+
+    // Cancelled when the connection closes.
+    boost::system::error_code ec;
+    session->idle_timer.expires_at(deadline);
+    co_await session->idle_timer.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+    if (ec) {
+      break;
+    }
+  }
+}
+
+// The only writer of the connection: replies and pushes leave in the order they were queued, batched into one
+// gathered write per wakeup.
+auto send_output(boost::local_shared_ptr<Session> session) -> awaitable<void> {
+  auto& output = session->client.Output();
+
+  try {
+    std::vector<boost::asio::const_buffer> buffers;
+    for (;;) {
+      auto segments = co_await output.Take();
+
+      size_t bytes = 0;
+      buffers.clear();
+      for (const auto& segment : segments) {
+        buffers.emplace_back(segment.bytes.data(), segment.bytes.size());
+        bytes += segment.bytes.size();
+      }
+      co_await boost::asio::async_write(session->socket, buffers, use_awaitable);
+      output.Consume(bytes);
+    }
+  } catch (std::exception& e) {
+    if (!output.IsClosed()) {
+      fmt::print("echo Exception: {}\n", e.what());
+    }
+  }
+
+  // Also closes the socket, which stops the reader.
+  output.Close();
+}
+
+auto run_session(redispp::DB& db,
+                 redispp::resp::BufferPool& buffers,
+                 redispp::capture::Recorder* recorder,
+                 tcp::socket socket,
+                 const Config& config) -> awaitable<void> {
+  auto session = boost::make_local_shared<Session>(std::move(socket), db, buffers, recorder, config);
+  auto& output = session->client.Output();
+  output.SetCloseHandler([&db, &session = *session] {
+    boost::system::error_code ec;
+    session.socket.close(ec);
+    // Blocked clients wait on a timer rather than on the socket.
+    db.GetBlocking().Abort(session.client);
+    session.idle_timer.cancel();
+  });
+
+  db.RegisterClient(session->client);
+
   try {
     auto executor = co_await this_coro::executor;
-    redispp::Client client;
-    redispp::resp::Deserializer deserializer(socket);
+    co_spawn(executor, send_output(session), detached);
+    if (config.timeout.count() != 0) {
+      co_spawn(executor, close_when_idle(session, config.timeout), detached);
+    }
 
     for (;;) {
-      auto response = co_await redispp::Execute(db, client, deserializer);
-      co_spawn(executor, send_result(std::move(response), socket), detached);
+      // Backpressure: stop reading requests while the client isn't reading its replies.
+      co_await output.WaitWritable();
+      co_await session->deserializer.WaitForInput();
+
+      auto response = co_await redispp::Execute(db, session->client, session->deserializer);
+      if (!response.Empty()) {
+        response.Write(output, session->client.GetProtocol());
+      }
     }
   } catch (std::exception& e) {
-    fmt::print("echo Exception: {}\n", e.what());
+    if (!output.IsClosed()) {
+      fmt::print("echo Exception: {}\n", e.what());
+    }
   }
+
+  db.UnregisterClient(session->client);
+  output.Close();
 }
 
-auto listener(redispp::DB& db) -> awaitable<void> {
+auto listener(redispp::DB& db,
+              redispp::resp::BufferPool& buffers,
+              redispp::capture::Recorder* recorder,
+              const Config& config) -> awaitable<void> {
   auto executor = co_await this_coro::executor;
-  tcp::acceptor acceptor(executor, {tcp::v4(), 55555});
+  tcp::acceptor acceptor(executor, {tcp::v4(), config.port});
   for (;;) {
     tcp::socket socket = co_await acceptor.async_accept(use_awaitable);
-    co_spawn(executor, run_session(db, std::move(socket)), detached);
+    // Replies to pipelined commands may leave in several writes: Nagle's algorithm would hold the later ones back until
+    // the client acknowledges the first, which it may delay for tens of milliseconds.
+    boost::system::error_code ec;
+    socket.set_option(tcp::no_delay(true), ec);
+    co_spawn(executor, run_session(db, buffers, recorder, std::move(socket), config), detached);
   }
 }
 
-auto main() -> int {
+template <typename Int>
+static auto parse_uint(std::string_view str, Int min = 1) -> std::optional<Int> {
+  Int val = 0;
+  auto res = std::from_chars(str.begin(), str.end(), val);
+  if (res.ec != std::errc{} || res.ptr != str.end() || val < min) {
+    return {};
+  }
+  return val;
+}
+
+// "host:port,host:port,..." lists every node, including this one; slots are split evenly in that order.
+static auto parse_cluster(std::string_view nodes_str, uint16_t myport) -> std::optional<redispp::cluster::Cluster> {
+  std::vector<redispp::cluster::Node> nodes;
+
+  while (!nodes_str.empty()) {
+    auto node_str = nodes_str.substr(0, nodes_str.find(','));
+    nodes_str.remove_prefix(std::min(nodes_str.size(), node_str.size() + 1));
+
+    auto colon = node_str.rfind(':');
+    if (colon == std::string_view::npos) {
+      return {};
+    }
+    auto port = parse_uint<uint16_t>(node_str.substr(colon + 1));
+    if (!port) {
+      return {};
+    }
+    nodes.push_back({std::string(node_str.substr(0, colon)), *port});
+  }
+
+  auto myself = std::find_if(nodes.begin(), nodes.end(), [&](const auto& node) { return node.port == myport; });
+  if (myself == nodes.end()) {
+    return {};
+  }
+
+  redispp::cluster::Cluster cluster(*myself);
+  const auto slots_per_node = redispp::cluster::SlotCount / nodes.size();
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const auto first = i * slots_per_node;
+    const auto last = i + 1 == nodes.size() ? redispp::cluster::SlotCount - 1 : first + slots_per_node - 1;
+    cluster.AssignSlots(first, last, cluster.AddNode(nodes[i]));
+  }
+  return cluster;
+}
+
+auto main(int argc, char* argv[]) -> int {
+  std::span args(argv, argc);
+  Config config;
+
+  for (size_t i = 1; i < args.size(); i++) {
+    std::string_view arg = args[i];
+    std::optional<size_t> limit;
+
+    if (arg == "--port" && i + 1 < args.size()) {
+      auto port = parse_uint<uint16_t>(args[++i]);
+      if (!port) {
+        fmt::print("Invalid port: {}\n", args[i]);
+        return 1;
+      }
+      config.port = *port;
+    } else if (arg == "--cluster" && i + 1 < args.size()) {
+      config.cluster_nodes = args[++i];
+    } else if (arg == "--output-soft-limit" && i + 1 < args.size() && (limit = parse_uint<size_t>(args[++i]))) {
+      config.output_limits.soft = *limit;
+    } else if (arg == "--output-hard-limit" && i + 1 < args.size() && (limit = parse_uint<size_t>(args[++i]))) {
+      config.output_limits.hard = *limit;
+    } else if (arg == "--tracking-table-max-keys" && i + 1 < args.size() && (limit = parse_uint<size_t>(args[++i]))) {
+      config.tracking_table_max_keys = *limit;
+    } else if (arg == "--timeout" && i + 1 < args.size() && (limit = parse_uint<size_t>(args[++i], 0))) {
+      config.timeout = std::chrono::seconds(*limit);
+    } else if (arg == "--compression-threshold" && i + 1 < args.size() &&
+               (limit = parse_uint<size_t>(args[++i], 0))) {
+      config.compression_threshold = *limit;
+    } else if (arg == "--capture" && i + 1 < args.size()) {
+      config.capture_path = args[++i];
+    } else {
+      fmt::print(
+          "Usage: {} [--port <port>] [--cluster <host:port>[,<host:port>...]] [--output-soft-limit <bytes>] "
+          "[--output-hard-limit <bytes>] [--tracking-table-max-keys <count>] [--timeout <seconds>] "
+          "[--compression-threshold <bytes>] [--capture <file>]\n",
+          args[0]);
+      return 1;
+    }
+  }
+
   try {
+    // Outlive the io_context, which destroys the sessions still running.
+    redispp::resp::BufferPool buffers;
+    std::optional<redispp::capture::Recorder> recorder;
+    if (config.capture_path) {
+      recorder.emplace(std::string(*config.capture_path));
+    }
     boost::asio::io_context io_context(1);
 
     boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
     signals.async_wait([&](auto, auto) { io_context.stop(); });
 
     redispp::DB db;
-    co_spawn(io_context, listener(db), detached);
+    db.GetTracking().SetMaxKeys(config.tracking_table_max_keys);
+    db.SetCompressionThreshold(config.compression_threshold);
+    std::optional<redispp::cluster::Cluster> cluster;
+    if (config.cluster_nodes) {
+      cluster = parse_cluster(*config.cluster_nodes, config.port);
+      if (!cluster) {
+        fmt::print("Invalid cluster nodes (must include this node's port {}): {}\n", config.port, *config.cluster_nodes);
+        return 1;
+      }
+      db.SetCluster(&*cluster);
+    }
+
+    co_spawn(io_context, listener(db, buffers, recorder ? &*recorder : nullptr, config), detached);
     io_context.run();
 
+    if (recorder && recorder->Dropped() != 0) {
+      fmt::print("Capture incomplete: {} reads dropped while the file writer lagged behind\n", recorder->Dropped());
+    }
+
   } catch (std::exception& e) {
     fmt::print("Exception: {}\n", e.what());
   }
-}
+}
\ No newline at end of file
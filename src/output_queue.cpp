@@ -0,0 +1,102 @@
+#include "output_queue.h"
+
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/smart_ptr/make_local_shared.hpp>
+#include <stdexcept>
+
+namespace redispp {
+auto OutputQueue::Push(Frame frame) -> bool {
+  const std::string_view bytes = *frame;
+  if (!Borrow(std::move(frame), bytes)) {
+    return false;
+  }
+
+  m_queued_pushes += bytes.size();
+  if (m_queued_pushes > m_limits.hard) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+auto OutputQueue::Borrow(boost::local_shared_ptr<const void> owner, std::string_view bytes) -> bool {
+  if (m_closed) {
+    return false;
+  }
+
+  flush_tail();
+  m_segments.push_back({std::move(owner), bytes});
+  return account(bytes.size());
+}
+
+auto OutputQueue::WaitWritable() -> boost::asio::awaitable<void> {
+  while (!m_closed && m_bytes >= m_limits.soft) {
+    co_await m_drained.async_receive(boost::asio::use_awaitable);
+  }
+  if (m_closed) {
+    throw std::runtime_error("Output closed");
+  }
+}
+
+auto OutputQueue::Take() -> boost::asio::awaitable<std::vector<Segment>> {
+  while (!m_closed && m_segments.empty() && m_tail.empty()) {
+    if (m_close_when_drained && m_bytes == 0) {
+      Close();
+      break;
+    }
+    co_await m_pending.async_receive(boost::asio::use_awaitable);
+  }
+  if (m_closed) {
+    throw std::runtime_error("Output closed");
+  }
+
+  flush_tail();
+  m_queued_pushes = 0;
+  co_return std::exchange(m_segments, {});
+}
+
+void OutputQueue::Consume(size_t bytes) {
+  const auto was_full = m_bytes >= m_limits.soft;
+  m_bytes -= bytes;
+  if (was_full && m_bytes < m_limits.soft) {
+    m_drained.try_send(boost::system::error_code{});
+  }
+}
+
+void OutputQueue::Close() {
+  if (std::exchange(m_closed, true)) {
+    return;
+  }
+  m_segments.clear();
+  m_tail.clear();
+  m_pending.close();
+  m_drained.close();
+  if (m_close_handler) {
+    std::exchange(m_close_handler, {})();
+  }
+}
+
+// The tail's bytes were accounted for when they were appended.
+void OutputQueue::flush_tail() {
+  if (!m_tail.empty()) {
+    auto frame = boost::make_local_shared<const std::string>(std::exchange(m_tail, {}));
+    const std::string_view bytes = *frame;
+    m_segments.push_back({std::move(frame), bytes});
+  }
+}
+
+void OutputQueue::CloseWhenDrained() {
+  m_close_when_drained = true;
+  m_pending.try_send(boost::system::error_code{});
+}
+
+auto OutputQueue::account(size_t bytes) -> bool {
+  if (m_closed) {
+    return false;
+  }
+
+  m_bytes += bytes;
+  m_pending.try_send(boost::system::error_code{});
+  return true;
+}
+}  // namespace redispp
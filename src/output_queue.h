@@ -0,0 +1,86 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/experimental/channel.hpp>
+#include <boost/smart_ptr/local_shared_ptr.hpp>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace redispp {
+// A RESP encoded frame. Frames sent to several clients (e.g. published messages) are encoded once and shared.
+using Frame = boost::local_shared_ptr<const std::string>;
+
+// Bytes waiting to be written, kept alive by `owner`: a frame, or a value borrowed from the DB.
+struct Segment {
+  boost::local_shared_ptr<const void> owner;
+  std::string_view bytes;
+};
+
+struct OutputLimits {
+  // Reading from the client pauses while this many bytes are waiting to be written.
+  size_t soft = size_t{1} << 20;
+  // Clients with more pushes (pub/sub messages, invalidations) waiting behind the write in progress are disconnected.
+  // Replies don't count: the pause at the soft limit bounds them to it plus one reply, however large that reply is.
+  size_t hard = size_t{32} << 20;
+};
+
+// Ordered output of a connection. Replies and pushes are written in the order they were queued, by a single writer.
+class OutputQueue {
+ public:
+  OutputQueue(const boost::asio::any_io_executor &executor, OutputLimits limits)
+      : m_limits(limits), m_pending(executor, 1), m_drained(executor, 1) {}
+
+  // Appends a private reply, encoded by `encode(std::string &)`. Consecutive replies share one buffer.
+  template <typename Encoder>
+  auto Append(Encoder &&encode) -> bool {
+    if (m_closed) {
+      return false;
+    }
+    const auto size = m_tail.size();
+    encode(m_tail);
+    return account(m_tail.size() - size);
+  }
+
+  // Appends a shared push. Returns false, and closes the queue, when the hard limit is exceeded.
+  auto Push(Frame frame) -> bool;
+
+  // Appends bytes owned elsewhere, e.g. a large value in the DB, without copying them.
+  auto Borrow(boost::local_shared_ptr<const void> owner, std::string_view bytes) -> bool;
+
+  // Waits until the queue is below the soft limit; throws once the queue is closed.
+  auto WaitWritable() -> boost::asio::awaitable<void>;
+
+  // Writer side: waits for output and takes all of it. The bytes count against the limits until `Consume`d.
+  auto Take() -> boost::asio::awaitable<std::vector<Segment>>;
+  void Consume(size_t bytes);
+
+  // Closing wakes up the waiters; the handler lets the connection abort a write that is stuck on a slow client.
+  void Close();
+  // Closes the queue once everything queued so far, and anything appended before the writer next waits, is written.
+  void CloseWhenDrained();
+  void SetCloseHandler(std::function<void()> handler) { m_close_handler = std::move(handler); }
+  [[nodiscard]] auto IsClosed() const noexcept -> bool { return m_closed; }
+  [[nodiscard]] auto Size() const noexcept -> size_t { return m_bytes; }
+
+ private:
+  using Signal = boost::asio::experimental::channel<void(boost::system::error_code)>;
+
+  auto account(size_t bytes) -> bool;
+  void flush_tail();
+
+  OutputLimits m_limits;
+  std::vector<Segment> m_segments;
+  std::string m_tail;
+  size_t m_bytes = 0;
+  size_t m_queued_pushes = 0;  // Bytes of pushes the writer hasn't taken yet
+  bool m_closed = false;
+  bool m_close_when_drained = false;
+  Signal m_pending;
+  Signal m_drained;
+  std::function<void()> m_close_handler;
+};
+}  // namespace redispp
@@ -0,0 +1,192 @@
+#include "pubsub.h"
+
+#include <boost/smart_ptr/make_local_shared.hpp>
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+#include "db.h"
+
+namespace redispp::pubsub {
+static auto match_class(std::string_view &pattern, char c) noexcept -> bool {
+  // `pattern` starts just after '['.
+  const bool negate = !pattern.empty() && pattern.front() == '^';
+  if (negate) {
+    pattern.remove_prefix(1);
+  }
+
+  bool match = false;
+  while (!pattern.empty() && pattern.front() != ']') {
+    if (pattern.front() == '\\' && pattern.size() >= 2) {
+      match |= pattern[1] == c;
+      pattern.remove_prefix(2);
+    } else if (pattern.size() >= 3 && pattern[1] == '-' && pattern[2] != ']') {
+      auto [lo, hi] = std::minmax(pattern[0], pattern[2]);
+      match |= lo <= c && c <= hi;
+      pattern.remove_prefix(3);
+    } else {
+      match |= pattern.front() == c;
+      pattern.remove_prefix(1);
+    }
+  }
+  if (!pattern.empty()) {
+    pattern.remove_prefix(1);  // ']'
+  }
+  return match != negate;
+}
+
+auto GlobMatch(std::string_view pattern, std::string_view str) noexcept -> bool {
+  while (!pattern.empty()) {
+    switch (pattern.front()) {
+      case '*':
+        while (!pattern.empty() && pattern.front() == '*') {
+          pattern.remove_prefix(1);
+        }
+        if (pattern.empty()) {
+          return true;
+        }
+        for (; !str.empty(); str.remove_prefix(1)) {
+          if (GlobMatch(pattern, str)) {
+            return true;
+          }
+        }
+        return false;
+
+      case '?':
+        if (str.empty()) {
+          return false;
+        }
+        pattern.remove_prefix(1);
+        break;
+
+      case '[':
+        pattern.remove_prefix(1);
+        if (str.empty() || !match_class(pattern, str.front())) {
+          return false;
+        }
+        str.remove_prefix(1);
+        continue;
+
+      case '\\':
+        if (pattern.size() >= 2) {
+          pattern.remove_prefix(1);
+        }
+        [[fallthrough]];
+
+      default:
+        if (str.empty() || pattern.front() != str.front()) {
+          return false;
+        }
+        pattern.remove_prefix(1);
+        break;
+    }
+    str.remove_prefix(1);
+  }
+  return str.empty();
+}
+
+void Registry::add(SubscriberMap &map, Client &client, const resp::String &name) {
+  auto it = map.find(name);
+  if (it == map.end()) {
+    it = map.emplace(resp::String(name, map.get_allocator().resource()), Subscribers{}).first;
+  }
+  it->second.push_back(&client);
+}
+
+void Registry::remove(SubscriberMap &map, Client &client, std::string_view name) {
+  auto it = map.find(name);
+  if (it == map.end()) {
+    return;
+  }
+
+  auto &subscribers = it->second;
+  auto pos = std::find(subscribers.begin(), subscribers.end(), &client);
+  if (pos != subscribers.end()) {
+    *pos = subscribers.back();
+    subscribers.pop_back();
+  }
+  if (subscribers.empty()) {
+    map.erase(it);
+  }
+}
+
+void Registry::Subscribe(Client &client, const resp::String &channel) {
+  if (client.PubSub().channels.insert(channel).second) {
+    add(m_channels, client, channel);
+  }
+}
+
+void Registry::Unsubscribe(Client &client, const resp::String &channel) {
+  if (client.PubSub().channels.erase(channel) != 0) {
+    remove(m_channels, client, channel);
+  }
+}
+
+void Registry::PSubscribe(Client &client, const resp::String &pattern) {
+  if (client.PubSub().patterns.insert(pattern).second) {
+    add(m_patterns, client, pattern);
+  }
+}
+
+void Registry::PUnsubscribe(Client &client, const resp::String &pattern) {
+  if (client.PubSub().patterns.erase(pattern) != 0) {
+    remove(m_patterns, client, pattern);
+  }
+}
+
+void Registry::UnsubscribeAll(Client &client) {
+  auto *state = client.GetPubSub();
+  if (state == nullptr) {
+    return;
+  }
+
+  for (const auto &channel : state->channels) {
+    remove(m_channels, client, channel);
+  }
+  for (const auto &pattern : state->patterns) {
+    remove(m_patterns, client, pattern);
+  }
+  state->channels.clear();
+  state->patterns.clear();
+}
+
+auto Registry::Publish(std::string_view channel, std::string_view message) -> size_t {
+  size_t receivers = 0;
+
+  // Encoded at most once per protocol version: RESP3 subscribers get push frames.
+  auto deliver = [&](const Subscribers &subscribers, std::optional<std::string_view> pattern) {
+    std::array<Frame, 2> frames;
+
+    for (auto *subscriber : subscribers) {
+      const auto proto = subscriber->GetProtocol();
+      auto &frame = frames[proto == resp::Protocol::Resp3 ? 1 : 0];
+      if (!frame) {
+        std::string buf;
+        resp::EncodeAggregateHeader(buf, resp::TokenTypeMarker::Push, pattern ? 4 : 3, proto);
+        resp::EncodeBulkString(buf, pattern ? "pmessage" : "message");
+        if (pattern) {
+          resp::EncodeBulkString(buf, *pattern);
+        }
+        resp::EncodeBulkString(buf, channel);
+        resp::EncodeBulkString(buf, message);
+        frame = boost::make_local_shared<const std::string>(std::move(buf));
+      }
+      subscriber->Output().Push(frame);
+    }
+    receivers += subscribers.size();
+  };
+
+  if (auto it = m_channels.find(channel); it != m_channels.end()) {
+    deliver(it->second, std::nullopt);
+  }
+
+  for (const auto &[pattern, subscribers] : m_patterns) {
+    if (GlobMatch(pattern, channel)) {
+      deliver(subscribers, pattern);
+    }
+  }
+
+  return receivers;
+}
+}  // namespace redispp::pubsub
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "output_queue.h"
+#include "resp_serde.h"
+#include "string_hash.h"
+
+namespace redispp {
+class Client;
+
+namespace pubsub {
+// Per client state, created on the first subscription.
+struct ClientState {
+  [[nodiscard]] auto Count() const noexcept -> size_t { return channels.size() + patterns.size(); }
+
+  std::unordered_set<resp::String, utils::string_hash, std::equal_to<>> channels;
+  std::unordered_set<resp::String, utils::string_hash, std::equal_to<>> patterns;
+};
+
+// Redis glob-style matching: `*`, `?`, `[a-z]`, `[^abc]` and `\` escapes.
+auto GlobMatch(std::string_view pattern, std::string_view str) noexcept -> bool;
+
+class Registry {
+ public:
+  explicit Registry(std::pmr::memory_resource &alloc) : m_channels(&alloc), m_patterns(&alloc) {}
+
+  void Subscribe(Client &client, const resp::String &channel);
+  void Unsubscribe(Client &client, const resp::String &channel);
+  void PSubscribe(Client &client, const resp::String &pattern);
+  void PUnsubscribe(Client &client, const resp::String &pattern);
+  void UnsubscribeAll(Client &client);
+
+  // Encodes the message once and queues the same frame to every subscriber; subscribers that cannot keep up are
+  // disconnected by their output limits. Returns the number of clients the message was delivered to.
+  auto Publish(std::string_view channel, std::string_view message) -> size_t;
+
+ private:
+  using Subscribers = std::vector<Client *>;
+  using SubscriberMap = std::pmr::unordered_map<resp::String, Subscribers, utils::string_hash, std::equal_to<>>;
+
+  static void add(SubscriberMap &map, Client &client, const resp::String &name);
+  static void remove(SubscriberMap &map, Client &client, std::string_view name);
+
+  SubscriberMap m_channels;
+  SubscriberMap m_patterns;
+};
+}  // namespace pubsub
+}  // namespace redispp
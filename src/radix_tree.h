@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispp {
+// An ordered map keyed on fixed size byte strings, e.g. big endian integers. Paths are compressed: a node holds the
+// bytes its whole subtree has in common, so keys sharing long prefixes, like the timestamps of stream IDs, share nodes.
+// Internal nodes other than the root always have two children or more.
+template <size_t KeySize, typename T>
+class RadixTree {
+ public:
+  using Key = std::array<uint8_t, KeySize>;
+  using Entry = std::pair<const Key, T>;
+
+  [[nodiscard]] auto Size() const noexcept -> size_t { return m_size; }
+  [[nodiscard]] auto Empty() const noexcept -> bool { return m_size == 0; }
+
+  // Returns the entry and whether it was inserted; an existing entry is left unchanged.
+  auto Insert(const Key &key, T value) -> std::pair<Entry *, bool> {
+    Node *node = &m_root;
+    size_t depth = 0;
+    while (depth < KeySize) {
+      auto [it, found] = find_child(*node, key[depth]);
+      if (!found) {
+        auto *entry = &*node->children.insert(it, make_leaf(key, depth, std::move(value)))->get()->entry;
+        m_size++;
+        return {entry, true};
+      }
+
+      auto &child = **it;
+      const auto common = common_prefix(child, key, depth);
+      if (common == child.prefix.size()) {
+        node = &child;
+        depth += common;
+        continue;
+      }
+
+      // The key leaves the child's path in the middle: split it there.
+      auto old = std::move(*it);
+      auto split = std::make_unique<Node>();
+      split->prefix = old->prefix.substr(0, common);
+      old->prefix.erase(0, common);
+      auto leaf = make_leaf(key, depth + common, std::move(value));
+      auto *entry = &*leaf->entry;
+      if (byte(old->prefix.front()) < key[depth + common]) {
+        split->children.push_back(std::move(old));
+        split->children.push_back(std::move(leaf));
+      } else {
+        split->children.push_back(std::move(leaf));
+        split->children.push_back(std::move(old));
+      }
+      *it = std::move(split);
+      m_size++;
+      return {entry, true};
+    }
+    return {&*node->entry, false};
+  }
+
+  auto Erase(const Key &key) -> bool {
+    // The parents of the leaf, and the index of the child on the way to it.
+    std::array<std::pair<Node *, size_t>, KeySize> path;
+    size_t path_len = 0;
+    Node *node = &m_root;
+    for (size_t depth = 0; depth < KeySize;) {
+      auto [it, found] = find_child(*node, key[depth]);
+      if (!found || common_prefix(**it, key, depth) != (*it)->prefix.size()) {
+        return false;
+      }
+      path[path_len++] = {node, static_cast<size_t>(it - node->children.begin())};
+      node = it->get();
+      depth += node->prefix.size();
+    }
+
+    auto [parent, index] = path[path_len - 1];
+    parent->children.erase(parent->children.begin() + static_cast<ptrdiff_t>(index));
+    m_size--;
+
+    // Keeps the path compressed: a node left with one child takes its place.
+    if (parent != &m_root && parent->children.size() == 1) {
+      auto only = std::move(parent->children.front());
+      parent->prefix += only->prefix;
+      parent->children = std::move(only->children);
+      if (only->entry) {
+        parent->entry.emplace(std::move(*only->entry));
+      }
+    }
+    return true;
+  }
+
+  auto Find(const Key &key) noexcept -> Entry * {
+    auto *leaf = lower_bound(m_root, key, 0);
+    return leaf != nullptr && leaf->entry->first == key ? &*leaf->entry : nullptr;
+  }
+
+  // The first entry whose key isn't less than `key`, nullptr when there's none.
+  auto LowerBound(const Key &key) noexcept -> Entry * { return entry_of(lower_bound(m_root, key, 0)); }
+
+  // The last entry whose key isn't greater than `key`, nullptr when there's none.
+  auto Floor(const Key &key) noexcept -> Entry * { return entry_of(floor(m_root, key, 0)); }
+
+  // The entry following `key`, whether `key` is in the tree or not.
+  auto Next(Key key) noexcept -> Entry * {
+    for (auto byte = key.rbegin(); byte != key.rend(); ++byte) {
+      if (++*byte != 0) {
+        return LowerBound(key);
+      }
+    }
+    return nullptr;
+  }
+
+  auto First() noexcept -> Entry * { return m_size == 0 ? nullptr : &*leftmost(m_root).entry; }
+  auto Last() noexcept -> Entry * { return m_size == 0 ? nullptr : &*rightmost(m_root).entry; }
+
+  auto Find(const Key &key) const noexcept -> const Entry * { return mutable_this().Find(key); }
+  auto LowerBound(const Key &key) const noexcept -> const Entry * { return mutable_this().LowerBound(key); }
+  auto Floor(const Key &key) const noexcept -> const Entry * { return mutable_this().Floor(key); }
+  auto Next(const Key &key) const noexcept -> const Entry * { return mutable_this().Next(key); }
+  auto First() const noexcept -> const Entry * { return mutable_this().First(); }
+  auto Last() const noexcept -> const Entry * { return mutable_this().Last(); }
+
+ private:
+  struct Node {
+    // The path from the parent, whose first byte tells the node apart from its siblings.
+    std::string prefix;
+    // Sorted by the first byte of their prefix.
+    std::vector<std::unique_ptr<Node>> children;
+    // Leaves only, where the path is a whole key.
+    std::optional<Entry> entry;
+  };
+  using Children = std::vector<std::unique_ptr<Node>>;
+
+  static auto byte(char c) noexcept -> uint8_t { return static_cast<uint8_t>(c); }
+
+  static auto make_leaf(const Key &key, size_t depth, T value) -> std::unique_ptr<Node> {
+    auto leaf = std::make_unique<Node>();
+    leaf->prefix.assign(key.begin() + static_cast<ptrdiff_t>(depth), key.end());
+    leaf->entry.emplace(key, std::move(value));
+    return leaf;
+  }
+
+  // The first child whose label isn't less than `label`, and whether it's equal.
+  static auto find_child(Node &node, uint8_t label) noexcept -> std::pair<typename Children::iterator, bool> {
+    auto it = std::lower_bound(node.children.begin(), node.children.end(), label,
+                               [](const auto &child, uint8_t label) { return byte(child->prefix.front()) < label; });
+    return {it, it != node.children.end() && byte((*it)->prefix.front()) == label};
+  }
+
+  // How many bytes of the node's prefix match the key from `depth`.
+  static auto common_prefix(const Node &node, const Key &key, size_t depth) noexcept -> size_t {
+    size_t i = 0;
+    while (i < node.prefix.size() && byte(node.prefix[i]) == key[depth + i]) {
+      i++;
+    }
+    return i;
+  }
+
+  static auto leftmost(Node &node) noexcept -> Node & {
+    auto *leaf = &node;
+    while (!leaf->children.empty()) {
+      leaf = leaf->children.front().get();
+    }
+    return *leaf;
+  }
+
+  static auto rightmost(Node &node) noexcept -> Node & {
+    auto *leaf = &node;
+    while (!leaf->children.empty()) {
+      leaf = leaf->children.back().get();
+    }
+    return *leaf;
+  }
+
+  // The first leaf under `node` not less than `key`; the path down to `node`, excluded, matches the key up to `depth`.
+  static auto lower_bound(Node &node, const Key &key, size_t depth) noexcept -> Node * {
+    const auto common = common_prefix(node, key, depth);
+    if (common != node.prefix.size()) {
+      return byte(node.prefix[common]) > key[depth + common] ? &leftmost(node) : nullptr;
+    }
+    depth += common;
+    if (depth == KeySize) {
+      return &node;
+    }
+
+    auto [it, found] = find_child(node, key[depth]);
+    if (found) {
+      if (auto *leaf = lower_bound(**it, key, depth)) {
+        return leaf;
+      }
+      ++it;
+    }
+    return it == node.children.end() ? nullptr : &leftmost(**it);
+  }
+
+  static auto floor(Node &node, const Key &key, size_t depth) noexcept -> Node * {
+    const auto common = common_prefix(node, key, depth);
+    if (common != node.prefix.size()) {
+      return byte(node.prefix[common]) < key[depth + common] ? &rightmost(node) : nullptr;
+    }
+    depth += common;
+    if (depth == KeySize) {
+      return &node;
+    }
+
+    auto [it, found] = find_child(node, key[depth]);
+    if (found) {
+      if (auto *leaf = floor(**it, key, depth)) {
+        return leaf;
+      }
+    }
+    return it == node.children.begin() ? nullptr : &rightmost(**std::prev(it));
+  }
+
+  static auto entry_of(Node *leaf) noexcept -> Entry * { return leaf != nullptr ? &*leaf->entry : nullptr; }
+
+  auto mutable_this() const noexcept -> RadixTree & {
+    return const_cast<RadixTree &>(*this);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  }
+
+  Node m_root;
+  size_t m_size = 0;
+};
+}  // namespace redispp
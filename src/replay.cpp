@@ -0,0 +1,436 @@
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/smart_ptr/local_shared_ptr.hpp>
+#include <boost/smart_ptr/make_local_shared.hpp>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "capture.h"
+#include "resp_serde.h"
+
+// Replays the traffic captured with `redis --capture <file>` against a server, and reports the throughput and the
+// latency of the replies, to compare builds on real traffic. Each captured client gets a connection of its own, over
+// which its commands are sent again in the batches they were read in, so that pipelines stay pipelines: at the time
+// they were captured, or as soon as the previous batch is answered with --max-speed.
+//
+// Replies are matched with commands in order, one each; commands answered by several replies (SUBSCRIBE) or not at
+// all skew the latencies of the commands after them. Error replies are counted: many of them usually mean that the
+// server didn't start from the data the capture did.
+
+using boost::asio::awaitable;
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
+namespace this_coro = boost::asio::this_coro;
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint16_t DefaultPort = 55555;
+static constexpr size_t ReadSize = size_t{64} << 10;
+// A connection whose commands are still unanswered after this long is given up on.
+static constexpr auto ReplyTimeout = std::chrono::seconds(10);
+
+struct Options {
+  std::string_view path;
+  std::string_view host = "127.0.0.1";
+  uint16_t port = DefaultPort;
+  bool max_speed = false;
+};
+
+// Commands of a client read from its socket at once, e.g. a pipeline, serialized again to be sent at once.
+struct Batch {
+  std::chrono::nanoseconds time;  // Since the first record
+  size_t commands = 0;
+  std::string bytes;
+};
+
+static auto Write(Batch& batch, const char* buf, size_t len) -> awaitable<void> {
+  batch.bytes.append(buf, len);
+  co_return;
+}
+
+// A client's captured reads, read back one at a time, so that each command is timed by the read that completed it.
+struct CapturedInput {
+  std::span<const redispp::capture::Record* const> records;
+  size_t next = 0;
+  size_t offset = 0;
+  std::chrono::nanoseconds time{0};
+
+  [[nodiscard]] auto Exhausted() const noexcept -> bool { return next == records.size(); }
+};
+
+static auto ReadSome(CapturedInput& input, char* buf, size_t len) -> awaitable<size_t> {
+  while (!input.Exhausted() && input.records[input.next]->data.size() == input.offset) {
+    input.next++;
+    input.offset = 0;
+  }
+  if (input.Exhausted()) {
+    co_return 0;
+  }
+
+  const auto& record = *input.records[input.next];
+  const auto n = std::min(len, record.data.size() - input.offset);
+  std::copy_n(record.data.data() + input.offset, n, buf);
+  input.offset += n;
+  input.time = record.time;
+  co_return n;
+}
+
+// Ordered by client ID, so that clients are connected in the same order every time.
+using ClientRecords = std::map<uint64_t, std::vector<const redispp::capture::Record*>>;
+
+// Parses the client's commands with the server's deserializer, and serializes them again, into batches.
+static auto prepare(std::span<const redispp::capture::Record* const> records) -> awaitable<std::vector<Batch>> {
+  using namespace redispp::resp;
+
+  auto executor = co_await this_coro::executor;
+  CapturedInput input{records};
+  Deserializer deserializer(input);
+  std::vector<Batch> batches;
+  std::vector<Token> args;
+
+  try {
+    while (!input.Exhausted() || deserializer.Buffered() != 0) {
+      auto ch = boost::make_local_shared<Channel>(executor);
+      co_spawn(executor, deserializer.SendTokens(ch), [ch](const std::exception_ptr& e) {
+        if (e) {
+          ch->close();
+        }
+      });
+
+      args.clear();
+      for (auto tok = co_await ch->async_receive(use_awaitable); !std::holds_alternative<EndOfCommand_t>(tok);
+           tok = co_await ch->async_receive(use_awaitable)) {
+        args.push_back(std::move(tok));
+      }
+      // "*0" and "*-1" aren't commands.
+      if (args.empty() || std::holds_alternative<NullArr_t>(args.front())) {
+        continue;
+      }
+
+      if (batches.empty() || batches.back().time != input.time) {
+        batches.push_back({input.time, 0, {}});
+      }
+      auto& batch = batches.back();
+      Serializer serializer(batch);
+      co_await serializer.SerializeArrayHeader(args.size());
+      for (const auto& arg : args) {
+        co_await serializer.Serialize(arg);
+      }
+      batch.commands++;
+    }
+  } catch (const std::exception&) {
+    // The capture ended in the middle of a command, or what the client sent didn't parse: the server closed the
+    // connection there too.
+  }
+  co_return batches;
+}
+
+static auto prepare_all(const ClientRecords& client_records, std::vector<std::vector<Batch>>& clients)
+    -> awaitable<void> {
+  for (const auto& [id, records] : client_records) {
+    auto batches = co_await prepare(records);
+    if (!batches.empty()) {
+      clients.push_back(std::move(batches));
+    }
+  }
+}
+
+// The length of the reply at the start of `buf`, or nothing when it hasn't been received whole yet. Replies are only
+// framed here, nested aggregates included, not parsed.
+static auto reply_length(std::string_view buf) -> std::optional<size_t> {
+  using enum redispp::resp::TokenTypeMarker;
+  constexpr auto Terminator = redispp::resp::MessagePartTerminator;
+
+  size_t pos = 0;
+  // Replies, or elements of aggregates, still to be framed.
+  size_t pending = 1;
+  while (pending != 0) {
+    const auto eol = buf.find(Terminator, pos);
+    if (eol == std::string_view::npos) {
+      return {};
+    }
+    const auto type = static_cast<redispp::resp::TokenTypeMarker>(buf[pos]);
+    // Lines that aren't lengths leave it at 0.
+    int64_t len = 0;
+    std::from_chars(buf.data() + pos + 1, buf.data() + eol, len);
+    pos = eol + Terminator.size();
+    pending--;
+
+    switch (type) {
+      case BulkString:
+      case BlobError:
+      case VerbatimString:
+        if (len >= 0) {
+          pos += len + Terminator.size();
+        }
+        break;
+      case Array:
+      case Set:
+      case Push:
+        pending += std::max<int64_t>(len, 0);
+        break;
+      case Map:
+        pending += 2 * std::max<int64_t>(len, 0);
+        break;
+      default:
+        break;
+    }
+  }
+  if (pos > buf.size()) {
+    return {};
+  }
+  return pos;
+}
+
+struct Stats {
+  std::vector<Clock::duration> latencies;
+  size_t errors = 0;
+  size_t unanswered = 0;
+};
+
+// A replayed client's connection, shared by the coroutine sending its commands and the one reading the replies.
+struct Link {
+  explicit Link(tcp::socket sock) : socket(std::move(sock)), answered(socket.get_executor()) {}
+
+  tcp::socket socket;
+  // When the commands waiting for a reply were sent.
+  std::deque<Clock::time_point> sent;
+  // Cancelled when the last reply outstanding arrives, or the connection is lost.
+  boost::asio::steady_timer answered;
+  bool closed = false;
+};
+
+static auto read_replies(boost::local_shared_ptr<Link> link, Stats& stats) -> awaitable<void> {
+  std::string buf;
+  try {
+    for (;;) {
+      const auto size = buf.size();
+      buf.resize(size + ReadSize);
+      const auto n = co_await link->socket.async_read_some(boost::asio::buffer(buf.data() + size, ReadSize),
+                                                           use_awaitable);
+      buf.resize(size + n);
+      const auto now = Clock::now();
+
+      size_t parsed = 0;
+      while (const auto len = reply_length(std::string_view(buf).substr(parsed))) {
+        const auto type = static_cast<redispp::resp::TokenTypeMarker>(buf[parsed]);
+        parsed += *len;
+        // Pushes, e.g. invalidations, answer no command.
+        if (type == redispp::resp::TokenTypeMarker::Push || link->sent.empty()) {
+          continue;
+        }
+        if (type == redispp::resp::TokenTypeMarker::Error || type == redispp::resp::TokenTypeMarker::BlobError) {
+          stats.errors++;
+        }
+        stats.latencies.push_back(now - link->sent.front());
+        link->sent.pop_front();
+      }
+      buf.erase(0, parsed);
+
+      if (link->sent.empty()) {
+        link->answered.cancel();
+      }
+    }
+  } catch (const std::exception&) {  // NOLINT(bugprone-empty-catch)
+  }
+  link->closed = true;
+  link->answered.cancel();
+}
+
+// Waits until every command sent has been answered; false when it took too long, or the connection was lost.
+static auto wait_answered(Link& link) -> awaitable<bool> {
+  const auto deadline = Clock::now() + ReplyTimeout;
+  while (!link.sent.empty() && !link.closed) {
+    if (Clock::now() >= deadline) {
+      co_return false;
+    }
+    link.answered.expires_at(deadline);
+    boost::system::error_code ec;
+    co_await link.answered.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+  }
+  co_return !link.closed;
+}
+
+static auto replay_client(const std::vector<Batch>& batches,
+                          const tcp::endpoint& endpoint,
+                          const Options& options,
+                          Clock::time_point start,
+                          Stats& stats) -> awaitable<void> {
+  auto executor = co_await this_coro::executor;
+  boost::asio::steady_timer timer(executor);
+
+  tcp::socket socket(executor);
+  co_await socket.async_connect(endpoint, use_awaitable);
+  socket.set_option(tcp::no_delay(true));
+  auto link = boost::make_local_shared<Link>(std::move(socket));
+  co_spawn(executor, read_replies(link, stats), detached);
+
+  for (const auto& batch : batches) {
+    if (options.max_speed) {
+      if (!co_await wait_answered(*link)) {
+        break;
+      }
+    } else {
+      timer.expires_at(start + batch.time);
+      co_await timer.async_wait(use_awaitable);
+      if (link->closed) {
+        break;
+      }
+    }
+
+    link->sent.insert(link->sent.end(), batch.commands, Clock::now());
+    co_await boost::asio::async_write(link->socket, boost::asio::buffer(batch.bytes), use_awaitable);
+  }
+
+  co_await wait_answered(*link);
+  stats.unanswered += link->sent.size();
+  // Also stops the reader.
+  boost::system::error_code ec;
+  link->socket.close(ec);
+}
+
+static auto percentile(const std::vector<Clock::duration>& sorted, double fraction) -> double {
+  const auto index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())));
+  return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+static void report(Stats& stats, size_t clients, Clock::duration elapsed) {
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  auto& latencies = stats.latencies;
+  fmt::print("{} commands from {} clients in {:.3f} s: {:.0f} commands/s\n",
+             latencies.size(),
+             clients,
+             seconds,
+             static_cast<double>(latencies.size()) / seconds);
+
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    fmt::print("Latency (us): p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, p99.9 {:.1f}, max {:.1f}\n",
+               percentile(latencies, 0.5),
+               percentile(latencies, 0.9),
+               percentile(latencies, 0.99),
+               percentile(latencies, 0.999),
+               percentile(latencies, 1));
+  }
+  if (stats.errors != 0) {
+    fmt::print("{} error replies\n", stats.errors);
+  }
+  if (stats.unanswered != 0) {
+    fmt::print("{} commands unanswered\n", stats.unanswered);
+  }
+}
+
+static auto read_file(std::string_view path) -> std::optional<std::string> {
+  std::ifstream in{std::string(path), std::ios::binary};
+  if (!in) {
+    return {};
+  }
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+auto main(int argc, char* argv[]) -> int {
+  std::span args(argv, argc);
+  Options options;
+
+  for (size_t i = 1; i < args.size(); i++) {
+    std::string_view arg = args[i];
+    uint16_t port = 0;
+
+    if (arg == "--host" && i + 1 < args.size()) {
+      options.host = args[++i];
+    } else if (arg == "--port" && i + 1 < args.size()) {
+      std::string_view str = args[++i];
+      auto res = std::from_chars(str.begin(), str.end(), port);
+      if (res.ec != std::errc{} || res.ptr != str.end() || port == 0) {
+        fmt::print("Invalid port: {}\n", str);
+        return 1;
+      }
+      options.port = port;
+    } else if (arg == "--max-speed") {
+      options.max_speed = true;
+    } else if (options.path.empty() && !arg.starts_with("--")) {
+      options.path = arg;
+    } else {
+      options.path = {};
+      break;
+    }
+  }
+  if (options.path.empty()) {
+    fmt::print("Usage: {} <capture file> [--host <host>] [--port <port>] [--max-speed]\n", args[0]);
+    return 1;
+  }
+
+  try {
+    const auto file = read_file(options.path);
+    if (!file) {
+      fmt::print("Can't read {}\n", options.path);
+      return 1;
+    }
+    const auto records = redispp::capture::Parse(*file);
+    if (records.empty()) {
+      fmt::print("No traffic in {}\n", options.path);
+      return 1;
+    }
+
+    ClientRecords client_records;
+    for (const auto& record : records) {
+      client_records[record.client_id].push_back(&record);
+    }
+
+    boost::asio::io_context io_context(1);
+    std::vector<std::vector<Batch>> clients;
+    co_spawn(io_context, prepare_all(client_records, clients), detached);
+    io_context.run();
+
+    for (auto& batches : clients) {
+      for (auto& batch : batches) {
+        batch.time -= records.front().time;
+      }
+    }
+
+    tcp::resolver resolver(io_context);
+    const auto endpoint = resolver.resolve(std::string(options.host), std::to_string(options.port))->endpoint();
+
+    Stats stats;
+    const auto start = Clock::now();
+    for (const auto& batches : clients) {
+      co_spawn(io_context, replay_client(batches, endpoint, options, start, stats), [](const std::exception_ptr& e) {
+        if (e) {
+          try {
+            std::rethrow_exception(e);
+          } catch (const std::exception& ex) {
+            fmt::print("Client failed: {}\n", ex.what());
+          }
+        }
+      });
+    }
+    io_context.restart();
+    io_context.run();
+
+    report(stats, clients.size(), Clock::now() - start);
+  } catch (std::exception& e) {
+    fmt::print("Exception: {}\n", e.what());
+    return 1;
+  }
+}
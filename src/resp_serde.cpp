@@ -4,17 +4,75 @@
 
 #include <boost/asio/use_awaitable.hpp>
 #include <charconv>
+#include <iterator>
 #include <optional>
 
 namespace redispp::resp {
+static constexpr auto is_aggregate(TokenTypeMarker type) noexcept -> bool {
+  return type == TokenTypeMarker::Array || type == TokenTypeMarker::Map || type == TokenTypeMarker::Set ||
+         type == TokenTypeMarker::Push;
+}
+
+static auto double_from_chars(std::string_view str, double& d) -> std::from_chars_result {
+  // std::from_chars accepts "inf" and "nan", but not a leading '+'.
+  if (str.starts_with('+')) {
+    str.remove_prefix(1);
+  }
+  return std::from_chars(str.begin(), str.end(), d);
+}
+
+BufferPool::~BufferPool() {
+  for (auto* buf : m_free) {
+    m_alloc->deallocate(buf, BufferSize);
+  }
+}
+
+auto BufferPool::Acquire() -> char* {
+  m_in_use++;
+  if (m_free.empty()) {
+    return static_cast<char*>(m_alloc->allocate(BufferSize));
+  }
+  auto* buf = m_free.back();
+  m_free.pop_back();
+  return buf;
+}
+
+void BufferPool::Release(char* buf) noexcept {
+  m_in_use--;
+  if (m_free.size() < m_max_free) {
+    try {
+      m_free.push_back(buf);
+      return;
+    } catch (const std::bad_alloc&) {  // NOLINT(bugprone-empty-catch)
+    }
+  }
+  m_alloc->deallocate(buf, BufferSize);
+}
+
+Deserializer::~Deserializer() {
+  if (m_mem == nullptr) {
+    return;
+  }
+  if (m_pool != nullptr) {
+    m_pool->Release(m_mem);
+  } else {
+    m_alloc->deallocate(m_mem, BufferSize);
+  }
+}
+
 auto Deserializer::SendTokens(boost::local_shared_ptr<Channel> ch) -> boost::asio::awaitable<void> {
   const auto msg_type = co_await dser_msg_type_marker();
   if (!msg_type) {
     co_await send_inline_tokens(*ch);
-  } else if (*msg_type != TokenTypeMarker::Array) {
+  } else if (!is_aggregate(*msg_type)) {
     co_await send_token(co_await dser_single_token(*msg_type), *ch);
   } else {
-    const auto count = co_await dser_integer();
+    // Elements of maps, sets and pushes are flattened the same way as those of arrays.
+    const auto len = co_await dser_integer();
+    if (len < -1 || len > MaxAggregateLength) {
+      throw std::runtime_error(fmt::format("Invalid aggregate length: {}", len));
+    }
+    const auto count = (*msg_type == TokenTypeMarker::Map ? 2 : 1) * len;
     if (count > 0) {
       for (Integer i = 0; i < count; i++) {
         const auto msg_type = co_await dser_msg_type_marker();
@@ -27,6 +85,7 @@ auto Deserializer::SendTokens(boost::local_shared_ptr<Channel> ch) -> boost::asi
       co_await send_token(NullArr, *ch);
     }
   }
+  release_buffer();
   co_return co_await send_token(EndOfCommand, *ch);
 }
 
@@ -69,7 +128,55 @@ auto Deserializer::dser_single_token(TokenTypeMarker msg_type) -> boost::asio::a
     case BulkString:
       co_return co_await dser_bulk_string(co_await dser_integer());
 
+    case Null:
+      co_await dser_any();
+      co_return resp::Null;
+
+    case Double: {
+      auto str = co_await dser_any();
+      struct Double d = {};
+      auto res = double_from_chars(str, d.value);
+      if (res.ec != std::errc{}) {
+        throw std::system_error(make_error_code(res.ec));
+      }
+      co_return d;
+    }
+
+    case Boolean: {
+      auto str = co_await dser_any();
+      if (str != "t" && str != "f") {
+        throw std::runtime_error(fmt::format("Invalid Boolean: {}", str));
+      }
+      co_return resp::Boolean{str == "t"};
+    }
+
+    case BlobError: {
+      auto tok = co_await dser_bulk_string(co_await dser_integer());
+      struct Error err = {std::get<String>(std::move(tok))};
+      co_return err;
+    }
+
+    case VerbatimString: {
+      auto tok = co_await dser_bulk_string(co_await dser_integer());
+      auto& str = std::get<String>(tok);
+      if (str.size() <= VerbatimString::FormatLength || str[VerbatimString::FormatLength] != ':') {
+        throw std::runtime_error(fmt::format("Invalid Verbatim string: {}", str));
+      }
+      struct VerbatimString verbatim = {String(str.substr(0, VerbatimString::FormatLength), m_alloc),
+                                        String(str.substr(VerbatimString::FormatLength + 1), m_alloc)};
+      co_return verbatim;
+    }
+
+    case BigNumber: {
+      // Awaited into a local first, like the cases above: GCC miscompiles co_await inside a braced initializer.
+      auto digits = co_await dser_any();
+      co_return resp::BigNumber{std::move(digits)};
+    }
+
     case Array:
+    case Map:
+    case Set:
+    case Push:
     default:
       throw std::runtime_error(fmt::format("Encountered wrong message type: {}", static_cast<char>(msg_type)));
   }
@@ -79,10 +186,27 @@ auto Deserializer::dser_msg_type_marker() -> boost::asio::awaitable<std::optiona
   co_await read_some();
 
   auto msg_type = static_cast<TokenTypeMarker>(m_mem[m_cursor]);
-  if (msg_type != TokenTypeMarker::SimpleString && msg_type != TokenTypeMarker::Error &&
-      msg_type != TokenTypeMarker::Integer && msg_type != TokenTypeMarker::BulkString &&
-      msg_type != TokenTypeMarker::Array) {
-    co_return std::nullopt;
+  switch (msg_type) {
+    using enum TokenTypeMarker;
+
+    case SimpleString:
+    case Error:
+    case Integer:
+    case BulkString:
+    case Array:
+    case Null:
+    case Double:
+    case Boolean:
+    case BlobError:
+    case VerbatimString:
+    case BigNumber:
+    case Map:
+    case Set:
+    case Push:
+      break;
+
+    default:
+      co_return std::nullopt;
   }
 
   m_cursor += 1;
@@ -94,16 +218,26 @@ auto Deserializer::dser_bulk_string(ptrdiff_t len) -> boost::asio::awaitable<Tok
   if (len == -1) {
     co_return NullStr;
   }
+  // Checked before allocating: the string is allocated at the announced length up front.
+  if (len < 0 || len > MaxBulkLength) {
+    throw std::runtime_error(fmt::format("Invalid bulk string length: {}", len));
+  }
+  // The string is allocated once, at its final size, and moved into the DB as is.
   String str(len + MessagePartTerminator.length(), '\0', m_alloc);
-  size_t copied = 0;
+  size_t copied = copy_some(str.data(), str.length());
 
+  if (str.length() - copied >= DirectReadSize) {
+    co_await read_direct(str.data() + copied, str.length() - copied);
+    copied = str.length();
+  }
   while (copied < str.length()) {
-    co_await read_some();
+    // The last byte of the terminator may be the last byte sent: don't wait for more than what's missing.
+    co_await read_some(std::min(str.length() - copied, MessagePartTerminator.length()));
     copied += copy_some(str.data() + copied, str.length() - copied);
   }
 
-  if (str.rbegin()[0] != MessagePartTerminator[1] && str.rbegin()[1] != MessagePartTerminator[0]) {
-    throw std::runtime_error(fmt::format("Invalid Bulk string: {}", str));
+  if (!std::string_view(str).ends_with(MessagePartTerminator)) {
+    throw std::runtime_error("Invalid bulk string: missing terminator");
   }
 
   // Remove trailing 'MessagePartTerminator'
@@ -119,7 +253,7 @@ auto Deserializer::dser_any() -> boost::asio::awaitable<String> {
   while (true) {
     co_await read_some();
 
-    std::string_view buf = {static_cast<const char*>(m_mem.data() + m_cursor), m_buflen};
+    std::string_view buf = {m_mem + m_cursor, m_buflen};
     const auto dl_pos = buf.find(MessagePartTerminator);
 
     if (dl_pos != std::string_view::npos) {
@@ -129,9 +263,14 @@ auto Deserializer::dser_any() -> boost::asio::awaitable<String> {
       break;
     }
 
+    // A '\r' at the end may start the terminator: it's left in the buffer, and read_some() keeps it, to be looked at
+    // again with the next byte.
     if (buf.back() == MessagePartTerminator[0]) {
       buf = buf.substr(0, buf.size() - 1);
     }
+    if (msg_part.size() + buf.size() > MaxLineLength) {
+      throw std::runtime_error("Line too long");
+    }
     msg_part += buf;
     m_cursor += buf.size();
     m_buflen -= buf.size();
@@ -143,28 +282,69 @@ auto Deserializer::dser_any() -> boost::asio::awaitable<String> {
 auto Deserializer::dser_integer() -> boost::asio::awaitable<Integer> {
   auto int_str = co_await dser_any();
   Integer i = 0;
-  auto res = std::from_chars(int_str.begin().base(), int_str.end().base(), i);
+  auto res = std::from_chars(int_str.data(), int_str.data() + int_str.size(), i);
   if (res.ec != std::errc{}) {
     throw std::system_error(make_error_code(res.ec));
   }
+  if (res.ptr != int_str.data() + int_str.size()) {
+    throw std::runtime_error(fmt::format("Invalid integer: {}", int_str));
+  }
 
   co_return i;
 }
 
-auto Deserializer::read_some() -> boost::asio::awaitable<void> {
-  if (m_buflen == 0) {
-    m_cursor = 0;
+auto Deserializer::read_some(size_t min_len) -> boost::asio::awaitable<void> {
+  if (m_mem == nullptr) {
+    co_await acquire_buffer();
   }
-  if (m_buflen == 1) {
-    m_mem[0] = m_mem[m_cursor];
-    m_cursor = 0;
-    m_buflen = 1;
+  if (m_buflen >= min_len) {
+    co_return;
   }
-  auto readpos = m_cursor + m_buflen;
-  while (m_buflen < MessagePartTerminator.length()) {
-    auto n = co_await m_read_some(m_reader, m_mem.data() + readpos, m_mem.size() - readpos);
+  // What's left, at most a byte, moves to the front, so that there's room for `min_len` bytes.
+  std::copy_n(m_mem + m_cursor, m_buflen, m_mem);
+  m_cursor = 0;
+  while (m_buflen < min_len) {
+    const auto n = co_await m_read_some(m_reader, m_mem + m_buflen, BufferSize - m_buflen);
+    if (n == 0) {
+      throw std::runtime_error("Unexpected end of input");
+    }
     m_buflen += n;
-    readpos += n;
+  }
+}
+
+auto Deserializer::WaitForInput() -> boost::asio::awaitable<void> {
+  if (m_mem == nullptr) {
+    co_await acquire_buffer();
+  }
+}
+
+auto Deserializer::acquire_buffer() -> boost::asio::awaitable<void> {
+  if (m_pool == nullptr) {
+    m_mem = static_cast<char*>(m_alloc->allocate(BufferSize));
+    co_return;
+  }
+  if (m_wait_readable != nullptr) {
+    co_await m_wait_readable(m_reader);
+  }
+  m_mem = m_pool->Acquire();
+}
+
+// Pooled buffers are given back as soon as everything received has been parsed; private ones are kept.
+void Deserializer::release_buffer() noexcept {
+  if (m_pool != nullptr && m_mem != nullptr && m_buflen == 0) {
+    m_pool->Release(std::exchange(m_mem, nullptr));
+  }
+}
+
+// Reads exactly `len` bytes, so nothing past the bulk string is consumed.
+auto Deserializer::read_direct(char* buf, size_t len) -> boost::asio::awaitable<void> {
+  while (len != 0) {
+    const auto n = co_await m_read_some(m_reader, buf, len);
+    if (n == 0) {
+      throw std::runtime_error("Unexpected end of input");
+    }
+    buf += n;
+    len -= n;
   }
 }
 
@@ -190,32 +370,27 @@ template <class... Ts>
 overloaded(Ts...) -> overloaded<Ts...>;
 
 auto Serializer::Serialize(const Token& tok) -> boost::asio::awaitable<void> {
-  co_await std::visit([this](const auto& tok) { return this->serialize(tok); }, tok);
+  if (const auto* str = std::get_if<String>(&tok)) {
+    return SerializeBulkString(*str);
+  }
+  return serialize_encoded(tok);
 }
 
 auto Serializer::SerializeArrayHeader(size_t elem_count) -> boost::asio::awaitable<void> {
-  std::array<char, 30> count{};
-
-  auto res = fmt::format_to_n(count.data(),
-                              count.size(),
-                              "{}{}{}",
-                              static_cast<char>(TokenTypeMarker::Array),
-                              elem_count,
-                              MessagePartTerminator);
-  co_await write(count.data(), res.size);
+  return SerializeAggregateHeader(TokenTypeMarker::Array, elem_count);
 }
 
-auto Serializer::SerializeNullArray(NullArr_t /*nullarr*/) -> boost::asio::awaitable<void> {
-  return serialize(NullArr);
+auto Serializer::SerializeAggregateHeader(TokenTypeMarker type, size_t elem_count) -> boost::asio::awaitable<void> {
+  std::string header;
+  EncodeAggregateHeader(header, type, elem_count, m_protocol);
+  co_await write(header.data(), header.size());
 }
 
-auto Serializer::serialize(NullArr_t /*nullarr*/) -> boost::asio::awaitable<void> {
-  const std::string_view NullArray = "*-1";
-  co_await write(NullArray.data(), NullArray.length());
-  co_await write(MessagePartTerminator.data(), MessagePartTerminator.length());
+auto Serializer::SerializeNullArray(NullArr_t /*nullarr*/) -> boost::asio::awaitable<void> {
+  return serialize_encoded(NullArr);
 }
 
-auto Serializer::serialize(const String& s) -> boost::asio::awaitable<void> {
+auto Serializer::SerializeBulkString(std::string_view s) -> boost::asio::awaitable<void> {
   std::array<char, 30> length{};
 
   auto res = fmt::format_to_n(length.data(),
@@ -237,25 +412,96 @@ auto Serializer::serialize_simple_string(const String& s) -> boost::asio::awaita
   co_await write(MessagePartTerminator.data(), MessagePartTerminator.length());
 }
 
-auto Serializer::serialize(const Error& err) -> boost::asio::awaitable<void> {
-  const auto msg_type = static_cast<char>(TokenTypeMarker::Error);
+auto Serializer::serialize_encoded(const Token& tok) -> boost::asio::awaitable<void> {
+  std::string buf;
+  Encode(buf, tok, m_protocol);
+  co_await write(buf.data(), buf.size());
+}
 
-  co_await write(&msg_type, sizeof(msg_type));
-  co_await write(err.msg.data(), err.msg.length());
-  co_await write(MessagePartTerminator.data(), MessagePartTerminator.length());
+void EncodeArrayHeader(std::string& buf, size_t elem_count) {
+  fmt::format_to(
+      std::back_inserter(buf), "{}{}{}", static_cast<char>(TokenTypeMarker::Array), elem_count, MessagePartTerminator);
+}
+
+void EncodeAggregateHeader(std::string& buf, TokenTypeMarker type, size_t elem_count, Protocol proto) {
+  if (proto == Protocol::Resp2) {
+    // Maps are sent as flat arrays of keys and values.
+    elem_count *= type == TokenTypeMarker::Map ? 2 : 1;
+    type = TokenTypeMarker::Array;
+  }
+  fmt::format_to(std::back_inserter(buf), "{}{}{}", static_cast<char>(type), elem_count, MessagePartTerminator);
 }
 
-auto Serializer::serialize(Integer i) -> boost::asio::awaitable<void> {
-  std::array<char, 30> int_str{};
+void EncodeBulkString(std::string& buf, std::string_view str) {
+  fmt::format_to(std::back_inserter(buf),
+                 "{}{}{}{}{}",
+                 static_cast<char>(TokenTypeMarker::BulkString),
+                 str.length(),
+                 MessagePartTerminator,
+                 str,
+                 MessagePartTerminator);
+}
 
-  auto res = fmt::format_to_n(
-      int_str.data(), int_str.size(), "{}{}{}", static_cast<char>(TokenTypeMarker::Integer), i, MessagePartTerminator);
-  co_await write(int_str.data(), res.size);
+void EncodeBulkStringHeader(std::string& buf, size_t len) {
+  fmt::format_to(
+      std::back_inserter(buf), "{}{}{}", static_cast<char>(TokenTypeMarker::BulkString), len, MessagePartTerminator);
 }
 
-auto Serializer::serialize(NullStr_t /*nullstr*/) -> boost::asio::awaitable<void> {
-  constexpr std::string_view NullString = "$-1";
-  co_await write(NullString.data(), NullString.length());
-  co_await write(MessagePartTerminator.data(), MessagePartTerminator.length());
+static void encode_simple(std::string& buf, TokenTypeMarker type, const auto& val) {
+  fmt::format_to(std::back_inserter(buf), "{}{}{}", static_cast<char>(type), val, MessagePartTerminator);
+}
+
+void Encode(std::string& buf, const Token& tok, Protocol proto) {
+  const bool resp3 = proto == Protocol::Resp3;
+
+  std::visit(overloaded{[&](Integer i) { encode_simple(buf, TokenTypeMarker::Integer, i); },
+                        [&](const String& s) { EncodeBulkString(buf, s); },
+                        [&](const Error& err) { encode_simple(buf, TokenTypeMarker::Error, err.msg); },
+                        [&](NullStr_t /*nullstr*/) {
+                          fmt::format_to(std::back_inserter(buf), "{}{}", resp3 ? "_" : "$-1", MessagePartTerminator);
+                        },
+                        [&](NullArr_t /*nullarr*/) {
+                          fmt::format_to(std::back_inserter(buf), "{}{}", resp3 ? "_" : "*-1", MessagePartTerminator);
+                        },
+                        [&](Null_t /*null*/) {
+                          fmt::format_to(std::back_inserter(buf), "{}{}", resp3 ? "_" : "$-1", MessagePartTerminator);
+                        },
+                        [&](Double d) {
+                          if (resp3) {
+                            encode_simple(buf, TokenTypeMarker::Double, d.value);
+                          } else {
+                            EncodeBulkString(buf, fmt::format("{}", d.value));
+                          }
+                        },
+                        [&](Boolean b) {
+                          if (resp3) {
+                            encode_simple(buf, TokenTypeMarker::Boolean, b.value ? 't' : 'f');
+                          } else {
+                            encode_simple(buf, TokenTypeMarker::Integer, b.value ? 1 : 0);
+                          }
+                        },
+                        [&](const BigNumber& n) {
+                          if (resp3) {
+                            encode_simple(buf, TokenTypeMarker::BigNumber, n.digits);
+                          } else {
+                            EncodeBulkString(buf, n.digits);
+                          }
+                        },
+                        [&](const VerbatimString& v) {
+                          if (resp3) {
+                            fmt::format_to(std::back_inserter(buf),
+                                           "{}{}{}{}:{}{}",
+                                           static_cast<char>(TokenTypeMarker::VerbatimString),
+                                           VerbatimString::FormatLength + 1 + v.text.length(),
+                                           MessagePartTerminator,
+                                           v.format,
+                                           v.text,
+                                           MessagePartTerminator);
+                          } else {
+                            EncodeBulkString(buf, v.text);
+                          }
+                        },
+                        [](EndOfCommand_t /*eoc*/) {}},
+             tok);
 }
-}  // namespace redispp::resp
\ No newline at end of file
+}  // namespace redispp::resp
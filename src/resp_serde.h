@@ -5,11 +5,36 @@
 #include <boost/smart_ptr/local_shared_ptr.hpp>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <memory_resource>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 namespace redispp::resp {
-enum class TokenTypeMarker : char { SimpleString = '+', Error = '-', Integer = ':', BulkString = '$', Array = '*' };
+enum class TokenTypeMarker : char {
+  SimpleString = '+',
+  Error = '-',
+  Integer = ':',
+  BulkString = '$',
+  Array = '*',
+  // RESP3
+  Null = '_',
+  Double = ',',
+  Boolean = '#',
+  BlobError = '!',
+  VerbatimString = '=',
+  BigNumber = '(',
+  Map = '%',
+  Set = '~',
+  Push = '>'
+};
+
+// Negotiated per connection with HELLO. RESP3 only types are downgraded when encoding for RESP2 clients.
+enum class Protocol : uint8_t { Resp2 = 2, Resp3 = 3 };
 
 using Integer = std::int64_t;
 using String = std::pmr::string;
@@ -18,6 +43,8 @@ struct NullStr_t {
 } constexpr NullStr;
 struct NullArr_t {
 } constexpr NullArr;
+struct Null_t {
+} constexpr Null;
 struct EndOfCommand_t {
 } constexpr EndOfCommand;
 
@@ -25,7 +52,36 @@ struct Error {
   String msg;
 };
 
-using Token = std::variant<Integer, String, Error, NullStr_t, NullArr_t, EndOfCommand_t>;
+struct Double {
+  double value;
+};
+
+struct Boolean {
+  bool value;
+};
+
+struct BigNumber {
+  String digits;
+};
+
+struct VerbatimString {
+  static constexpr size_t FormatLength = 3;
+
+  String format;  // e.g. "txt" or "mkd"
+  String text;
+};
+
+using Token = std::variant<Integer,
+                           String,
+                           Error,
+                           NullStr_t,
+                           NullArr_t,
+                           Null_t,
+                           Double,
+                           Boolean,
+                           BigNumber,
+                           VerbatimString,
+                           EndOfCommand_t>;
 
 static constexpr std::string_view MessagePartTerminator = "\r\n";
 
@@ -34,23 +90,94 @@ concept Reader = requires(T a, char* buf, size_t len) {
   { ReadSome(a, buf, len) } -> std::same_as<boost::asio::awaitable<size_t>>;
 };
 
+// Readers that can wait for input without a buffer let idle connections give theirs back.
+template <typename T>
+concept WaitableReader = Reader<T> && requires(T a) {
+  { WaitReadable(a) } -> std::same_as<boost::asio::awaitable<void>>;
+};
+
+// Readers that can tell, without blocking, whether the peer has gone away.
+template <typename T>
+concept ClosableReader = Reader<T> && requires(T a) {
+  { PeerClosed(a) } -> std::same_as<bool>;
+};
+
 using Channel = boost::asio::experimental::channel<void(boost::system::error_code, Token)>;
 
+// Read buffers shared by connections, so that idle ones don't hold any. Not thread safe, like the rest of the server.
+class BufferPool {
+ public:
+  static constexpr size_t BufferSize = size_t{16} << 10;
+
+  // Up to `max_free` released buffers are kept for reuse; the rest go back to `alloc`.
+  explicit BufferPool(size_t max_free = DefaultMaxFree,
+                      std::pmr::memory_resource& alloc = *std::pmr::get_default_resource())
+      : m_alloc(&alloc), m_max_free(max_free) {}
+  BufferPool(const BufferPool&) = delete;
+  auto operator=(const BufferPool&) -> BufferPool& = delete;
+  ~BufferPool();
+
+  auto Acquire() -> char*;
+  void Release(char* buf) noexcept;
+
+  // Buffers handed out and not released yet.
+  [[nodiscard]] auto InUse() const noexcept -> size_t { return m_in_use; }
+
+ private:
+  static constexpr size_t DefaultMaxFree = 1024;
+
+  std::pmr::memory_resource* m_alloc;
+  size_t m_max_free;
+  size_t m_in_use = 0;
+  std::vector<char*> m_free;
+};
+
 class Deserializer {
  public:
-  explicit Deserializer(Reader auto& reader, std::pmr::memory_resource& alloc = *std::pmr::get_default_resource())
-      : m_alloc(&alloc), m_reader(&reader), m_read_some(get_reader<std::decay_t<decltype(reader)>, false>()) {}
+  // Without a pool, the deserializer allocates its own buffer and keeps it.
+  explicit Deserializer(Reader auto& reader,
+                        std::pmr::memory_resource& alloc = *std::pmr::get_default_resource(),
+                        BufferPool* pool = nullptr)
+      : m_alloc(&alloc),
+        m_pool(pool),
+        m_reader(&reader),
+        m_read_some(get_reader<std::decay_t<decltype(reader)>, false>()),
+        m_wait_readable(get_waiter<std::decay_t<decltype(reader)>, false>()),
+        m_peer_closed(get_closed_check<std::decay_t<decltype(reader)>, false>()) {}
 
-  explicit Deserializer(const Reader auto& reader, std::pmr::memory_resource& alloc = *std::pmr::get_default_resource())
+  explicit Deserializer(const Reader auto& reader,
+                        std::pmr::memory_resource& alloc = *std::pmr::get_default_resource(),
+                        BufferPool* pool = nullptr)
       : m_alloc(&alloc),
+        m_pool(pool),
         m_reader(
             const_cast<void*>(static_const<const void*>(&reader))),  // NOLINT(cppcoreguidelines-pro-type-const-cast)
-        m_read_some(get_reader<std::decay_t<decltype(reader)>, true>()) {}
+        m_read_some(get_reader<std::decay_t<decltype(reader)>, true>()),
+        m_wait_readable(get_waiter<std::decay_t<decltype(reader)>, true>()),
+        m_peer_closed(get_closed_check<std::decay_t<decltype(reader)>, true>()) {}
+
+  Deserializer(const Deserializer&) = delete;
+  auto operator=(const Deserializer&) -> Deserializer& = delete;
+  ~Deserializer();
 
   auto SendTokens(boost::local_shared_ptr<Channel> ch) -> boost::asio::awaitable<void>;
 
+  // Waits until there's input to parse, and takes a buffer for it. Idle connections wait here rather than in the middle
+  // of a command, so they hold no buffer, channel or parsing coroutine.
+  auto WaitForInput() -> boost::asio::awaitable<void>;
+
+  // Bytes received but not parsed yet, e.g. pipelined commands.
+  [[nodiscard]] auto Buffered() const noexcept -> size_t { return m_buflen; }
+  [[nodiscard]] auto HasBuffer() const noexcept -> bool { return m_mem != nullptr; }
+
+  // Whether the peer has closed the connection, for clients that are waiting rather than reading, e.g. blocked ones.
+  // Always false for readers that can't tell.
+  [[nodiscard]] auto InputClosed() const -> bool { return m_peer_closed != nullptr && m_peer_closed(m_reader); }
+
  private:
   using read_some_t = boost::asio::awaitable<size_t> (*)(void* reader, char* buf, size_t len);
+  using wait_readable_t = boost::asio::awaitable<void> (*)(void* reader);
+  using peer_closed_t = bool (*)(void* reader);
 
   template <Reader Reader, bool IsConst>
   static constexpr auto get_reader() noexcept -> read_some_t {
@@ -63,6 +190,36 @@ class Deserializer {
     };
   }
 
+  template <Reader Reader, bool IsConst>
+  static constexpr auto get_waiter() noexcept -> wait_readable_t {
+    if constexpr (!WaitableReader<Reader>) {
+      return nullptr;
+    } else {
+      return [](void* reader) {
+        if constexpr (IsConst) {
+          return WaitReadable(*static_cast<const Reader*>(reader));
+        } else {
+          return WaitReadable(*static_cast<Reader*>(reader));
+        }
+      };
+    }
+  }
+
+  template <Reader Reader, bool IsConst>
+  static constexpr auto get_closed_check() noexcept -> peer_closed_t {
+    if constexpr (!ClosableReader<Reader>) {
+      return nullptr;
+    } else {
+      return [](void* reader) {
+        if constexpr (IsConst) {
+          return PeerClosed(*static_cast<const Reader*>(reader));
+        } else {
+          return PeerClosed(*static_cast<Reader*>(reader));
+        }
+      };
+    }
+  }
+
   auto send_token(Token tok, Channel& ch) -> boost::asio::awaitable<void>;
   auto send_inline_tokens(Channel& ch) -> boost::asio::awaitable<void>;
 
@@ -73,20 +230,46 @@ class Deserializer {
   auto dser_any() -> boost::asio::awaitable<String>;
   auto dser_integer() -> boost::asio::awaitable<Integer>;
 
-  auto read_some() -> boost::asio::awaitable<void>;
+  // Waits until at least `min_len` bytes are buffered. Two by default, so that a terminator split across reads is seen
+  // whole.
+  auto read_some(size_t min_len = MessagePartTerminator.length()) -> boost::asio::awaitable<void>;
   auto copy_some(char* buf, size_t len) -> size_t;
+  auto read_direct(char* buf, size_t len) -> boost::asio::awaitable<void>;
+
+  // The buffer is only held while there's input to parse.
+  auto acquire_buffer() -> boost::asio::awaitable<void>;
+  void release_buffer() noexcept;
 
-  static constexpr auto BufferSize = 1024;
+  static constexpr auto BufferSize = BufferPool::BufferSize;
   static_assert(BufferSize >= MessagePartTerminator.size());
+  // Bulk strings with at least this much left to read are read straight into place, bypassing `m_mem`.
+  static constexpr size_t DirectReadSize = BufferSize;
+  // Limits on what a peer can make us allocate, as in Redis: bulk strings, lines (inline commands, simple strings and
+  // numbers) and aggregates.
+  static constexpr ptrdiff_t MaxBulkLength = ptrdiff_t{512} << 20;
+  static constexpr size_t MaxLineLength = size_t{64} << 10;
+  static constexpr Integer MaxAggregateLength = std::numeric_limits<int32_t>::max();
 
   std::pmr::memory_resource* m_alloc;
-  std::array<char, BufferSize> m_mem{};
+  BufferPool* m_pool;
+  char* m_mem = nullptr;
   size_t m_cursor = 0;
   size_t m_buflen = 0;
   void* m_reader = nullptr;
   read_some_t m_read_some = nullptr;
+  wait_readable_t m_wait_readable = nullptr;
+  peer_closed_t m_peer_closed = nullptr;
 };
 
+// Synchronous encoding into an in-memory buffer, for frames that are built once and written to many clients.
+void EncodeArrayHeader(std::string& buf, size_t elem_count);
+// `type` is one of the aggregate markers; for maps `elem_count` is the number of key/value pairs.
+void EncodeAggregateHeader(std::string& buf, TokenTypeMarker type, size_t elem_count, Protocol proto);
+void EncodeBulkString(std::string& buf, std::string_view str);
+// "$<len>\r\n", for bulk strings whose payload is written separately.
+void EncodeBulkStringHeader(std::string& buf, size_t len);
+void Encode(std::string& buf, const Token& tok, Protocol proto = Protocol::Resp2);
+
 template <typename T>
 concept Writer = requires(T a, const char* buf, size_t len) {
   { Write(a, buf, len) } -> std::same_as<boost::asio::awaitable<void>>;
@@ -102,22 +285,23 @@ class Serializer {
             const_cast<void*>(static_cast<const void*>(&writer))),  // NOLINT(cppcoreguidelines-pro-type-const-cast)
         m_write(get_writer<std::decay_t<decltype(writer)>, true>()) {}
 
+  void SetProtocol(Protocol proto) noexcept { m_protocol = proto; }
+
   auto SerializeArrayHeader(size_t elem_count) -> boost::asio::awaitable<void>;
+  auto SerializeAggregateHeader(TokenTypeMarker type, size_t elem_count) -> boost::asio::awaitable<void>;
   auto SerializeNullArray(NullArr_t) -> boost::asio::awaitable<void>;
 
   auto Serialize(const Token& tok) -> boost::asio::awaitable<void>;
+  // Writes `str` from where it is, e.g. a large value that shouldn't be copied.
+  auto SerializeBulkString(std::string_view str) -> boost::asio::awaitable<void>;
 
  private:
   using write_t = boost::asio::awaitable<void> (*)(void* writer, const char* buf, size_t len);
 
-  auto serialize(Integer i) -> boost::asio::awaitable<void>;
   auto serialize_simple_string(const String& s) -> boost::asio::awaitable<void>;
-  auto serialize(const Error& err) -> boost::asio::awaitable<void>;
 
-  auto serialize(const String& s) -> boost::asio::awaitable<void>;
-  auto serialize(NullStr_t) -> boost::asio::awaitable<void>;
-  auto serialize(NullArr_t) -> boost::asio::awaitable<void>;
-  static auto serialize(EndOfCommand_t /*eoc*/) noexcept -> boost::asio::awaitable<void> { co_return; }
+  // Small tokens are encoded in memory and written at once.
+  auto serialize_encoded(const Token& tok) -> boost::asio::awaitable<void>;
 
   auto write(const char* buf, size_t len) -> boost::asio::awaitable<void> { return m_write(m_writer, buf, len); }
 
@@ -134,6 +318,7 @@ class Serializer {
 
   void* m_writer = nullptr;
   write_t m_write = nullptr;
+  Protocol m_protocol = Protocol::Resp2;
 };
 
 }  // namespace redispp::resp
\ No newline at end of file
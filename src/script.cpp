@@ -0,0 +1,539 @@
+#include "script.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <limits>
+#include <optional>
+
+#include "db.h"
+
+namespace redispp::script {
+using resp::Integer;
+using resp::String;
+
+static constexpr size_t MaxDepth = 128;
+static constexpr uint32_t Variadic = std::numeric_limits<uint32_t>::max();
+
+class Program::Compiler {
+ public:
+  Compiler(std::string_view source, CommandResolver resolver) : m_source(source), m_resolver(resolver) {}
+
+  auto Compile() -> Program {
+    // The top level is an implicit `do`.
+    std::vector<uint32_t> children;
+    while (peek() != '\0') {
+      children.push_back(expr(0));
+    }
+    if (children.empty()) {
+      throw ScriptError("SCRIPT_ERROR Empty script");
+    }
+
+    m_program.m_root = add(Node{.op = Op::Do}, children);
+    m_program.m_locals = static_cast<uint32_t>(m_locals.size());
+    return std::move(m_program);
+  }
+
+ private:
+  struct Form {
+    std::string_view name;
+    Op op;
+    uint32_t min_args;
+    uint32_t max_args;
+  };
+
+  static constexpr std::array Forms = {Form{"do", Op::Do, 1, Variadic},
+                                       Form{"if", Op::If, 2, 3},
+                                       Form{"and", Op::And, 1, Variadic},
+                                       Form{"or", Op::Or, 1, Variadic},
+                                       Form{"not", Op::Not, 1, 1},
+                                       Form{"==", Op::Eq, 2, 2},
+                                       Form{"!=", Op::Ne, 2, 2},
+                                       Form{"<", Op::Lt, 2, 2},
+                                       Form{"<=", Op::Le, 2, 2},
+                                       Form{">", Op::Gt, 2, 2},
+                                       Form{">=", Op::Ge, 2, 2},
+                                       Form{"+", Op::Add, 1, Variadic},
+                                       Form{"-", Op::Sub, 1, Variadic},
+                                       Form{"*", Op::Mul, 1, Variadic},
+                                       Form{"/", Op::Div, 2, 2},
+                                       Form{"%", Op::Mod, 2, 2},
+                                       Form{"concat", Op::Concat, 1, Variadic},
+                                       Form{"len", Op::Len, 1, 1},
+                                       Form{"int", Op::ToInt, 1, 1},
+                                       Form{"str", Op::ToStr, 1, 1},
+                                       Form{"error", Op::Raise, 1, 1}};
+
+  [[noreturn]] void fail(std::string_view what) const {
+    throw ScriptError(fmt::format("SCRIPT_ERROR {} at offset {}", what, m_pos));
+  }
+
+  // Skips whitespace and `;` comments, returns the next character or '\0' at the end.
+  auto peek() -> char {
+    while (m_pos < m_source.size()) {
+      if (std::isspace(static_cast<unsigned char>(m_source[m_pos])) != 0) {
+        m_pos++;
+      } else if (m_source[m_pos] == ';') {
+        m_pos = std::min(m_source.find('\n', m_pos), m_source.size());
+      } else {
+        return m_source[m_pos];
+      }
+    }
+    return '\0';
+  }
+
+  void expect(char c) {
+    if (peek() != c) {
+      fail(fmt::format("Expected '{}'", c));
+    }
+    m_pos++;
+  }
+
+  auto atom() -> std::string_view {
+    peek();
+    const auto start = m_pos;
+    while (m_pos < m_source.size() && std::isspace(static_cast<unsigned char>(m_source[m_pos])) == 0 &&
+           m_source[m_pos] != '(' && m_source[m_pos] != ')' && m_source[m_pos] != '"' && m_source[m_pos] != ';') {
+      m_pos++;
+    }
+    if (start == m_pos) {
+      fail("Expected a name");
+    }
+    return m_source.substr(start, m_pos - start);
+  }
+
+  auto string_literal() -> String {
+    expect('"');
+    String str;
+    for (;;) {
+      if (m_pos == m_source.size()) {
+        fail("Unterminated string");
+      }
+      auto c = m_source[m_pos++];
+      if (c == '"') {
+        return str;
+      }
+      if (c == '\\' && m_pos < m_source.size()) {
+        c = m_source[m_pos++];
+        c = c == 'n' ? '\n' : c == 'r' ? '\r' : c == 't' ? '\t' : c;
+      }
+      str.push_back(c);
+    }
+  }
+
+  static auto integer_literal(std::string_view atom) -> std::optional<Integer> {
+    Integer i = 0;
+    auto res = std::from_chars(atom.begin(), atom.end(), i);
+    if (res.ec != std::errc{} || res.ptr != atom.end()) {
+      return {};
+    }
+    return i;
+  }
+
+  auto add(Node node, const std::vector<uint32_t> &children = {}) -> uint32_t {
+    node.first = static_cast<uint32_t>(m_program.m_children.size());
+    node.count = static_cast<uint32_t>(children.size());
+    m_program.m_children.insert(m_program.m_children.end(), children.begin(), children.end());
+    m_program.m_nodes.push_back(node);
+    return static_cast<uint32_t>(m_program.m_nodes.size() - 1);
+  }
+
+  auto constant(Value val) -> uint32_t {
+    m_program.m_constants.push_back(std::move(val));
+    return add(Node{.op = Op::Const, .index = static_cast<uint32_t>(m_program.m_constants.size() - 1)});
+  }
+
+  auto expr(size_t depth) -> uint32_t {
+    if (depth == MaxDepth) {
+      fail("Too deeply nested");
+    }
+
+    switch (peek()) {
+      case '\0':
+        fail("Unexpected end of script");
+      case ')':
+        fail("Unexpected ')'");
+      case '"':
+        return constant(string_literal());
+      case '(':
+        m_pos++;
+        return form(depth);
+      default:
+        break;
+    }
+
+    const auto name = atom();
+    if (auto i = integer_literal(name)) {
+      return constant(*i);
+    }
+    if (name == "nil") {
+      return constant(resp::NullStr);
+    }
+    auto local = std::find(m_locals.begin(), m_locals.end(), name);
+    if (local == m_locals.end()) {
+      fail(fmt::format("Unknown variable '{}'", name));
+    }
+    return add(Node{.op = Op::Local, .index = static_cast<uint32_t>(local - m_locals.begin())});
+  }
+
+  auto position() -> uint32_t {
+    auto i = integer_literal(atom());
+    if (!i || *i < 1 || *i > Integer(Variadic)) {
+      fail("Expected a position starting at 1");
+    }
+    return static_cast<uint32_t>(*i - 1);
+  }
+
+  auto form(size_t depth) -> uint32_t {
+    const auto name = atom();
+    uint32_t id = 0;
+
+    if (name == "key" || name == "arg") {
+      id = add(Node{.op = name == "key" ? Op::Key : Op::Arg, .index = position()});
+    } else if (name == "let") {
+      const auto var = atom();
+      std::vector<uint32_t> value{expr(depth + 1)};
+      auto slot = std::find(m_locals.begin(), m_locals.end(), var) - m_locals.begin();
+      if (slot == std::ssize(m_locals)) {
+        m_locals.push_back(var);
+      }
+      id = add(Node{.op = Op::Let, .index = static_cast<uint32_t>(slot)}, value);
+    } else if (name == "call" || name == "pcall") {
+      // Commands are resolved once, here, rather than on every run.
+      std::string command(peek() == '"' ? std::string_view(string_literal()) : atom());
+      std::transform(command.begin(), command.end(), command.begin(), [](unsigned char c) { return std::toupper(c); });
+      const auto func = m_resolver(command);
+      if (func == nullptr) {
+        fail(fmt::format("Unknown command or not allowed in scripts '{}'", command));
+      }
+      return add(Node{.op = name == "call" ? Op::Call : Op::PCall, .command = func}, args(depth));
+    } else {
+      auto it = std::find_if(Forms.begin(), Forms.end(), [&](const auto &f) { return f.name == name; });
+      if (it == Forms.end()) {
+        fail(fmt::format("Unknown form '{}'", name));
+      }
+      auto children = args(depth);
+      if (children.size() < it->min_args || children.size() > it->max_args) {
+        fail(fmt::format("Wrong number of arguments to '{}'", name));
+      }
+      return add(Node{.op = it->op}, children);
+    }
+
+    expect(')');
+    return id;
+  }
+
+  // Arguments up to and including the closing parenthesis.
+  auto args(size_t depth) -> std::vector<uint32_t> {
+    std::vector<uint32_t> children;
+    while (peek() != ')') {
+      children.push_back(expr(depth + 1));
+    }
+    m_pos++;
+    return children;
+  }
+
+  std::string_view m_source;
+  size_t m_pos = 0;
+  CommandResolver m_resolver;
+  std::vector<std::string_view> m_locals;
+  Program m_program;
+};
+
+auto Program::Compile(std::string_view source, CommandResolver resolver) -> Program {
+  return Compiler(source, resolver).Compile();
+}
+
+struct Program::Frame {
+  DB &db;
+  Client &client;
+  std::span<const String> keys;
+  std::span<const String> args;
+  std::vector<Value> locals;
+};
+
+static auto is_nil(const Value &val) noexcept -> bool {
+  return std::holds_alternative<resp::NullStr_t>(val) || std::holds_alternative<resp::Null_t>(val);
+}
+
+// nil and 0 are false, everything else is true.
+static auto truthy(const Value &val) noexcept -> bool {
+  if (const auto *i = std::get_if<Integer>(&val)) {
+    return *i != 0;
+  }
+  return !is_nil(val);
+}
+
+static auto to_integer(const Value &val) -> Integer {
+  if (const auto *i = std::get_if<Integer>(&val)) {
+    return *i;
+  }
+  if (const auto *s = std::get_if<String>(&val)) {
+    Integer i = 0;
+    auto res = std::from_chars(s->data(), s->data() + s->size(), i);
+    if (res.ec == std::errc{} && res.ptr == s->data() + s->size()) {
+      return i;
+    }
+  }
+  throw ScriptError("SCRIPT_ERROR Value is not an integer");
+}
+
+static auto to_string(DB &db, const Value &val) -> String {
+  if (const auto *s = std::get_if<String>(&val)) {
+    return *s;
+  }
+  if (const auto *i = std::get_if<Integer>(&val)) {
+    return db.NewString(fmt::format("{}", *i));
+  }
+  throw ScriptError("SCRIPT_ERROR Value is not a string");
+}
+
+static auto equal(DB &db, const Value &lhs, const Value &rhs) -> bool {
+  if (is_nil(lhs) || is_nil(rhs)) {
+    return is_nil(lhs) && is_nil(rhs);
+  }
+  if (std::holds_alternative<Integer>(lhs) && std::holds_alternative<Integer>(rhs)) {
+    return std::get<Integer>(lhs) == std::get<Integer>(rhs);
+  }
+  if (std::holds_alternative<resp::Error>(lhs) || std::holds_alternative<resp::Error>(rhs)) {
+    return false;
+  }
+  return to_string(db, lhs) == to_string(db, rhs);
+}
+
+auto Program::eval(uint32_t id, Frame &frame) const -> Value {
+  const auto &node = m_nodes[id];
+  auto arg = [&](uint32_t i) { return eval(child(node, i), frame); };
+  auto arg_int = [&](uint32_t i) { return to_integer(arg(i)); };
+
+  auto fold = [&](auto op) {
+    auto acc = arg_int(0);
+    for (uint32_t i = 1; i < node.count; i++) {
+      if (op(acc, arg_int(i), &acc)) {
+        throw ScriptError("SCRIPT_ERROR Integer overflow");
+      }
+    }
+    return Value(acc);
+  };
+
+  auto compare = [&](auto cmp) { return Value(Integer(cmp(arg_int(0), arg_int(1)) ? 1 : 0)); };
+
+  switch (node.op) {
+    case Op::Const:
+      return m_constants[node.index];
+
+    case Op::Key:
+    case Op::Arg: {
+      const auto &list = node.op == Op::Key ? frame.keys : frame.args;
+      if (node.index >= list.size()) {
+        return resp::NullStr;
+      }
+      return list[node.index];
+    }
+
+    case Op::Local:
+      return frame.locals[node.index];
+
+    case Op::Let:
+      return frame.locals[node.index] = arg(0);
+
+    case Op::Call:
+    case Op::PCall: {
+      std::vector<resp::Token> args;
+      args.reserve(node.count);
+      for (uint32_t i = 0; i < node.count; i++) {
+        // Commands get their arguments the way clients send them, as strings.
+        args.emplace_back(to_string(frame.db, arg(i)));
+      }
+      auto reply = node.command(frame.db, frame.client, std::move(args));
+      if (const auto *err = std::get_if<resp::Error>(&reply); err != nullptr && node.op == Op::Call) {
+        throw ScriptError(std::string(err->msg));
+      }
+      return reply;
+    }
+
+    case Op::Raise:
+      throw ScriptError(std::string(to_string(frame.db, arg(0))));
+
+    case Op::Do: {
+      Value val;
+      for (uint32_t i = 0; i < node.count; i++) {
+        val = arg(i);
+      }
+      return val;
+    }
+
+    case Op::If:
+      if (truthy(arg(0))) {
+        return arg(1);
+      }
+      return node.count == 3 ? arg(2) : Value(resp::NullStr);
+
+    case Op::And:
+    case Op::Or: {
+      // Short-circuits, returning the deciding value.
+      Value val;
+      for (uint32_t i = 0; i < node.count; i++) {
+        val = arg(i);
+        if (truthy(val) == (node.op == Op::Or)) {
+          break;
+        }
+      }
+      return val;
+    }
+
+    case Op::Not:
+      return Integer(truthy(arg(0)) ? 0 : 1);
+
+    case Op::Eq:
+    case Op::Ne:
+      return Integer(equal(frame.db, arg(0), arg(1)) == (node.op == Op::Eq) ? 1 : 0);
+
+    case Op::Lt:
+      return compare(std::less<>{});
+    case Op::Le:
+      return compare(std::less_equal<>{});
+    case Op::Gt:
+      return compare(std::greater<>{});
+    case Op::Ge:
+      return compare(std::greater_equal<>{});
+
+    case Op::Add:
+      return fold([](Integer a, Integer b, Integer *res) { return __builtin_add_overflow(a, b, res); });
+    case Op::Sub:
+      if (node.count == 1) {
+        Integer res = 0;
+        if (__builtin_sub_overflow(Integer(0), arg_int(0), &res)) {
+          throw ScriptError("SCRIPT_ERROR Integer overflow");
+        }
+        return res;
+      }
+      return fold([](Integer a, Integer b, Integer *res) { return __builtin_sub_overflow(a, b, res); });
+    case Op::Mul:
+      return fold([](Integer a, Integer b, Integer *res) { return __builtin_mul_overflow(a, b, res); });
+
+    case Op::Div:
+    case Op::Mod: {
+      const auto lhs = arg_int(0);
+      const auto rhs = arg_int(1);
+      if (rhs == 0 || (lhs == std::numeric_limits<Integer>::min() && rhs == -1)) {
+        throw ScriptError("SCRIPT_ERROR Division by zero or overflow");
+      }
+      return node.op == Op::Div ? lhs / rhs : lhs % rhs;
+    }
+
+    case Op::Concat: {
+      auto str = frame.db.NewString();
+      for (uint32_t i = 0; i < node.count; i++) {
+        str += to_string(frame.db, arg(i));
+      }
+      return str;
+    }
+
+    case Op::Len:
+      return Integer(to_string(frame.db, arg(0)).size());
+    case Op::ToInt:
+      return to_integer(arg(0));
+    case Op::ToStr:
+      return to_string(frame.db, arg(0));
+  }
+  return resp::NullStr;
+}
+
+auto Program::Run(DB &db, Client &client, std::span<const String> keys, std::span<const String> args) const -> Value {
+  Frame frame{db, client, keys, args, std::vector<Value>(m_locals, Value(resp::NullStr))};
+  return eval(m_root, frame);
+}
+
+// FIPS 180-4.
+auto Sha1Hex(std::string_view data) -> std::string {
+  std::array<uint32_t, 5> h = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+  auto process = [&](const unsigned char *block) {
+    std::array<uint32_t, 80> w{};
+    for (size_t i = 0; i < 16; i++) {
+      w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16 | uint32_t(block[i * 4 + 2]) << 8 |
+             uint32_t(block[i * 4 + 3]);
+    }
+    for (size_t i = 16; i < 80; i++) {
+      w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    auto [a, b, c, d, e] = h;
+    for (size_t i = 0; i < 80; i++) {
+      uint32_t f = 0;
+      uint32_t k = 0;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      const auto temp = std::rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = std::rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  };
+
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+  size_t full = data.size() / 64 * 64;
+  for (size_t i = 0; i < full; i += 64) {
+    process(bytes + i);
+  }
+
+  // The tail, 0x80 and the length in bits take one or two more blocks.
+  std::array<unsigned char, 128> tail{};
+  const auto rest = data.size() - full;
+  std::copy_n(bytes + full, rest, tail.begin());
+  tail[rest] = 0x80;
+  const size_t tail_len = rest + 9 <= 64 ? 64 : 128;
+  const uint64_t bits = uint64_t(data.size()) * 8;
+  for (size_t i = 0; i < 8; i++) {
+    tail[tail_len - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+  }
+  for (size_t i = 0; i < tail_len; i += 64) {
+    process(tail.data() + i);
+  }
+
+  std::string hex;
+  for (auto word : h) {
+    fmt::format_to(std::back_inserter(hex), "{:08x}", word);
+  }
+  return hex;
+}
+
+auto Cache::Load(std::string_view source, CommandResolver resolver) -> std::pair<std::string, const Program *> {
+  auto sha = Sha1Hex(source);
+  auto it = m_programs.find(std::string_view(sha));
+  if (it == m_programs.end()) {
+    it = m_programs
+             .emplace(resp::String(sha, m_programs.get_allocator().resource()), Program::Compile(source, resolver))
+             .first;
+  }
+  return {std::move(sha), &it->second};
+}
+
+auto Cache::Find(std::string_view sha) const -> const Program * {
+  auto it = m_programs.find(sha);
+  return it == m_programs.end() ? nullptr : &it->second;
+}
+}  // namespace redispp::script
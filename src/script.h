@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "resp_serde.h"
+#include "string_hash.h"
+
+namespace redispp {
+class Client;
+class DB;
+
+namespace script {
+// Scripts compute with reply tokens: integers, strings, errors and nil.
+using Value = resp::Token;
+
+// A command resolved when the script is compiled; called with the evaluated arguments, it returns the reply.
+using CommandFunc = auto (*)(DB &db, Client &client, std::vector<resp::Token> args) -> Value;
+// Returns nullptr for commands that scripts may not call.
+using CommandResolver = auto (*)(std::string_view name) -> CommandFunc;
+
+// Compile errors, runtime errors and the error replies raised by `call`. The message is the error reply.
+class ScriptError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// A script in the built-in expression language, compiled to a tree of nodes. E.g. compare-and-set:
+//   (if (== (call GET (key 1)) (arg 1)) (call SET (key 1) (arg 2)) 0)
+// There are no loops, so every script terminates. Nothing else runs until it returns, which makes it atomic.
+class Program {
+ public:
+  static auto Compile(std::string_view source, CommandResolver resolver) -> Program;
+
+  auto Run(DB &db, Client &client, std::span<const resp::String> keys, std::span<const resp::String> args) const
+      -> Value;
+
+ private:
+  class Compiler;
+  struct Frame;
+
+  enum class Op : uint8_t {
+    Const,
+    Key,
+    Arg,
+    Local,
+    Let,
+    Call,
+    PCall,
+    Raise,
+    Do,
+    If,
+    And,
+    Or,
+    Not,
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Mod,
+    Concat,
+    Len,
+    ToInt,
+    ToStr
+  };
+
+  struct Node {
+    Op op;
+    uint32_t index = 0;  // Const: constant, Key/Arg: 0 based position, Local/Let: variable slot
+    uint32_t first = 0;  // Children are m_children[first, first + count)
+    uint32_t count = 0;
+    CommandFunc command = nullptr;
+  };
+
+  auto eval(uint32_t id, Frame &frame) const -> Value;
+  [[nodiscard]] auto child(const Node &node, uint32_t i) const noexcept -> uint32_t {
+    return m_children[node.first + i];
+  }
+
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_children;
+  std::vector<Value> m_constants;
+  uint32_t m_locals = 0;
+  uint32_t m_root = 0;
+};
+
+// Lowercase hex SHA1 digest, the name of a script for EVALSHA.
+auto Sha1Hex(std::string_view data) -> std::string;
+
+// Compiled scripts by SHA1, so that repeated EVAL and EVALSHA calls skip compilation.
+class Cache {
+ public:
+  explicit Cache(std::pmr::memory_resource &alloc) : m_programs(&alloc) {}
+
+  // Compiles the script unless it's already cached. Returns the script SHA1 and the program.
+  auto Load(std::string_view source, CommandResolver resolver) -> std::pair<std::string, const Program *>;
+  [[nodiscard]] auto Find(std::string_view sha) const -> const Program *;
+  void Flush() noexcept { m_programs.clear(); }
+
+ private:
+  std::pmr::unordered_map<resp::String, Program, utils::string_hash, std::equal_to<>> m_programs;
+};
+}  // namespace script
+}  // namespace redispp
@@ -0,0 +1,418 @@
+#include "sorted_set.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace redispp::zset {
+static auto less(const Element &lhs, const Element &rhs) noexcept -> bool {
+  if (lhs.score != rhs.score) {
+    return lhs.score < rhs.score;
+  }
+  return *lhs.member < *rhs.member;
+}
+
+static auto same(const Element &lhs, const Element &rhs) noexcept -> bool { return lhs.member == rhs.member; }
+
+// Shifts [pos, size) of `arr` one slot right and writes `val` at `pos`.
+template <typename Array, typename T>
+static void insert_at(Array &arr, size_t size, size_t pos, T val) noexcept {
+  std::move_backward(arr.begin() + pos, arr.begin() + size, arr.begin() + size + 1);
+  arr[pos] = val;
+}
+
+template <typename Array>
+static void erase_at(Array &arr, size_t size, size_t pos) noexcept {
+  std::move(arr.begin() + pos + 1, arr.begin() + size, arr.begin() + pos);
+}
+
+ScoreTree::~ScoreTree() {
+  if (m_root != nullptr) {
+    destroy(m_root);
+  }
+}
+
+auto ScoreTree::new_leaf() -> Leaf * {
+  auto *leaf = m_alloc.new_object<Leaf>();
+  leaf->leaf = true;
+  return leaf;
+}
+
+auto ScoreTree::new_inner() -> Inner * {
+  auto *inner = m_alloc.new_object<Inner>();
+  inner->leaf = false;
+  return inner;
+}
+
+void ScoreTree::destroy(Node *node) noexcept {
+  if (node->leaf) {
+    m_alloc.delete_object(static_cast<Leaf *>(node));
+    return;
+  }
+  auto *inner = static_cast<Inner *>(node);
+  for (size_t i = 0; i < inner->size; i++) {
+    destroy(inner->children[i]);
+  }
+  m_alloc.delete_object(inner);
+}
+
+void ScoreTree::Insert(Element element) {
+  m_size++;
+  if (m_root == nullptr) {
+    auto *leaf = new_leaf();
+    leaf->elements[0] = element;
+    leaf->size = 1;
+    m_root = leaf;
+    return;
+  }
+
+  Path path;
+  size_t depth = 0;
+  Node *node = m_root;
+  while (!node->leaf) {
+    auto *inner = static_cast<Inner *>(node);
+    const auto keys = inner->keys.begin();
+    const auto child = size_t(std::upper_bound(keys, keys + inner->size - 1, element, less) - keys);
+    inner->counts[child]++;
+    path[depth++] = {inner, child};
+    node = inner->children[child];
+  }
+
+  auto &leaf = *static_cast<Leaf *>(node);
+  const auto begin = leaf.elements.begin();
+  const auto pos = size_t(std::lower_bound(begin, begin + leaf.size, element, less) - begin);
+  if (leaf.size < LeafCapacity) {
+    insert_at(leaf.elements, leaf.size, pos, element);
+    leaf.size++;
+    return;
+  }
+
+  // Splits go up the path as long as they fill the parents up.
+  Node *right = split(leaf, pos, element);
+  size_t right_count = right->size;
+  Element key = static_cast<Leaf *>(right)->elements[0];
+  while (right != nullptr && depth != 0) {
+    auto [parent, child] = path[--depth];
+    parent->counts[child] -= right_count;
+    auto *split_parent = insert_child(*parent, child, right, right_count, key);
+    if (split_parent != nullptr) {
+      right_count = 0;
+      for (size_t i = 0; i < split_parent->size; i++) {
+        right_count += split_parent->counts[i];
+      }
+    }
+    right = split_parent;
+  }
+
+  if (right != nullptr) {
+    auto *root = new_inner();
+    root->children[0] = m_root;
+    root->children[1] = right;
+    root->counts[0] = m_size - right_count;
+    root->counts[1] = right_count;
+    root->keys[0] = key;
+    root->size = 2;
+    m_root = root;
+  }
+}
+
+auto ScoreTree::split(Leaf &leaf, size_t pos, Element element) -> Leaf * {
+  std::array<Element, LeafCapacity + 1> all;
+  std::copy(leaf.elements.begin(), leaf.elements.end(), all.begin());
+  insert_at(all, LeafCapacity, pos, element);
+
+  auto *right = new_leaf();
+  const size_t half = (LeafCapacity + 1) / 2;
+  std::copy(all.begin(), all.begin() + half, leaf.elements.begin());
+  std::copy(all.begin() + half, all.end(), right->elements.begin());
+  leaf.size = half;
+  right->size = LeafCapacity + 1 - half;
+
+  right->prev = &leaf;
+  right->next = leaf.next;
+  if (leaf.next != nullptr) {
+    leaf.next->prev = right;
+  }
+  leaf.next = right;
+  return right;
+}
+
+auto ScoreTree::insert_child(Inner &parent, size_t index, Node *child, size_t count, Element &key) -> Inner * {
+  if (parent.size < Fanout) {
+    insert_at(parent.children, parent.size, index + 1, child);
+    insert_at(parent.counts, parent.size, index + 1, count);
+    insert_at(parent.keys, parent.size - 1, index, key);
+    parent.size++;
+    return nullptr;
+  }
+
+  std::array<Node *, Fanout + 1> children;
+  std::array<size_t, Fanout + 1> counts;
+  std::array<Element, Fanout> keys;
+  std::copy(parent.children.begin(), parent.children.end(), children.begin());
+  std::copy(parent.counts.begin(), parent.counts.end(), counts.begin());
+  std::copy(parent.keys.begin(), parent.keys.end(), keys.begin());
+  insert_at(children, Fanout, index + 1, child);
+  insert_at(counts, Fanout, index + 1, count);
+  insert_at(keys, Fanout - 1, index, key);
+
+  // The key between the halves moves up instead of staying in either.
+  auto *right = new_inner();
+  const size_t half = (Fanout + 1) / 2;
+  std::copy(children.begin(), children.begin() + half, parent.children.begin());
+  std::copy(counts.begin(), counts.begin() + half, parent.counts.begin());
+  std::copy(keys.begin(), keys.begin() + half - 1, parent.keys.begin());
+  std::copy(children.begin() + half, children.end(), right->children.begin());
+  std::copy(counts.begin() + half, counts.end(), right->counts.begin());
+  std::copy(keys.begin() + half, keys.end(), right->keys.begin());
+  parent.size = half;
+  right->size = Fanout + 1 - half;
+  key = keys[half - 1];
+  return right;
+}
+
+void ScoreTree::Erase(Element element) noexcept {
+  Path path;
+  size_t depth = 0;
+  Node *node = m_root;
+  while (!node->leaf) {
+    auto *inner = static_cast<Inner *>(node);
+    const auto keys = inner->keys.begin();
+    const auto child = size_t(std::upper_bound(keys, keys + inner->size - 1, element, less) - keys);
+    inner->counts[child]--;
+    path[depth++] = {inner, child};
+    node = inner->children[child];
+  }
+
+  auto &leaf = *static_cast<Leaf *>(node);
+  const auto begin = leaf.elements.begin();
+  const auto pos = size_t(std::lower_bound(begin, begin + leaf.size, element, less) - begin);
+
+  // The first element of a leaf may be the key in front of a subtree: the next element takes its place. When there's
+  // none, the leaf is the last one and the key goes away with it, when the leaf is merged.
+  if (pos == 0) {
+    const Element *next = leaf.size > 1 ? &leaf.elements[1] : leaf.next != nullptr ? &leaf.next->elements[0] : nullptr;
+    for (size_t i = 0; i < depth && next != nullptr; i++) {
+      auto [inner, child] = path[i];
+      if (child != 0 && same(inner->keys[child - 1], element)) {
+        inner->keys[child - 1] = *next;
+      }
+    }
+  }
+  erase_at(leaf.elements, leaf.size, pos);
+  leaf.size--;
+  m_size--;
+
+  for (Node *child = node; depth != 0; child = path[depth].node) {
+    auto [parent, index] = path[--depth];
+    const auto min_size = child->leaf ? LeafCapacity / 2 : Fanout / 2;
+    if (child->size >= min_size) {
+      break;
+    }
+    rebalance(*parent, index == 0 ? 0 : index - 1);
+  }
+
+  // The root is a leaf while it holds few enough elements, and is gone when there's none.
+  if (m_root->leaf && m_root->size == 0) {
+    destroy(m_root);
+    m_root = nullptr;
+  } else if (!m_root->leaf && m_root->size == 1) {
+    auto *root = static_cast<Inner *>(m_root);
+    m_root = root->children[0];
+    m_alloc.delete_object(root);
+  }
+}
+
+void ScoreTree::rebalance(Inner &parent, size_t index) noexcept {
+  auto *left_node = parent.children[index];
+  auto *right_node = parent.children[index + 1];
+  const auto capacity = left_node->leaf ? LeafCapacity : Fanout;
+
+  if (left_node->size + right_node->size <= capacity) {
+    if (left_node->leaf) {
+      auto &left = *static_cast<Leaf *>(left_node);
+      auto &right = *static_cast<Leaf *>(right_node);
+      std::copy(right.elements.begin(), right.elements.begin() + right.size, left.elements.begin() + left.size);
+      left.next = right.next;
+      if (right.next != nullptr) {
+        right.next->prev = &left;
+      }
+    } else {
+      auto &left = *static_cast<Inner *>(left_node);
+      auto &right = *static_cast<Inner *>(right_node);
+      left.keys[left.size - 1] = parent.keys[index];
+      std::copy(right.keys.begin(), right.keys.begin() + right.size - 1, left.keys.begin() + left.size);
+      std::copy(right.children.begin(), right.children.begin() + right.size, left.children.begin() + left.size);
+      std::copy(right.counts.begin(), right.counts.begin() + right.size, left.counts.begin() + left.size);
+    }
+    left_node->size += right_node->size;
+    parent.counts[index] += parent.counts[index + 1];
+    erase_at(parent.children, parent.size, index + 1);
+    erase_at(parent.counts, parent.size, index + 1);
+    erase_at(parent.keys, parent.size - 1, index);
+    parent.size--;
+    if (right_node->leaf) {
+      m_alloc.delete_object(static_cast<Leaf *>(right_node));
+    } else {
+      m_alloc.delete_object(static_cast<Inner *>(right_node));
+    }
+    return;
+  }
+
+  // Too many to merge: one element or child moves over to the smaller side.
+  const bool to_left = left_node->size < right_node->size;
+  size_t moved = 1;
+  if (left_node->leaf) {
+    auto &left = *static_cast<Leaf *>(left_node);
+    auto &right = *static_cast<Leaf *>(right_node);
+    if (to_left) {
+      left.elements[left.size] = right.elements[0];
+      erase_at(right.elements, right.size, 0);
+    } else {
+      insert_at(right.elements, right.size, 0, left.elements[left.size - 1]);
+    }
+    parent.keys[index] = right.elements[0];
+  } else {
+    auto &left = *static_cast<Inner *>(left_node);
+    auto &right = *static_cast<Inner *>(right_node);
+    if (to_left) {
+      moved = right.counts[0];
+      left.keys[left.size - 1] = parent.keys[index];
+      left.children[left.size] = right.children[0];
+      left.counts[left.size] = moved;
+      parent.keys[index] = right.keys[0];
+      erase_at(right.keys, right.size - 1, 0);
+      erase_at(right.children, right.size, 0);
+      erase_at(right.counts, right.size, 0);
+    } else {
+      moved = left.counts[left.size - 1];
+      insert_at(right.keys, right.size - 1, 0, parent.keys[index]);
+      insert_at(right.children, right.size, 0, left.children[left.size - 1]);
+      insert_at(right.counts, right.size, 0, moved);
+      parent.keys[index] = left.keys[left.size - 2];
+    }
+  }
+
+  if (to_left) {
+    left_node->size++;
+    right_node->size--;
+    parent.counts[index] += moved;
+    parent.counts[index + 1] -= moved;
+  } else {
+    left_node->size--;
+    right_node->size++;
+    parent.counts[index] -= moved;
+    parent.counts[index + 1] += moved;
+  }
+}
+
+auto ScoreTree::Rank(Element element) const noexcept -> size_t {
+  size_t rank = 0;
+  const Node *node = m_root;
+  while (!node->leaf) {
+    const auto *inner = static_cast<const Inner *>(node);
+    const auto keys = inner->keys.begin();
+    const auto child = size_t(std::upper_bound(keys, keys + inner->size - 1, element, less) - keys);
+    for (size_t i = 0; i < child; i++) {
+      rank += inner->counts[i];
+    }
+    node = inner->children[child];
+  }
+
+  const auto &leaf = *static_cast<const Leaf *>(node);
+  const auto begin = leaf.elements.begin();
+  return rank + size_t(std::lower_bound(begin, begin + leaf.size, element, less) - begin);
+}
+
+auto ScoreTree::At(size_t rank) const noexcept -> Iterator {
+  if (rank >= m_size) {
+    return {nullptr, 0};
+  }
+  const Node *node = m_root;
+  while (!node->leaf) {
+    const auto *inner = static_cast<const Inner *>(node);
+    size_t child = 0;
+    for (; rank >= inner->counts[child]; child++) {
+      rank -= inner->counts[child];
+    }
+    node = inner->children[child];
+  }
+  return {static_cast<const Leaf *>(node), rank};
+}
+
+auto ScoreTree::LowerBound(double score, bool exclusive) const noexcept -> Iterator {
+  if (m_root == nullptr) {
+    return {nullptr, 0};
+  }
+  auto before = [&](const Element &element) { return exclusive ? element.score <= score : element.score < score; };
+
+  // The last child whose first element comes before the bound may still hold the first element past it.
+  const Node *node = m_root;
+  while (!node->leaf) {
+    const auto *inner = static_cast<const Inner *>(node);
+    const auto keys = inner->keys.begin();
+    node = inner->children[size_t(std::partition_point(keys, keys + inner->size - 1, before) - keys)];
+  }
+
+  const auto *leaf = static_cast<const Leaf *>(node);
+  const auto begin = leaf->elements.begin();
+  const auto pos = size_t(std::partition_point(begin, begin + leaf->size, before) - begin);
+  return pos < leaf->size ? Iterator(leaf, pos) : Iterator(leaf->next, 0);
+}
+
+void ScoreTree::Iterator::Next() noexcept {
+  if (++m_pos == m_leaf->size) {
+    m_leaf = m_leaf->next;
+    m_pos = 0;
+  }
+}
+
+void ScoreTree::Iterator::Prev() noexcept {
+  if (m_pos != 0) {
+    m_pos--;
+    return;
+  }
+  m_leaf = m_leaf->prev;
+  m_pos = m_leaf != nullptr ? m_leaf->size - 1 : 0;
+}
+
+auto SortedSet::Score(std::string_view member) const -> std::optional<double> {
+  auto it = m_scores.find(member);
+  if (it == m_scores.end()) {
+    return {};
+  }
+  return it->second;
+}
+
+auto SortedSet::Add(std::string_view member, double score) -> bool {
+  auto it = m_scores.find(member);
+  if (it == m_scores.end()) {
+    it = m_scores.emplace(resp::String(member, m_scores.get_allocator()), score).first;
+    m_tree.Insert({score, &it->first});
+    return true;
+  }
+  if (it->second != score) {
+    m_tree.Erase({it->second, &it->first});
+    it->second = score;
+    m_tree.Insert({score, &it->first});
+  }
+  return false;
+}
+
+auto SortedSet::Remove(std::string_view member) -> bool {
+  auto it = m_scores.find(member);
+  if (it == m_scores.end()) {
+    return false;
+  }
+  m_tree.Erase({it->second, &it->first});
+  m_scores.erase(it);
+  return true;
+}
+
+auto SortedSet::Rank(std::string_view member) const -> std::optional<size_t> {
+  auto it = m_scores.find(member);
+  if (it == m_scores.end()) {
+    return {};
+  }
+  return m_tree.Rank({it->second, &it->first});
+}
+}  // namespace redispp::zset
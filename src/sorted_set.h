@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+#include "resp_serde.h"
+#include "string_hash.h"
+
+namespace redispp::zset {
+// An element's place in the order: by score, then by member, bytewise. Members are owned by the sorted set's map.
+struct Element {
+  double score;
+  const resp::String *member;
+};
+
+// A B+tree of elements whose inner nodes count the elements under each child, so that ranks are found, and elements
+// found by rank, in O(log n). Nodes are sized to cache lines, and the leaves are linked so that ranges are read
+// sequentially, leaf after leaf, without going back up the tree.
+class ScoreTree {
+  struct Leaf;
+
+ public:
+  static constexpr size_t CacheLine = 64;
+  static constexpr size_t NodeBytes = 4 * CacheLine;
+
+  explicit ScoreTree(std::pmr::memory_resource *alloc) : m_alloc(alloc) {}
+  ScoreTree(const ScoreTree &) = delete;
+  auto operator=(const ScoreTree &) -> ScoreTree & = delete;
+  ~ScoreTree();
+
+  [[nodiscard]] auto Size() const noexcept -> size_t { return m_size; }
+
+  // The element must not be in the tree already, respectively must be in it.
+  void Insert(Element element);
+  void Erase(Element element) noexcept;
+
+  // The number of elements before `element`, which must be in the tree.
+  [[nodiscard]] auto Rank(Element element) const noexcept -> size_t;
+
+  // A position in the tree, moving along the linked leaves.
+  class Iterator {
+   public:
+    [[nodiscard]] auto Valid() const noexcept -> bool { return m_leaf != nullptr; }
+    [[nodiscard]] auto Score() const noexcept -> double { return m_leaf->elements[m_pos].score; }
+    [[nodiscard]] auto Member() const noexcept -> std::string_view { return *m_leaf->elements[m_pos].member; }
+
+    void Next() noexcept;
+    void Prev() noexcept;
+
+   private:
+    friend class ScoreTree;
+
+    Iterator(const Leaf *leaf, size_t pos) noexcept : m_leaf(leaf), m_pos(pos) {}
+
+    const Leaf *m_leaf;
+    size_t m_pos;
+  };
+
+  // The element of rank `rank`; invalid past the end.
+  [[nodiscard]] auto At(size_t rank) const noexcept -> Iterator;
+  // The first element scored at least `score`, or more than it when `exclusive`.
+  [[nodiscard]] auto LowerBound(double score, bool exclusive) const noexcept -> Iterator;
+
+ private:
+  struct Node {
+    uint16_t size = 0;  // Elements of a leaf, children of an inner node
+    bool leaf;
+  };
+
+  static constexpr size_t LeafCapacity = (NodeBytes - sizeof(Node) - 2 * sizeof(void *)) / sizeof(Element);
+  // Children; an inner node holds one key less, the first element of each child but the first.
+  static constexpr size_t Fanout =
+      (NodeBytes - sizeof(Node) + sizeof(Element)) / (sizeof(Element) + 2 * sizeof(void *));
+
+  struct alignas(CacheLine) Leaf : Node {
+    Leaf *prev = nullptr;
+    Leaf *next = nullptr;
+    std::array<Element, LeafCapacity> elements;
+  };
+
+  struct alignas(CacheLine) Inner : Node {
+    std::array<size_t, Fanout> counts;
+    std::array<Node *, Fanout> children;
+    std::array<Element, Fanout - 1> keys;
+  };
+
+  static_assert(sizeof(Leaf) == NodeBytes && sizeof(Inner) == NodeBytes);
+
+  // Inner nodes on the way down to a leaf, with the index of the child taken. Nodes other than the root are at least
+  // half full, which bounds the height far below this for any number of elements that fits in memory.
+  struct Step {
+    Inner *node;
+    size_t child;
+  };
+  static constexpr size_t MaxHeight = 32;
+  using Path = std::array<Step, MaxHeight>;
+
+  auto new_leaf() -> Leaf *;
+  auto new_inner() -> Inner *;
+  void destroy(Node *node) noexcept;
+
+  // Splits the full leaf, inserting `element` at `pos`, and returns the new right half.
+  auto split(Leaf &leaf, size_t pos, Element element) -> Leaf *;
+  // Inserts `child` after child `index` of `parent`, splitting the parent when it's full: returns the new right half,
+  // or nullptr, and the key that moves up to the grandparent.
+  auto insert_child(Inner &parent, size_t index, Node *child, size_t count, Element &key) -> Inner *;
+
+  // Merges child `index` + 1 of `parent` into child `index`, or moves an element or a child between them when they
+  // don't fit in one node.
+  void rebalance(Inner &parent, size_t index) noexcept;
+
+  std::pmr::polymorphic_allocator<> m_alloc;
+  Node *m_root = nullptr;
+  size_t m_size = 0;
+};
+
+// A sorted set: members mapped to their scores, for lookups by member, and ordered in a ScoreTree.
+class SortedSet {
+ public:
+  // Takes the memory resource like the pmr containers do, e.g. lists.
+  explicit SortedSet(std::pmr::memory_resource *alloc) : m_scores(alloc), m_tree(alloc) {}
+
+  [[nodiscard]] auto Size() const noexcept -> size_t { return m_scores.size(); }
+
+  [[nodiscard]] auto Score(std::string_view member) const -> std::optional<double>;
+  // Adds the member or changes its score; false when it was in the set already.
+  auto Add(std::string_view member, double score) -> bool;
+  auto Remove(std::string_view member) -> bool;
+
+  // The member's rank, from the lowest score.
+  [[nodiscard]] auto Rank(std::string_view member) const -> std::optional<size_t>;
+
+  [[nodiscard]] auto At(size_t rank) const noexcept -> ScoreTree::Iterator { return m_tree.At(rank); }
+  [[nodiscard]] auto LowerBound(double score, bool exclusive) const noexcept -> ScoreTree::Iterator {
+    return m_tree.LowerBound(score, exclusive);
+  }
+
+ private:
+  std::pmr::unordered_map<resp::String, double, utils::string_hash, std::equal_to<>> m_scores;
+  ScoreTree m_tree;
+};
+}  // namespace redispp::zset
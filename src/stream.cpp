@@ -0,0 +1,272 @@
+#include "stream.h"
+
+#include <fmt/format.h>
+
+#include <iterator>
+#include <tuple>
+
+namespace redispp::stream {
+auto FormatID(ID id, std::pmr::memory_resource &alloc) -> resp::String {
+  resp::String str(&alloc);
+  fmt::format_to(std::back_inserter(str), "{}-{}", id.ms, id.seq);
+  return str;
+}
+
+auto ToKey(ID id) noexcept -> IDKey {
+  IDKey key;
+  for (size_t i = 0; i < 8; i++) {
+    key[i] = static_cast<uint8_t>(id.ms >> (56 - 8 * i));
+    key[8 + i] = static_cast<uint8_t>(id.seq >> (56 - 8 * i));
+  }
+  return key;
+}
+
+auto FromKey(const IDKey &key) noexcept -> ID {
+  ID id;
+  for (size_t i = 0; i < 8; i++) {
+    id.ms = id.ms << 8 | key[i];
+    id.seq = id.seq << 8 | key[8 + i];
+  }
+  return id;
+}
+
+Node::Node(ID master, std::span<const resp::String> fields, std::pmr::memory_resource &alloc)
+    : m_data(&alloc), m_master_fields(fields.size() / 2), m_master(master) {
+  write_varint(m_master_fields);
+  m_names_begin = m_data.size();
+  for (size_t i = 0; i < fields.size(); i += 2) {
+    write_string(fields[i]);
+  }
+  m_entries_begin = m_data.size();
+  Append(master, fields);
+}
+
+void Node::Append(ID id, std::span<const resp::String> fields) {
+  const bool same = same_fields(fields);
+  m_data += static_cast<char>(same ? SameFieldsFlag : 0);
+  write_varint(id.ms - m_master.ms);
+  write_varint(id.ms == m_master.ms ? id.seq - m_master.seq : id.seq);
+  if (same) {
+    for (size_t i = 1; i < fields.size(); i += 2) {
+      write_string(fields[i]);
+    }
+  } else {
+    write_varint(fields.size() / 2);
+    for (const auto &str : fields) {
+      write_string(str);
+    }
+  }
+
+  m_last = id;
+  m_count++;
+  m_live++;
+}
+
+void Node::write_varint(uint64_t val) {
+  while (val >= 0x80) {
+    m_data += static_cast<char>(val | 0x80);
+    val >>= 7;
+  }
+  m_data += static_cast<char>(val);
+}
+
+void Node::write_string(std::string_view str) {
+  write_varint(str.size());
+  m_data += str;
+}
+
+auto Node::read_varint(size_t &pos) const noexcept -> uint64_t {
+  uint64_t val = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    const auto byte = static_cast<uint8_t>(m_data[pos++]);
+    val |= uint64_t{byte & 0x7fU} << shift;
+    if (byte < 0x80) {
+      return val;
+    }
+  }
+}
+
+auto Node::read_string(size_t &pos) const noexcept -> std::string_view {
+  const auto len = read_varint(pos);
+  const std::string_view str(m_data.data() + pos, len);
+  pos += len;
+  return str;
+}
+
+auto Node::same_fields(std::span<const resp::String> fields) const noexcept -> bool {
+  if (fields.size() / 2 != m_master_fields) {
+    return false;
+  }
+  auto pos = m_names_begin;
+  for (size_t i = 0; i < fields.size(); i += 2) {
+    if (read_string(pos) != fields[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Node::Cursor::load() noexcept {
+  if (!Valid()) {
+    return;
+  }
+  auto pos = m_pos + 1;
+  const auto ms_delta = m_node->read_varint(pos);
+  const auto seq = m_node->read_varint(pos);
+  m_id = {m_node->m_master.ms + ms_delta, ms_delta == 0 ? m_node->m_master.seq + seq : seq};
+  m_field_count = (flags() & SameFieldsFlag) != 0 ? m_node->m_master_fields : m_node->read_varint(pos);
+  m_fields = pos;
+}
+
+void Node::Cursor::Next() noexcept {
+  auto pos = m_fields;
+  const auto strings = (flags() & SameFieldsFlag) != 0 ? m_field_count : 2 * m_field_count;
+  for (size_t i = 0; i < strings; i++) {
+    m_node->read_string(pos);
+  }
+  m_pos = pos;
+  load();
+}
+
+void Node::Cursor::MarkDeleted() noexcept {
+  if (!Deleted()) {
+    m_node->m_data[m_pos] = static_cast<char>(flags() | DeletedFlag);
+    m_node->m_live--;
+  }
+}
+
+auto ConsumerGroup::GetConsumer(std::string_view name) -> Consumer & {
+  auto it = m_consumers.find(name);
+  if (it == m_consumers.end()) {
+    it = m_consumers.emplace(std::piecewise_construct, std::forward_as_tuple(name), std::tuple<>()).first;
+  }
+  return it->second;
+}
+
+void ConsumerGroup::Deliver(Consumer &consumer, ID id, bool noack) {
+  m_last_delivered = std::max(m_last_delivered, id);
+  if (noack) {
+    return;
+  }
+
+  const auto key = ToKey(id);
+  auto [entry, inserted] = m_pending.Insert(key, {&consumer, Clock::now()});
+  if (!inserted) {
+    // Delivered again after the group's last delivered ID was moved back: the entry changes hands.
+    entry->second.consumer->pending.Erase(key);
+    entry->second = {&consumer, Clock::now(), entry->second.deliveries + 1};
+  }
+  consumer.pending.Insert(key, {});
+}
+
+void ConsumerGroup::Redeliver(ID id) noexcept {
+  if (auto *entry = m_pending.Find(ToKey(id))) {
+    entry->second.delivered = Clock::now();
+    entry->second.deliveries++;
+  }
+}
+
+auto ConsumerGroup::Ack(ID id) -> bool {
+  const auto key = ToKey(id);
+  auto *entry = m_pending.Find(key);
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->second.consumer->pending.Erase(key);
+  m_pending.Erase(key);
+  return true;
+}
+
+void Stream::Add(ID id, std::span<const resp::String> fields) {
+  auto *last = m_nodes.Last();
+  if (last == nullptr || last->second.Full()) {
+    m_nodes.Insert(ToKey(id), Node(id, fields, *m_alloc));
+  } else {
+    last->second.Append(id, fields);
+  }
+  m_last_id = id;
+  m_length++;
+}
+
+auto Stream::erase_first() -> size_t {
+  auto *first = m_nodes.First();
+  const auto live = first->second.Live();
+  m_nodes.Erase(IDKey(first->first));
+  m_length -= live;
+  return live;
+}
+
+template <typename Pred>
+auto Stream::trim_first(Pred &&pred) -> size_t {
+  auto &node = m_nodes.First()->second;
+  size_t removed = 0;
+  for (auto cursor = node.Begin(); cursor.Valid(); cursor.Next()) {
+    if (cursor.Deleted()) {
+      continue;
+    }
+    if (!pred(cursor.Id())) {
+      break;
+    }
+    cursor.MarkDeleted();
+    removed++;
+  }
+  m_length -= removed;
+  return removed;
+}
+
+auto Stream::TrimMaxLen(size_t maxlen, bool approx) -> size_t {
+  size_t removed = 0;
+  while (m_length > maxlen) {
+    const auto excess = m_length - maxlen;
+    if (m_nodes.First()->second.Live() <= excess) {
+      removed += erase_first();
+      continue;
+    }
+    if (!approx) {
+      size_t trimmed = 0;
+      removed += trim_first([&](ID /*id*/) { return trimmed++ < excess; });
+    }
+    break;
+  }
+  return removed;
+}
+
+auto Stream::TrimMinId(ID minid, bool approx) -> size_t {
+  size_t removed = 0;
+  while (m_length != 0) {
+    const auto &node = m_nodes.First()->second;
+    if (node.Last() < minid) {
+      removed += erase_first();
+      continue;
+    }
+    if (!approx && node.Master() < minid) {
+      removed += trim_first([&](ID id) { return id < minid; });
+    }
+    break;
+  }
+  return removed;
+}
+
+auto Stream::CreateGroup(std::string_view name, ID last_delivered) -> bool {
+  if (m_groups.contains(name)) {
+    return false;
+  }
+  m_groups.emplace(std::piecewise_construct, std::forward_as_tuple(name),
+                   std::forward_as_tuple(last_delivered, *m_alloc));
+  return true;
+}
+
+auto Stream::DestroyGroup(std::string_view name) -> bool {
+  auto it = m_groups.find(name);
+  if (it == m_groups.end()) {
+    return false;
+  }
+  m_groups.erase(it);
+  return true;
+}
+
+auto Stream::GetGroup(std::string_view name) -> ConsumerGroup * {
+  auto it = m_groups.find(name);
+  return it == m_groups.end() ? nullptr : &it->second;
+}
+}  // namespace redispp::stream
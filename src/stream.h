@@ -0,0 +1,229 @@
+#pragma once
+
+#include <chrono>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+#include "radix_tree.h"
+#include "resp_serde.h"
+#include "string_hash.h"
+
+namespace redispp::stream {
+// Entry IDs: a millisecond timestamp and a sequence number for entries added in the same millisecond.
+struct ID {
+  uint64_t ms = 0;
+  uint64_t seq = 0;
+
+  auto operator<=>(const ID &) const noexcept = default;
+
+  static constexpr auto Max() noexcept -> ID {
+    return {std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max()};
+  }
+};
+
+// "<ms>-<seq>"
+auto FormatID(ID id, std::pmr::memory_resource &alloc) -> resp::String;
+
+// IDs are radix tree keys in big endian, so that the tree is sorted by ID.
+static constexpr size_t IDSize = 16;
+using IDKey = std::array<uint8_t, IDSize>;
+
+auto ToKey(ID id) noexcept -> IDKey;
+auto FromKey(const IDKey &key) noexcept -> ID;
+
+template <typename T>
+using IDTree = RadixTree<IDSize, T>;
+
+// A macro node: consecutive entries packed in one buffer, listpack style. IDs are stored as varint deltas from the
+// node's master ID, the ID of its first entry, and the field names of entries that have the same fields as the master
+// entry are left out, which is the common case of streams of uniform events.
+class Node {
+ public:
+  static constexpr size_t MaxEntries = 100;
+  static constexpr size_t MaxBytes = 4096;
+
+  // `fields` alternates names and values.
+  Node(ID master, std::span<const resp::String> fields, std::pmr::memory_resource &alloc);
+
+  [[nodiscard]] auto Master() const noexcept -> ID { return m_master; }
+  [[nodiscard]] auto Last() const noexcept -> ID { return m_last; }
+  // Entries that aren't deleted.
+  [[nodiscard]] auto Live() const noexcept -> size_t { return m_live; }
+  [[nodiscard]] auto Full() const noexcept -> bool { return m_count >= MaxEntries || m_data.size() >= MaxBytes; }
+
+  // `id` must be greater than Last().
+  void Append(ID id, std::span<const resp::String> fields);
+
+  // Reads the entries in ID order, deleted ones included.
+  class Cursor {
+   public:
+    [[nodiscard]] auto Valid() const noexcept -> bool { return m_pos < m_node->m_data.size(); }
+    [[nodiscard]] auto Id() const noexcept -> ID { return m_id; }
+    [[nodiscard]] auto Deleted() const noexcept -> bool { return (flags() & DeletedFlag) != 0; }
+    [[nodiscard]] auto FieldCount() const noexcept -> size_t { return m_field_count; }
+
+    // Calls func(name, value) for each field of the entry.
+    template <typename Func>
+    void ForEachField(Func &&func) const {
+      auto names = m_node->m_names_begin;
+      auto pos = m_fields;
+      const bool same_fields = (flags() & SameFieldsFlag) != 0;
+      for (size_t i = 0; i < m_field_count; i++) {
+        const auto name = m_node->read_string(same_fields ? names : pos);
+        const auto value = m_node->read_string(pos);
+        func(name, value);
+      }
+    }
+
+    void Next() noexcept;
+    void MarkDeleted() noexcept;
+
+   private:
+    friend class Node;
+
+    explicit Cursor(Node &node, size_t pos) noexcept : m_node(&node), m_pos(pos) { load(); }
+
+    [[nodiscard]] auto flags() const noexcept -> uint8_t { return static_cast<uint8_t>(m_node->m_data[m_pos]); }
+    void load() noexcept;
+
+    Node *m_node;
+    size_t m_pos;  // Of the entry's flags
+    size_t m_fields = 0;
+    size_t m_field_count = 0;
+    ID m_id;
+  };
+
+  auto Begin() noexcept -> Cursor { return Cursor(*this, m_entries_begin); }
+
+ private:
+  static constexpr uint8_t DeletedFlag = 1;
+  static constexpr uint8_t SameFieldsFlag = 2;
+
+  void write_varint(uint64_t val);
+  void write_string(std::string_view str);
+  auto read_varint(size_t &pos) const noexcept -> uint64_t;
+  auto read_string(size_t &pos) const noexcept -> std::string_view;
+  [[nodiscard]] auto same_fields(std::span<const resp::String> fields) const noexcept -> bool;
+
+  // The master entry's field names, then the entries:
+  //   flags, ms - master.ms, seq - master.seq if the ms are equal or seq otherwise,
+  //   with SameFieldsFlag: the values, in the order of the master's names,
+  //   without it: the field count, then names and values alternately.
+  // Integers are varints, strings are prefixed by their varint length.
+  std::pmr::string m_data;
+  size_t m_names_begin = 0;
+  size_t m_entries_begin = 0;
+  size_t m_master_fields = 0;
+  ID m_master;
+  ID m_last;
+  size_t m_count = 0;
+  size_t m_live = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+struct Consumer {
+  // IDs of the entries delivered to the consumer and not acknowledged yet.
+  IDTree<std::monostate> pending;
+};
+
+// An entry of a consumer group's pending entries list (PEL).
+struct PendingEntry {
+  Consumer *consumer;
+  Clock::time_point delivered;
+  uint64_t deliveries = 1;
+};
+
+class ConsumerGroup {
+ public:
+  ConsumerGroup(ID last_delivered, std::pmr::memory_resource &alloc)
+      : m_last_delivered(last_delivered), m_consumers(&alloc) {}
+
+  [[nodiscard]] auto LastDelivered() const noexcept -> ID { return m_last_delivered; }
+
+  // Created on first use, like in Redis.
+  auto GetConsumer(std::string_view name) -> Consumer &;
+
+  // A new entry delivered to the consumer: it's added to the PELs unless `noack`.
+  void Deliver(Consumer &consumer, ID id, bool noack);
+  // An entry read again from the consumer's PEL.
+  void Redeliver(ID id) noexcept;
+  // Removes the entry from the PELs; false when it wasn't pending.
+  auto Ack(ID id) -> bool;
+
+ private:
+  ID m_last_delivered;
+  IDTree<PendingEntry> m_pending;
+  std::pmr::unordered_map<resp::String, Consumer, utils::string_hash, std::equal_to<>> m_consumers;
+};
+
+class Stream {
+ public:
+  // Takes the memory resource like the pmr containers do, e.g. lists.
+  explicit Stream(std::pmr::memory_resource *alloc) : m_alloc(alloc), m_groups(alloc) {}
+
+  [[nodiscard]] auto Length() const noexcept -> size_t { return m_length; }
+  [[nodiscard]] auto LastId() const noexcept -> ID { return m_last_id; }
+
+  // `id` must be greater than LastId(); `fields` alternates names and values.
+  void Add(ID id, std::span<const resp::String> fields);
+
+  // Calls func(const Node::Cursor &) for up to `count` entries with IDs in [start, end], in order. Entries are read
+  // sequentially from the buffers of the macro nodes.
+  template <typename Func>
+  void Range(ID start, ID end, size_t count, Func &&func) {
+    // The node holding `start` is the last one starting before it.
+    auto *entry = m_nodes.Floor(ToKey(start));
+    if (entry == nullptr) {
+      entry = m_nodes.First();
+    }
+    for (; entry != nullptr && count != 0; entry = m_nodes.Next(entry->first)) {
+      for (auto cursor = entry->second.Begin(); cursor.Valid(); cursor.Next()) {
+        if (cursor.Id() > end) {
+          return;
+        }
+        if (cursor.Id() >= start && !cursor.Deleted()) {
+          func(std::as_const(cursor));
+          if (--count == 0) {
+            return;
+          }
+        }
+      }
+    }
+  }
+
+  // Remove the oldest entries. Approximate trimming only removes whole macro nodes, which is cheaper and may keep a
+  // few more entries. Return the number of entries removed.
+  auto TrimMaxLen(size_t maxlen, bool approx) -> size_t;
+  auto TrimMinId(ID minid, bool approx) -> size_t;
+
+  // False when the group already exists.
+  auto CreateGroup(std::string_view name, ID last_delivered) -> bool;
+  auto DestroyGroup(std::string_view name) -> bool;
+  // nullptr when there's no such group.
+  auto GetGroup(std::string_view name) -> ConsumerGroup *;
+  [[nodiscard]] auto GroupCount() const noexcept -> size_t { return m_groups.size(); }
+
+ private:
+  // Erases the first macro node, returning the number of entries it held.
+  auto erase_first() -> size_t;
+  // Marks the entries of the first macro node deleted while `pred(id)` holds. The node keeps at least one entry.
+  template <typename Pred>
+  auto trim_first(Pred &&pred) -> size_t;
+
+  std::pmr::memory_resource *m_alloc;
+  IDTree<Node> m_nodes;
+  size_t m_length = 0;
+  ID m_last_id;
+  std::pmr::unordered_map<resp::String, ConsumerGroup, utils::string_hash, std::equal_to<>> m_groups;
+};
+}  // namespace redispp::stream
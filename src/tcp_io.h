@@ -0,0 +1,31 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <cerrno>
+
+// `resp::Reader` and `resp::Writer` adapters for TCP sockets, found through ADL.
+namespace boost::asio {
+inline auto ReadSome(ip::tcp::socket& socket, char* buf, size_t bufsize) -> awaitable<size_t> {
+  return socket.async_read_some(boost::asio::buffer(buf, bufsize), use_awaitable);
+}
+
+// Lets idle connections wait for input without holding a read buffer.
+inline auto WaitReadable(ip::tcp::socket& socket) -> awaitable<void> {
+  return socket.async_wait(ip::tcp::socket::wait_read, use_awaitable);
+}
+
+// Peeks at the socket: end of stream or an error, other than there being nothing to read yet, means it's closed.
+inline auto PeerClosed(ip::tcp::socket& socket) -> bool {
+  char byte = 0;
+  const auto n = ::recv(socket.native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+inline auto Write(ip::tcp::socket& socket, const char* buf, size_t bufsize) -> awaitable<void> {
+  co_await boost::asio::async_write(socket, boost::asio::buffer(buf, bufsize), use_awaitable);
+}
+}  // namespace boost::asio
@@ -0,0 +1,141 @@
+#include "tracking.h"
+
+#include <boost/smart_ptr/make_local_shared.hpp>
+
+#include <algorithm>
+#include <array>
+
+#include "db.h"
+
+namespace redispp::tracking {
+void Table::add(ClientMap &map, std::string_view name, ClientID id) {
+  auto it = map.find(name);
+  if (it == map.end()) {
+    it = map.emplace(resp::String(name, map.get_allocator().resource()), Clients{}).first;
+  }
+
+  auto &clients = it->second;
+  if (std::find(clients.begin(), clients.end(), id) == clients.end()) {
+    clients.push_back(id);
+  }
+}
+
+void Table::Enable(Client &client, ClientState state) {
+  Disable(client);
+
+  if (state.bcast) {
+    if (state.prefixes.empty()) {
+      state.prefixes.emplace_back();
+    }
+    for (const auto &prefix : state.prefixes) {
+      add(m_prefixes, prefix, client.Id());
+    }
+  }
+  client.SetTracking(std::make_unique<ClientState>(std::move(state)));
+}
+
+void Table::Disable(Client &client) {
+  auto *state = client.GetTracking();
+  if (state == nullptr) {
+    return;
+  }
+
+  for (const auto &prefix : state->prefixes) {
+    auto it = m_prefixes.find(prefix);
+    if (it == m_prefixes.end()) {
+      continue;
+    }
+
+    auto &clients = it->second;
+    clients.erase(std::remove(clients.begin(), clients.end(), client.Id()), clients.end());
+    if (clients.empty()) {
+      m_prefixes.erase(it);
+    }
+  }
+  client.SetTracking(nullptr);
+}
+
+void Table::Remember(Client &client, std::string_view key) {
+  auto *state = client.GetTracking();
+  if (state == nullptr || state->bcast) {
+    return;
+  }
+
+  if (!m_keys.contains(key)) {
+    while (!m_keys.empty() && m_keys.size() >= m_max_keys) {
+      auto victim = m_keys.begin();
+      send(victim->first, victim->second, 0);
+      m_keys.erase(victim);
+    }
+  }
+  add(m_keys, key, client.Id());
+}
+
+void Table::Invalidate(std::string_view key, ClientID modified_by) {
+  if (auto it = m_keys.find(key); it != m_keys.end()) {
+    auto clients = std::move(it->second);
+    m_keys.erase(it);
+    send(key, clients, modified_by);
+  }
+
+  // Few prefixes are expected to be registered, so all of them are checked.
+  for (const auto &[prefix, clients] : m_prefixes) {
+    if (key.starts_with(prefix)) {
+      send(key, clients, modified_by);
+    }
+  }
+}
+
+void Table::send(std::string_view key, const Clients &clients, ClientID modified_by) {
+  // Encoded at most once per protocol version: RESP2 targets get the message of a `InvalidateChannel` subscription.
+  std::array<Frame, 2> frames;
+
+  for (auto id : clients) {
+    auto *client = m_db->FindClient(id);
+    auto *state = client != nullptr ? client->GetTracking() : nullptr;
+    if (state == nullptr || (state->noloop && id == modified_by)) {
+      continue;
+    }
+
+    auto *target = client;
+    if (state->redirect != 0) {
+      target = m_db->FindClient(state->redirect);
+      if (target == nullptr) {
+        if (client->GetProtocol() == resp::Protocol::Resp3) {
+          std::string buf;
+          resp::EncodeAggregateHeader(buf, resp::TokenTypeMarker::Push, 2, resp::Protocol::Resp3);
+          resp::EncodeBulkString(buf, "tracking-redir-broken");
+          resp::Encode(buf, static_cast<resp::Integer>(state->redirect));
+          client->Output().Push(boost::make_local_shared<const std::string>(std::move(buf)));
+        }
+        continue;
+      }
+    }
+
+    const auto proto = target->GetProtocol();
+    if (proto == resp::Protocol::Resp2) {
+      const auto *pubsub = target->GetPubSub();
+      if (pubsub == nullptr || !pubsub->channels.contains(InvalidateChannel)) {
+        continue;
+      }
+    }
+
+    auto &frame = frames[proto == resp::Protocol::Resp3 ? 1 : 0];
+    if (!frame) {
+      std::string buf;
+      if (proto == resp::Protocol::Resp3) {
+        resp::EncodeAggregateHeader(buf, resp::TokenTypeMarker::Push, 2, proto);
+        resp::EncodeBulkString(buf, "invalidate");
+      } else {
+        resp::EncodeArrayHeader(buf, 3);
+        resp::EncodeBulkString(buf, "message");
+        resp::EncodeBulkString(buf, InvalidateChannel);
+      }
+      resp::EncodeArrayHeader(buf, 1);
+      resp::EncodeBulkString(buf, key);
+      frame = boost::make_local_shared<const std::string>(std::move(buf));
+    }
+    target->Output().Push(frame);
+  }
+}
+}  // namespace redispp::tracking
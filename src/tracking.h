@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "resp_serde.h"
+#include "string_hash.h"
+
+namespace redispp {
+class Client;
+class DB;
+
+using ClientID = uint64_t;
+
+namespace tracking {
+// Per client options of CLIENT TRACKING, present while tracking is on.
+struct ClientState {
+  bool bcast = false;
+  bool noloop = false;
+  // Invalidations are sent to this client instead, e.g. a RESP2 connection subscribed to `InvalidateChannel`.
+  ClientID redirect = 0;
+  std::vector<resp::String> prefixes;
+};
+
+static constexpr std::string_view InvalidateChannel = "__redis__:invalidate";
+static constexpr size_t DefaultMaxKeys = 1'000'000;
+
+// Remembers which clients may have cached which keys. Clients are referred to by id, so that disconnected clients
+// don't need to be purged: their entries are dropped the next time the key is invalidated.
+class Table {
+ public:
+  explicit Table(DB &db, std::pmr::memory_resource &alloc) : m_db(&db), m_keys(&alloc), m_prefixes(&alloc) {}
+
+  // The table is bounded: going over the limit evicts keys, invalidating them in the clients that track them.
+  void SetMaxKeys(size_t max_keys) noexcept { m_max_keys = max_keys; }
+
+  void Enable(Client &client, ClientState state);
+  void Disable(Client &client);
+
+  // Called after `client` read `key`; a no-op unless the client tracks keys in the default mode.
+  void Remember(Client &client, std::string_view key);
+
+  // Pushes invalidations for the clients that read the key or track one of its prefixes. The per key entry is dropped:
+  // clients have to read the key again to be notified of the next change.
+  void Invalidate(std::string_view key, ClientID modified_by = 0);
+
+  // Whether any client may need an invalidation.
+  [[nodiscard]] auto Active() const noexcept -> bool { return !m_keys.empty() || !m_prefixes.empty(); }
+
+ private:
+  using Clients = std::vector<ClientID>;
+  using ClientMap = std::pmr::unordered_map<resp::String, Clients, utils::string_hash, std::equal_to<>>;
+
+  static void add(ClientMap &map, std::string_view name, ClientID id);
+  void send(std::string_view key, const Clients &clients, ClientID modified_by);
+
+  DB *m_db;
+  ClientMap m_keys;
+  ClientMap m_prefixes;
+  size_t m_max_keys = DefaultMaxKeys;
+};
+}  // namespace tracking
+}  // namespace redispp
@@ -0,0 +1,132 @@
+#include "bitops.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace redispp::test {
+namespace {
+// Bit by bit, the way Redis addresses bitmaps, for comparison with the word and AVX2 code paths.
+auto test_bit(std::string_view data, uint64_t pos) -> bool {
+  return pos / 8 < data.size() && (static_cast<unsigned char>(data[pos / 8]) & (0x80 >> (pos % 8))) != 0;
+}
+
+auto count(std::string_view data) -> uint64_t {
+  uint64_t n = 0;
+  for (const auto byte : data) {
+    n += std::popcount(static_cast<unsigned char>(byte));
+  }
+  return n;
+}
+
+auto find_first(std::string_view data, bool bit) -> std::optional<uint64_t> {
+  for (uint64_t pos = 0; pos < data.size() * 8; pos++) {
+    if (test_bit(data, pos) == bit) {
+      return pos;
+    }
+  }
+  return {};
+}
+
+auto combine(bits::Op op, const std::vector<std::string> &srcs) -> std::string {
+  size_t len = 0;
+  for (const auto &src : srcs) {
+    len = std::max(len, src.size());
+  }
+  std::string dst(len, '\0');
+  for (size_t i = 0; i < len; i++) {
+    const auto byte = [&](const std::string &src) { return i < src.size() ? static_cast<unsigned char>(src[i]) : 0; };
+    unsigned value = byte(srcs.front());
+    for (size_t s = 1; s < srcs.size(); s++) {
+      const unsigned other = byte(srcs[s]);
+      value = op == bits::Op::And ? value & other : op == bits::Op::Or ? value | other : value ^ other;
+    }
+    dst[i] = static_cast<char>(op == bits::Op::Not ? ~value : value);
+  }
+  return dst;
+}
+
+// Lengths around the 8 byte words and 32 byte AVX2 blocks, and past the 31 blocks whose counts are added up at once.
+auto random_bitmap(std::mt19937 &rng) -> std::string {
+  static constexpr std::array<size_t, 8> Lengths = {0, 1, 7, 8, 31, 33, 64, 992};
+  auto len = Lengths[rng() % Lengths.size()] + rng() % 3;
+  if (rng() % 8 == 0) {
+    len = rng() % 5000;
+  }
+
+  // Mostly zeros or ones, so that FindFirst has long runs to skip.
+  const auto fill = static_cast<char>(rng() % 3 == 0 ? 0xff : 0);
+  std::string data(len, fill);
+  const auto changes = len == 0 ? 0 : rng() % 4;
+  for (size_t i = 0; i < changes; i++) {
+    data[rng() % len] = static_cast<char>(rng());
+  }
+  if (rng() % 2 == 0) {
+    std::generate(data.begin(), data.end(), [&] { return static_cast<char>(rng()); });
+  }
+  return data;
+}
+
+TEST(Bits, CountAndFindFirstMatchScalar) {
+  std::mt19937 rng(0);
+  for (size_t i = 0; i < 3000; i++) {
+    const auto data = random_bitmap(rng);
+    ASSERT_EQ(bits::Count(data), count(data)) << "length " << data.size();
+    ASSERT_EQ(bits::FindFirst(data, true), find_first(data, true)) << "length " << data.size();
+    ASSERT_EQ(bits::FindFirst(data, false), find_first(data, false)) << "length " << data.size();
+  }
+}
+
+TEST(Bits, ApplyMatchesScalar) {
+  std::mt19937 rng(1);
+  for (size_t i = 0; i < 2000; i++) {
+    const auto op = static_cast<bits::Op>(rng() % 4);
+    std::vector<std::string> srcs(op == bits::Op::Not ? 1 : 1 + rng() % 3);
+    std::generate(srcs.begin(), srcs.end(), [&] { return random_bitmap(rng); });
+
+    const std::vector<std::string_view> views(srcs.begin(), srcs.end());
+    std::pmr::string dst;
+    bits::Apply(op, views, dst);
+    ASSERT_EQ(std::string(dst), combine(op, srcs)) << "op " << static_cast<int>(op) << ", case " << i;
+  }
+}
+
+TEST(Bits, FieldsMatchScalar) {
+  std::mt19937 rng(2);
+  for (size_t i = 0; i < 2000; i++) {
+    std::pmr::string data(1 + rng() % 24, '\0');
+    std::generate(data.begin(), data.end(), [&] { return static_cast<char>(rng()); });
+    const auto width = 1 + static_cast<unsigned>(rng() % 64);
+    // Fields may run past the end when read, not when written.
+    const auto read_offset = rng() % (data.size() * 8 + 16);
+    uint64_t expected = 0;
+    for (uint64_t pos = read_offset; pos < read_offset + width; pos++) {
+      expected = (expected << 1) | (test_bit(data, pos) ? 1 : 0);
+    }
+    ASSERT_EQ(bits::GetField(data, read_offset, width), expected);
+
+    if (width > data.size() * 8) {
+      continue;
+    }
+    const auto offset = rng() % (data.size() * 8 - width + 1);
+    const uint64_t value = (uint64_t{rng()} << 32 | rng()) & (width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1);
+    const std::string before(data);
+    bits::SetField(data, offset, width, value);
+    ASSERT_EQ(bits::GetField(data, offset, width), value);
+    for (uint64_t pos = 0; pos < data.size() * 8; pos++) {
+      if (pos < offset || pos >= offset + width) {
+        ASSERT_EQ(test_bit(data, pos), test_bit(before, pos)) << "bit " << pos << " outside the field changed";
+      }
+    }
+  }
+}
+}  // namespace
+}  // namespace redispp::test
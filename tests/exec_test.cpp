@@ -0,0 +1,260 @@
+#include "exec.h"
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "db.h"
+#include "test_utils.h"
+
+namespace redispp::test {
+namespace {
+using Command = std::vector<std::string>;
+
+auto encode(const Command &command) -> std::string {
+  auto request = fmt::format("*{}\r\n", command.size());
+  for (const auto &arg : command) {
+    request += fmt::format("${}\r\n{}\r\n", arg.size(), arg);
+  }
+  return request;
+}
+
+auto bulk(std::string_view str) -> std::string { return fmt::format("${}\r\n{}\r\n", str.size(), str); }
+auto integer(int64_t i) -> std::string { return fmt::format(":{}\r\n", i); }
+
+// Replied as a bulk string, like every status reply of the server.
+constexpr std::string_view Ok = "$2\r\nOK\r\n";
+constexpr std::string_view Nil = "$-1\r\n";
+constexpr std::string_view NilArray = "*-1\r\n";
+constexpr std::string_view WrongType = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+constexpr std::string_view NotInteger = "-CONVERSION_ERROR Invalid Integer\r\n";
+
+// The string and list commands as Redis documents them, on std::map, with the replies they should get in RESP2.
+class Model {
+ public:
+  auto Execute(const Command &cmd) -> std::string {
+    const auto &name = cmd[0];
+    const auto &key = cmd[1];
+    auto *str = find(m_strings, key);
+    auto *list = find(m_lists, key);
+
+    if (name == "SET") {
+      m_lists.erase(key);
+      m_strings[key] = cmd[2];
+      return std::string(Ok);
+    }
+
+    const bool list_command = name.ends_with("PUSH") || name.ends_with("POP") || name == "LLEN" || name == "LRANGE";
+    if (list_command ? str != nullptr : list != nullptr) {
+      return std::string(WrongType);
+    }
+
+    if (name == "GET") {
+      return str != nullptr ? bulk(*str) : std::string(Nil);
+    }
+    if (name == "GETDEL") {
+      auto reply = str != nullptr ? bulk(*str) : std::string(Nil);
+      m_strings.erase(key);
+      return reply;
+    }
+    if (name == "APPEND") {
+      return integer(static_cast<int64_t>((m_strings[key] += cmd[2]).size()));
+    }
+    if (name == "STRLEN") {
+      return integer(str != nullptr ? static_cast<int64_t>(str->size()) : 0);
+    }
+    if (name == "INCRBY" || name == "DECRBY") {
+      int64_t val = 0;
+      if (str != nullptr && !parse(*str, val)) {
+        return std::string(NotInteger);
+      }
+      val += (name == "INCRBY" ? 1 : -1) * std::stoll(cmd[2]);
+      m_strings[key] = std::to_string(val);
+      return integer(val);
+    }
+
+    if (name == "LPUSH" || name == "RPUSH") {
+      auto &pushed = m_lists[key];
+      for (size_t i = 2; i < cmd.size(); i++) {
+        name == "LPUSH" ? pushed.push_front(cmd[i]) : pushed.push_back(cmd[i]);
+      }
+      return integer(static_cast<int64_t>(pushed.size()));
+    }
+    if (name == "LPOP" || name == "RPOP") {
+      const bool with_count = cmd.size() == 3;
+      if (list == nullptr) {
+        return std::string(with_count ? NilArray : Nil);
+      }
+      std::vector<std::string> popped;
+      for (size_t i = 0; i < (with_count ? std::stoul(cmd[2]) : 1) && !list->empty(); i++) {
+        popped.push_back(name == "LPOP" ? list->front() : list->back());
+        name == "LPOP" ? list->pop_front() : list->pop_back();
+      }
+      if (list->empty()) {
+        m_lists.erase(key);
+      }
+      return with_count ? array(popped) : bulk(popped.front());
+    }
+    if (name == "LLEN") {
+      return integer(list != nullptr ? static_cast<int64_t>(list->size()) : 0);
+    }
+    if (name == "LRANGE") {
+      const auto len = list != nullptr ? static_cast<int64_t>(list->size()) : 0;
+      int64_t start = std::stoll(cmd[2]);
+      int64_t stop = std::stoll(cmd[3]);
+      start = start < 0 ? std::max<int64_t>(start + len, 0) : start;
+      stop = stop < 0 ? stop + len : std::min(stop, len - 1);
+      std::vector<std::string> range;
+      for (auto i = start; i <= stop && i < len; i++) {
+        range.push_back((*list)[static_cast<size_t>(i)]);
+      }
+      return array(range);
+    }
+    throw std::logic_error("Not modelled: " + name);
+  }
+
+ private:
+  template <typename Map>
+  static auto find(Map &map, const std::string &key) -> typename Map::mapped_type * {
+    auto it = map.find(key);
+    return it != map.end() ? &it->second : nullptr;
+  }
+
+  static auto parse(const std::string &str, int64_t &val) -> bool {
+    const auto res = std::from_chars(str.data(), str.data() + str.size(), val);
+    return res.ec == std::errc{} && res.ptr == str.data() + str.size();
+  }
+
+  static auto array(const std::vector<std::string> &elements) -> std::string {
+    auto reply = fmt::format("*{}\r\n", elements.size());
+    for (const auto &element : elements) {
+      reply += bulk(element);
+    }
+    return reply;
+  }
+
+  std::map<std::string, std::string> m_strings;
+  std::map<std::string, std::deque<std::string>> m_lists;
+};
+
+// Commands on a few keys, with values that are integers or not, and long ones that are stored compressed.
+auto random_command(std::mt19937 &rng) -> Command {
+  static constexpr std::array Names{"SET",   "GET",   "GETDEL", "APPEND", "STRLEN", "INCRBY", "DECRBY",
+                                    "LPUSH", "RPUSH", "LPOP",   "RPOP",   "LLEN",   "LRANGE"};
+  const auto pick = [&](size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+  const auto number = [&](int64_t min, int64_t max) {
+    return std::to_string(std::uniform_int_distribution<int64_t>(min, max)(rng));
+  };
+  const auto value = [&]() -> std::string {
+    switch (pick(4)) {
+      case 0:
+        return number(-100, 100);
+      case 1:
+        return std::string(pick(3), "xyz"[pick(3)]);
+      case 2:
+        return std::string(100 + pick(100), 'a') + number(0, 9);
+      default:
+        return "12abc";
+    }
+  };
+
+  Command cmd{Names[pick(Names.size())], fmt::format("key{}", pick(4))};
+  const auto &name = cmd[0];
+  if (name == "SET" || name == "APPEND") {
+    cmd.push_back(value());
+  } else if (name == "INCRBY" || name == "DECRBY") {
+    cmd.push_back(number(-1000, 1000));
+  } else if (name.ends_with("PUSH")) {
+    for (size_t i = 0, count = 1 + pick(3); i < count; i++) {
+      cmd.push_back(value());
+    }
+  } else if (name.ends_with("POP") && pick(2) == 0) {
+    cmd.push_back(number(0, 3));
+  } else if (name == "LRANGE") {
+    cmd.push_back(number(-6, 6));
+    cmd.push_back(number(-6, 6));
+  }
+  return cmd;
+}
+
+auto join(const Command &command) -> std::string {
+  std::string str;
+  for (const auto &arg : command) {
+    str += (str.empty() ? "" : " ") + arg;
+  }
+  return str;
+}
+
+// Seeded random command sequences, read in random segments, get the replies the model gives.
+TEST(Execute, MatchesModel) {
+  for (unsigned seed = 0; seed < 20; seed++) {
+    boost::asio::io_context io;
+    DB db;
+    db.SetCompressionThreshold(64);
+    Client client(io.get_executor(), OutputLimits{});
+    db.RegisterClient(client);
+    Model model;
+    std::mt19937 rng(seed);
+
+    for (size_t i = 0; i < 1000; i++) {
+      const auto command = random_command(rng);
+      const auto request = encode(command);
+      SegmentedReader reader{request, &rng, 7};
+      resp::Deserializer deserializer(reader);
+      std::string reply;
+      RunCoroutine(io, redispp::Execute(db, client, deserializer)).Encode(reply, resp::Protocol::Resp2);
+      ASSERT_EQ(reply, model.Execute(command)) << "seed " << seed << ", command " << i << ": " << join(command);
+    }
+    db.UnregisterClient(client);
+  }
+}
+
+// Only writers decompress a compressed string in the DB; readers decode it into buffers of their own.
+TEST(Execute, ReadsKeepValuesCompressed) {
+  boost::asio::io_context io;
+  DB db;
+  db.SetCompressionThreshold(64);
+  Client client(io.get_executor(), OutputLimits{});
+  db.RegisterClient(client);
+  std::mt19937 rng(0);
+  const auto run = [&](const Command &command) {
+    const auto request = encode(command);
+    SegmentedReader reader{request, &rng};
+    resp::Deserializer deserializer(reader);
+    std::string reply;
+    RunCoroutine(io, redispp::Execute(db, client, deserializer)).Encode(reply, resp::Protocol::Resp2);
+    return reply;
+  };
+  const auto compressed = [&] { return db.Find("key")->ShareCompressed() != nullptr; };
+
+  const std::string value(1000, 'a');
+  ASSERT_EQ(run({"SET", "key", value}), Ok);
+  ASSERT_TRUE(compressed());
+
+  EXPECT_EQ(run({"GET", "key"}), bulk(value));
+  EXPECT_EQ(run({"STRLEN", "key"}), integer(1000));
+  EXPECT_EQ(run({"GETRANGE", "key", "10", "12"}), bulk("aaa"));
+  EXPECT_EQ(run({"BITCOUNT", "key"}), integer(3000));
+  EXPECT_EQ(run({"BITCOUNT", "key", "1", "1"}), integer(3));
+  EXPECT_EQ(run({"GETBIT", "key", "7999"}), integer(1));
+  EXPECT_EQ(run({"GETBIT", "key", "7998"}), integer(0));
+  EXPECT_EQ(run({"BITPOS", "key", "1"}), integer(1));
+  EXPECT_EQ(run({"BITOP", "AND", "dest", "key", "key"}), integer(1000));
+  EXPECT_EQ(run({"PFCOUNT", "key"}), "-WRONGTYPE Key is not a valid HyperLogLog string value.\r\n");
+  EXPECT_TRUE(compressed());
+
+  EXPECT_EQ(run({"SETBIT", "key", "0", "1"}), integer(0));
+  EXPECT_FALSE(compressed());
+  EXPECT_EQ(run({"GET", "key"}), bulk("\xe1" + value.substr(1)));
+  db.UnregisterClient(client);
+}
+}  // namespace
+}  // namespace redispp::test
@@ -0,0 +1,120 @@
+#include "hyperloglog.h"
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace redispp::test {
+namespace {
+// The dense registers as Redis lays them out, 6 bits each from the least significant bit of each byte, read one by one
+// for comparison with the AVX2 unpacking.
+auto dense_registers(std::string_view hll) -> hll::RawRegisters {
+  hll::RawRegisters raw{};
+  const auto *p = reinterpret_cast<const unsigned char *>(hll.data() + hll::HeaderSize);
+  for (size_t i = 0; i < hll::Registers; i++) {
+    const auto byte = i * 6 / 8;
+    const auto shift = i * 6 % 8;
+    const unsigned next = byte + 1 < hll::DenseSize - hll::HeaderSize ? p[byte + 1] : 0;
+    raw[i] = static_cast<uint8_t>(((p[byte] >> shift) | (next << (8 - shift))) & 0x3f);
+  }
+  return raw;
+}
+
+auto registers(std::string_view hll) -> hll::RawRegisters {
+  hll::RawRegisters raw{};
+  hll::Merge(raw, hll);
+  return raw;
+}
+
+// The register an element sets, found by adding it alone to an empty HyperLogLog.
+auto register_of(std::string_view element) -> std::pair<size_t, uint8_t> {
+  std::pmr::string hll;
+  hll::Init(hll);
+  hll::Add(hll, element);
+  const auto raw = registers(hll);
+  const auto it = std::find_if(raw.begin(), raw.end(), [](uint8_t value) { return value != 0; });
+  return {static_cast<size_t>(it - raw.begin()), *it};
+}
+
+auto random_registers(std::mt19937 &rng) -> hll::RawRegisters {
+  hll::RawRegisters raw{};
+  std::generate(raw.begin(), raw.end(), [&] { return static_cast<uint8_t>(rng() % 52); });
+  return raw;
+}
+
+TEST(HyperLogLog, DenseRoundTrip) {
+  std::mt19937 rng(0);
+  for (size_t i = 0; i < 20; i++) {
+    const auto raw = random_registers(rng);
+    std::pmr::string hll;
+    hll::StoreDense(hll, raw);
+    ASSERT_TRUE(hll::IsValid(hll));
+    ASSERT_EQ(hll.size(), hll::DenseSize);
+    ASSERT_EQ(dense_registers(hll), raw);
+    ASSERT_EQ(registers(hll), raw);
+  }
+}
+
+TEST(HyperLogLog, MergeTakesTheMaximum) {
+  std::mt19937 rng(1);
+  for (size_t i = 0; i < 20; i++) {
+    const auto a = random_registers(rng);
+    const auto b = random_registers(rng);
+    std::pmr::string hll;
+    hll::StoreDense(hll, b);
+
+    auto merged = a;
+    hll::Merge(merged, hll);
+    for (size_t r = 0; r < hll::Registers; r++) {
+      ASSERT_EQ(merged[r], std::max(a[r], b[r])) << "register " << r;
+    }
+  }
+}
+
+// Elements added one at a time, through the sparse encoding and its promotion to dense, leave the registers the
+// elements set on their own, and are counted from them.
+TEST(HyperLogLog, AddMatchesRegisters) {
+  std::pmr::string hll;
+  hll::Init(hll);
+  hll::RawRegisters expected{};
+  size_t added = 0;
+  for (const size_t checkpoint : {1, 10, 100, 1000, 3000, 10000, 50000}) {
+    for (; added < checkpoint; added++) {
+      const auto element = fmt::format("element:{}", added);
+      const auto [index, value] = register_of(element);
+      const auto changed = value > expected[index];
+      expected[index] = std::max(expected[index], value);
+      ASSERT_EQ(hll::Add(hll, element), changed) << element;
+    }
+
+    ASSERT_TRUE(hll::IsValid(hll));
+    ASSERT_EQ(registers(hll), expected) << checkpoint << " elements";
+    if (hll.size() == hll::DenseSize) {
+      ASSERT_EQ(dense_registers(hll), expected) << checkpoint << " elements";
+    }
+
+    const auto count = hll::Count(hll);
+    ASSERT_EQ(count, hll::Estimate(expected)) << checkpoint << " elements";
+    ASSERT_EQ(hll::Count(hll), count) << "the cached cardinality";
+    const auto n = static_cast<double>(checkpoint);
+    EXPECT_NEAR(static_cast<double>(count), n, 0.03 * n + 1);
+  }
+  EXPECT_EQ(hll.size(), hll::DenseSize);
+}
+
+// The example of Redis' documentation.
+TEST(HyperLogLog, CountsLikeRedis) {
+  std::pmr::string hll;
+  hll::Init(hll);
+  for (const auto *element : {"a", "b", "c", "d", "e", "f", "g"}) {
+    hll::Add(hll, element);
+  }
+  EXPECT_EQ(hll::Count(hll), 7);
+}
+}  // namespace
+}  // namespace redispp::test
@@ -0,0 +1,92 @@
+#include "resp_serde.h"
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "test_utils.h"
+
+namespace redispp::test {
+namespace {
+auto bulk(std::string_view str) -> std::string { return fmt::format("${}\r\n{}\r\n", str.size(), str); }
+
+// Requests with every kind of token the deserializer reads, including terminators inside bulk strings, and a bulk
+// string larger than the read buffer, which is read straight into place.
+auto requests() -> std::vector<std::string> {
+  return {
+      "*3\r\n" + bulk("SET") + bulk("key") + bulk("hello\r\nworld\r"),
+      "PING a b\r\n",
+      "*2\r\n" + bulk("GET") + bulk(""),
+      "*1\r\n$-1\r\n",
+      "*-1\r\n",
+      "*0\r\n",
+      "*5\r\n:42\r\n:-9223372036854775808\r\n+simple\r\n-ERR an error\r\n_\r\n",
+      "*6\r\n,3.25\r\n,-inf\r\n#t\r\n#f\r\n(123456789012345678901234567890\r\n!5\r\nblob!\r\n",
+      "*1\r\n=14\r\ntxt:some\r\ntext\r\n",
+      "%2\r\n+k1\r\n:1\r\n+k2\r\n:2\r\n",
+      "~2\r\n+a\r\n+b\r\n",
+      ":7\r\n",
+      "*2\r\n" + bulk("SET") + bulk(std::string(40'000, 'x')),
+      "+" + std::string(1'000, 's') + "\r\n",
+  };
+}
+
+// Each command's tokens, concatenated.
+auto read_commands(resp::Deserializer &deserializer, size_t count) -> boost::asio::awaitable<std::vector<std::string>> {
+  std::vector<std::string> commands;
+  for (size_t i = 0; i < count; i++) {
+    std::string encoded;
+    for (const auto &tok : co_await ReadCommand(deserializer)) {
+      encoded += tok;
+    }
+    commands.push_back(std::move(encoded));
+  }
+  co_return commands;
+}
+
+auto read_all(const std::string &input, size_t count, std::mt19937 &rng, size_t max_segment)
+    -> std::vector<std::string> {
+  boost::asio::io_context io;
+  SegmentedReader reader{input, &rng, max_segment};
+  resp::Deserializer deserializer(reader);
+  return RunCoroutine(io, read_commands(deserializer, count));
+}
+
+// Input split in random segments of 1 to 7 bytes parses the same as when it's read at once.
+TEST(Deserializer, FragmentedInput) {
+  std::string input;
+  for (const auto &request : requests()) {
+    input += request;
+  }
+  const auto count = requests().size();
+  std::mt19937 rng(0);
+  const auto whole = read_all(input, count, rng, std::numeric_limits<size_t>::max());
+  ASSERT_EQ(whole.size(), count);
+
+  for (unsigned seed = 0; seed < 200; seed++) {
+    rng.seed(seed);
+    ASSERT_EQ(read_all(input, count, rng, 7), whole) << "seed " << seed;
+  }
+}
+
+// A request cut short at any point is an error, not a crash or a wait for more.
+TEST(Deserializer, TruncatedInput) {
+  std::mt19937 rng(0);
+  for (const auto &request : requests()) {
+    for (size_t len = request.size() - 1; len > 0; len = len > 64 ? len / 2 : len - 1) {
+      EXPECT_ANY_THROW(read_all(request.substr(0, len), 1, rng, 7)) << request.substr(0, len);
+    }
+  }
+}
+
+TEST(Deserializer, InvalidInput) {
+  std::mt19937 rng(0);
+  for (const std::string input : {"*1\r\n*1\r\n:1\r\n", "*2\r\nPING\r\n", "$-2\r\n", "*-2\r\n", ":1x\r\n", "#x\r\n",
+                                  "=2\r\nab\r\n", "$3\r\nabcd\r\n"}) {
+    EXPECT_ANY_THROW(read_all(input, 1, rng, 7)) << input;
+  }
+}
+}  // namespace
+}  // namespace redispp::test
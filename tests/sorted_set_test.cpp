@@ -0,0 +1,136 @@
+#include "sorted_set.h"
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispp::test {
+namespace {
+using Ordered = std::set<std::pair<double, std::string>>;
+
+// Many ties, so that members order elements of the same score, and infinities.
+auto random_score(std::mt19937 &rng) -> double {
+  switch (rng() % 8) {
+    case 0:
+      return -std::numeric_limits<double>::infinity();
+    case 1:
+      return std::numeric_limits<double>::infinity();
+    case 2:
+      return std::uniform_real_distribution<double>(-1e6, 1e6)(rng);
+    default:
+      return static_cast<double>(rng() % 50);
+  }
+}
+
+// Forward along the leaves from the first element, and backward from the last.
+void expect_order(const zset::SortedSet &zset, const Ordered &ordered) {
+  ASSERT_EQ(zset.Size(), ordered.size());
+  auto it = zset.At(0);
+  for (const auto &[score, member] : ordered) {
+    ASSERT_TRUE(it.Valid());
+    ASSERT_EQ(it.Score(), score);
+    ASSERT_EQ(it.Member(), member);
+    it.Next();
+  }
+  ASSERT_FALSE(it.Valid());
+
+  if (ordered.empty()) {
+    return;
+  }
+  it = zset.At(ordered.size() - 1);
+  for (auto rit = ordered.rbegin(); rit != ordered.rend(); ++rit) {
+    ASSERT_TRUE(it.Valid());
+    ASSERT_EQ(it.Member(), rit->second);
+    it.Prev();
+  }
+  ASSERT_FALSE(it.Valid());
+}
+
+// Random adds, score updates and removes against std::map and std::set: the set grows to thousands of elements, which
+// splits leaves and inner nodes, and then shrinks to nothing, which borrows between and merges them.
+TEST(SortedSet, MatchesOrderedSet) {
+  for (unsigned seed = 0; seed < 5; seed++) {
+    std::mt19937 rng(seed);
+    zset::SortedSet zset(std::pmr::new_delete_resource());
+    std::map<std::string, double> scores;
+    Ordered ordered;
+
+    for (const auto add_percent : {90U, 50U, 10U}) {
+      for (size_t i = 0; i < 4000; i++) {
+        const auto member = fmt::format("member:{}", rng() % 3000);
+        if (rng() % 100 < add_percent) {
+          const auto score = random_score(rng);
+          const auto old = scores.find(member);
+          ASSERT_EQ(zset.Add(member, score), old == scores.end()) << member;
+          if (old != scores.end()) {
+            ordered.erase({old->second, member});
+          }
+          scores[member] = score;
+          ordered.emplace(score, member);
+        } else {
+          const auto old = scores.find(member);
+          ASSERT_EQ(zset.Remove(member), old != scores.end()) << member;
+          if (old != scores.end()) {
+            ordered.erase({old->second, member});
+            scores.erase(old);
+          }
+        }
+
+        // Lookups by member, by rank and by score.
+        const auto probe = fmt::format("member:{}", rng() % 3000);
+        const auto score = scores.find(probe);
+        ASSERT_EQ(zset.Score(probe), score != scores.end() ? std::optional(score->second) : std::nullopt);
+        if (score != scores.end() && i % 10 == 0) {
+          const auto rank = size_t(std::distance(ordered.begin(), ordered.find({score->second, probe})));
+          ASSERT_EQ(zset.Rank(probe), rank) << probe;
+          const auto at = zset.At(rank);
+          ASSERT_TRUE(at.Valid());
+          ASSERT_EQ(at.Member(), probe);
+        }
+
+        const auto min = random_score(rng);
+        const bool exclusive = rng() % 2 == 0;
+        const auto bound = exclusive ? ordered.upper_bound({min, std::string(1, '\xff')})
+                                     : ordered.lower_bound({min, std::string()});
+        const auto it = zset.LowerBound(min, exclusive);
+        ASSERT_EQ(it.Valid(), bound != ordered.end()) << (exclusive ? "(" : "") << min;
+        if (it.Valid()) {
+          ASSERT_EQ(it.Member(), bound->second) << (exclusive ? "(" : "") << min;
+        }
+
+        if (i % 500 == 0) {
+          ASSERT_NO_FATAL_FAILURE(expect_order(zset, ordered));
+        }
+      }
+      ASSERT_NO_FATAL_FAILURE(expect_order(zset, ordered));
+    }
+
+    std::vector<std::string> members;
+    for (const auto &[member, score] : scores) {
+      members.push_back(member);
+    }
+    std::shuffle(members.begin(), members.end(), rng);
+    for (size_t i = 0; i < members.size(); i++) {
+      ASSERT_TRUE(zset.Remove(members[i]));
+      ordered.erase({scores[members[i]], members[i]});
+      if (i % 100 == 0) {
+        ASSERT_NO_FATAL_FAILURE(expect_order(zset, ordered));
+      }
+    }
+    ASSERT_NO_FATAL_FAILURE(expect_order(zset, ordered));
+  }
+}
+}  // namespace
+}  // namespace redispp::test
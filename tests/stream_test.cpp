@@ -0,0 +1,131 @@
+#include "stream.h"
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispp::test {
+namespace {
+using Fields = std::vector<std::pair<std::string, std::string>>;
+using Entries = std::map<stream::ID, Fields>;
+
+auto format(stream::ID id) -> std::string { return fmt::format("{}-{}", id.ms, id.seq); }
+
+// Mostly the fields of the first entry, which nodes store without their names, sometimes others; values are now and
+// then long enough to fill a node's buffer before its entry count.
+auto random_fields(std::mt19937 &rng) -> Fields {
+  const auto value = [&] {
+    return std::string(rng() % 10 == 0 ? 200 + rng() % 1500 : rng() % 12, static_cast<char>('a' + rng() % 26));
+  };
+  if (rng() % 4 != 0) {
+    return {{"temperature", value()}, {"humidity", value()}};
+  }
+  Fields fields(1 + rng() % 4);
+  for (auto &[name, field] : fields) {
+    name = fmt::format("field{}", rng() % 6);
+    field = value();
+  }
+  return fields;
+}
+
+auto range(stream::Stream &stream, stream::ID start, stream::ID end, size_t count) -> Entries {
+  Entries entries;
+  stream.Range(start, end, count, [&](const stream::Node::Cursor &entry) {
+    auto &fields = entries[entry.Id()];
+    entry.ForEachField([&](std::string_view name, std::string_view value) { fields.emplace_back(name, value); });
+  });
+  return entries;
+}
+
+auto range(const Entries &entries, stream::ID start, stream::ID end, size_t count) -> Entries {
+  Entries result;
+  for (auto it = entries.lower_bound(start); it != entries.end() && it->first <= end && result.size() < count; ++it) {
+    result.insert(*it);
+  }
+  return result;
+}
+
+// An ID of the stream, or one in between, before or after them.
+auto random_id(std::mt19937 &rng, const Entries &entries, stream::ID last) -> stream::ID {
+  if (!entries.empty() && rng() % 2 == 0) {
+    return std::next(entries.begin(), static_cast<ptrdiff_t>(rng() % entries.size()))->first;
+  }
+  return {rng() % (last.ms + 2), rng() % 3};
+}
+
+// Random adds, range reads and trims against std::map. Entries are packed into macro nodes, which trimming erases
+// whole or marks partly deleted.
+TEST(Stream, MatchesMap) {
+  for (unsigned seed = 0; seed < 10; seed++) {
+    std::mt19937 rng(seed);
+    stream::Stream stream(std::pmr::new_delete_resource());
+    Entries entries;
+    stream::ID last;
+
+    for (size_t i = 0; i < 5000; i++) {
+      const auto op = rng() % 10;
+      if (op < 6) {
+        // Several entries in the same millisecond now and then.
+        const auto ms = last.ms + rng() % 3;
+        const stream::ID id{ms, ms == last.ms ? last.seq + 1 : 0};
+        const auto fields = random_fields(rng);
+        std::vector<resp::String> args;
+        for (const auto &[name, value] : fields) {
+          args.emplace_back(name);
+          args.emplace_back(value);
+        }
+        stream.Add(id, args);
+        entries.emplace(id, fields);
+        last = id;
+      } else if (op < 8) {
+        auto start = random_id(rng, entries, last);
+        auto end = rng() % 4 == 0 ? stream::ID::Max() : random_id(rng, entries, last);
+        if (end < start) {
+          std::swap(start, end);
+        }
+        const auto count = rng() % 2 == 0 ? std::numeric_limits<size_t>::max() : 1 + rng() % 150;
+        ASSERT_EQ(range(stream, start, end, count), range(entries, start, end, count))
+            << "seed " << seed << ", [" << format(start) << ", " << format(end) << "] count " << count;
+      } else if (op < 9) {
+        const auto maxlen = entries.size() - std::min<size_t>(entries.size(), rng() % 300);
+        const bool approx = rng() % 2 == 0;
+        const auto removed = stream.TrimMaxLen(maxlen, approx);
+        // Approximate trimming only removes whole nodes, so it may keep more.
+        ASSERT_LE(removed, entries.size() - maxlen);
+        if (!approx) {
+          ASSERT_EQ(removed, entries.size() - maxlen);
+        }
+        entries.erase(entries.begin(), std::next(entries.begin(), static_cast<ptrdiff_t>(removed)));
+      } else {
+        const auto minid = random_id(rng, entries, last);
+        const bool approx = rng() % 2 == 0;
+        const auto removed = stream.TrimMinId(minid, approx);
+        const auto older = static_cast<size_t>(std::distance(entries.begin(), entries.lower_bound(minid)));
+        ASSERT_LE(removed, older) << "MINID " << format(minid);
+        if (!approx) {
+          ASSERT_EQ(removed, older) << "MINID " << format(minid);
+        }
+        entries.erase(entries.begin(), std::next(entries.begin(), static_cast<ptrdiff_t>(removed)));
+      }
+
+      ASSERT_EQ(stream.Length(), entries.size()) << "seed " << seed << ", operation " << i;
+      if (i % 250 == 0) {
+        ASSERT_EQ(range(stream, {}, stream::ID::Max(), entries.size()), entries) << "seed " << seed;
+      }
+    }
+    ASSERT_EQ(stream.LastId(), last);
+    ASSERT_EQ(range(stream, {}, stream::ID::Max(), entries.size()), entries) << "seed " << seed;
+  }
+}
+}  // namespace
+}  // namespace redispp::test
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/smart_ptr/make_local_shared.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "resp_serde.h"
+
+namespace redispp::test {
+// A `resp::Reader` handing out its input in segments of 1 to `max_segment` bytes, of random sizes, the way TCP may
+// split it, so that the deserializer meets every boundary of the encoding sooner or later. The end of the input reads
+// as the peer closing the connection.
+struct SegmentedReader {
+  std::string_view input;
+  std::mt19937 *rng;
+  size_t max_segment = std::numeric_limits<size_t>::max();
+};
+
+inline auto ReadSome(SegmentedReader &reader, char *buf, size_t len) -> boost::asio::awaitable<size_t> {
+  std::uniform_int_distribution<size_t> segment(1, reader.max_segment);
+  const auto n = std::min({len, reader.input.size(), segment(*reader.rng)});
+  std::copy_n(reader.input.data(), n, buf);
+  reader.input.remove_prefix(n);
+  co_return n;
+}
+
+// The tokens of the next command, each encoded in RESP3 so that they compare as strings. Throws when the input isn't
+// valid RESP or ends first.
+inline auto ReadCommand(resp::Deserializer &deserializer) -> boost::asio::awaitable<std::vector<std::string>> {
+  auto executor = co_await boost::asio::this_coro::executor;
+  auto ch = boost::make_local_shared<resp::Channel>(executor);
+  boost::asio::co_spawn(executor, deserializer.SendTokens(ch), [ch](const std::exception_ptr &e) {
+    if (e) {
+      ch->close();
+    }
+  });
+
+  std::vector<std::string> tokens;
+  for (;;) {
+    auto tok = co_await ch->async_receive(boost::asio::use_awaitable);
+    if (std::holds_alternative<resp::EndOfCommand_t>(tok)) {
+      break;
+    }
+    resp::Encode(tokens.emplace_back(), tok, resp::Protocol::Resp3);
+  }
+  co_return tokens;
+}
+
+// The commands read until the input ends, or up to the first invalid one.
+struct Parsed {
+  std::vector<std::vector<std::string>> commands;
+  bool failed = false;
+
+  auto operator==(const Parsed &) const -> bool = default;
+};
+
+inline auto ReadAll(resp::Deserializer &deserializer, const SegmentedReader &reader) -> boost::asio::awaitable<Parsed> {
+  Parsed parsed;
+  try {
+    while (!reader.input.empty() || deserializer.Buffered() != 0) {
+      parsed.commands.push_back(co_await ReadCommand(deserializer));
+    }
+  } catch (const std::exception &) {
+    parsed.failed = true;
+  }
+  co_return parsed;
+}
+
+// Runs the coroutine, and whatever it spawns, to completion and returns its result or throws its exception.
+template <typename T>
+auto RunCoroutine(boost::asio::io_context &io, boost::asio::awaitable<T> coro) -> T {
+  std::optional<T> result;
+  std::exception_ptr error;
+  boost::asio::co_spawn(io, std::move(coro), [&](std::exception_ptr e, T value) {
+    error = e;
+    result.emplace(std::move(value));
+  });
+  io.restart();
+  io.run();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return std::move(*result);
+}
+}  // namespace redispp::test